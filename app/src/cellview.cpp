@@ -127,6 +127,18 @@ void CellItem::paint(QPainter *painter, const QStyleOptionGraphicsItem*, QWidget
     }
 }
 
+/* 現在のスピン配位を行優先で1次元に並べて返す */
+void CellItem::snapshot(std::vector<double>& cells, int& rows, int& cols) const
+{
+    rows = static_cast<int>(state.rows());
+    cols = static_cast<int>(state.cols());
+    cells.resize(state.rows() * state.cols());
+
+    for(size_t i = 0; i < state.rows(); ++i)
+        for(size_t j = 0; j < state.cols(); ++j)
+            cells[i * state.cols() + j] = static_cast<double>(state.at(i, j));
+}
+
 void CellItem::setInterval(const int msec)
 {
     timer->setInterval(msec);
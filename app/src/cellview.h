@@ -56,6 +56,8 @@ public:
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
 
     int maxCount() const { return _maxCount; }
+    int cellWidth() const { return cellSize; }
+    void snapshot(std::vector<double>& cells, int& rows, int& cols) const;
     double paramKbT() const { return ising.kbT(); }
     double paramJ() const { return ising.param.J; }
 
@@ -11,12 +11,18 @@ CONFIG += c++17
 SOURCES += \
     cellview.cpp \
     main.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    phaseoverlay.cpp \
+    trajectoryview.cpp
 
 HEADERS += \
     F:/repos/CmpPhys2/03/cplus/metropolismethod.h \
+    F:/repos/CmpPhys2/03/cplus/neuralnetwork.h \
+    F:/repos/CmpPhys2/03/cplus/trajectory.h \
     cellview.h \
     mainwindow.h \
+    phaseoverlay.h \
+    trajectoryview.h \
 
 INCLUDEPATH += F:/repos/CmpPhys2/03/cplus
 
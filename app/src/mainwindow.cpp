@@ -1,13 +1,18 @@
 #include "mainwindow.h"
 
 #include <QVBoxLayout>
+#include <QTabWidget>
 #include "cellview.h"
+#include "trajectoryview.h"
+#include "phaseoverlay.h"
 #include <QFileDialog>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
 {
-    QWidget *centralWidget = new QWidget(this);
+    QTabWidget *tabWidget = new QTabWidget(this);
+    QWidget *centralWidget = new QWidget(tabWidget);
+    TrajectoryPlayerWidget *playerWidget = new TrajectoryPlayerWidget(tabWidget);
     QVBoxLayout *vLayout = new QVBoxLayout(centralWidget);
     QWidget *contentsWidget = new QWidget(centralWidget);
     QHBoxLayout *contentsLayout = new QHBoxLayout(contentsWidget);
@@ -15,17 +20,21 @@ MainWindow::MainWindow(QWidget *parent)
     CellItem *cellItem = new CellItem(cellView, nullptr);
     ParameterSettingWidget *paramSetting = new ParameterSettingWidget(contentsWidget, cellItem);
     CellViewSettingWidget *settingWidget = new CellViewSettingWidget(centralWidget, cellItem);
+    PhaseOverlayWidget *overlayWidget = new PhaseOverlayWidget(contentsWidget, cellItem);
 
     cellView->scene()->addItem(cellItem);
     contentsLayout->setContentsMargins(0, 0, 0, 0);
     contentsWidget->setContentsMargins(0, 0, 0, 0);
 
-    setCentralWidget(centralWidget);
+    setCentralWidget(tabWidget);
+    tabWidget->addTab(centralWidget, "Simulation");
+    tabWidget->addTab(playerWidget, "Playback");
     centralWidget->setLayout(vLayout);
     vLayout->addWidget(contentsWidget);
     contentsWidget->setLayout(contentsLayout);
     contentsLayout->addWidget(cellView);
     contentsLayout->addWidget(paramSetting);
+    contentsLayout->addWidget(overlayWidget);
     vLayout->addWidget(settingWidget);
 
     connect(settingWidget, &CellViewSettingWidget::saveRequested, [=]()
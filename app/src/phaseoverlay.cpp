@@ -0,0 +1,260 @@
+#include "phaseoverlay.h"
+
+#include <QCheckBox>
+#include <QElapsedTimer>
+#include <QFileDialog>
+#include <QFormLayout>
+#include <QLineEdit>
+#include <QMutexLocker>
+#include <QPainter>
+#include <QPushButton>
+#include <QSpinBox>
+#include <QTimer>
+#include <cmath>
+#include "cellview.h"
+#include "neuralnetwork.h"
+
+PhasePredictor::PhasePredictor()
+    : QObject(nullptr)
+{
+}
+
+PhasePredictor::~PhasePredictor()
+{
+    delete model;
+}
+
+/* UIスレッドから呼ばれる．推論待ちのスナップショットは新しいもので上書きする． */
+void PhasePredictor::submit(Snapshot&& snapshot)
+{
+    QMutexLocker locker(&mutex);
+
+    pending = std::move(snapshot);
+    hasPending = true;
+
+    if(!scheduled)
+    {
+        scheduled = true;
+        QMetaObject::invokeMethod(this, &PhasePredictor::processLatest, Qt::QueuedConnection);
+    }
+}
+
+void PhasePredictor::loadNetwork(const QString& path)
+{
+    delete model;
+    model = nn::NetworkModel::load(path.toLocal8Bit().toStdString());
+    windowSize = 0;
+
+    //入力は正方形のスピン配位を1次元に並べたもの
+    if(model)
+    {
+        const int size = static_cast<int>(std::lround(std::sqrt(static_cast<double>(model->elemSize()))));
+        if(static_cast<size_t>(size * size) == model->elemSize() && model->labelSize() == 2)
+            windowSize = size;
+        else
+        {
+            delete model;
+            model = nullptr;
+        }
+    }
+
+    emit networkLoaded(model != nullptr, windowSize);
+}
+
+void PhasePredictor::processLatest()
+{
+    Snapshot snapshot;
+    {
+        QMutexLocker locker(&mutex);
+        snapshot = std::move(pending);
+        hasPending = false;
+    }
+
+    predict(snapshot);
+
+    QMutexLocker locker(&mutex);
+    if(hasPending)
+        QMetaObject::invokeMethod(this, &PhasePredictor::processLatest, Qt::QueuedConnection);
+    else
+        scheduled = false;
+}
+
+/* スピン配位を windowSize 四方のウィンドウに切り出してまとめて推論する */
+void PhasePredictor::predict(const Snapshot& snapshot)
+{
+    if(!model || snapshot.rows < windowSize || snapshot.cols < windowSize) return;
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    const int step = std::max(1, stride.load());
+    const int heatRows = (snapshot.rows - windowSize) / step + 1;
+    const int heatCols = (snapshot.cols - windowSize) / step + 1;
+
+    nn::vec2d x(heatRows * heatCols, nn::vec1d(windowSize * windowSize));
+    for(int i = 0; i < heatRows; ++i)
+        for(int j = 0; j < heatCols; ++j)
+        {
+            nn::vec1d& window = x[i * heatCols + j];
+            for(int r = 0; r < windowSize; ++r)
+                for(int c = 0; c < windowSize; ++c)
+                    window[r * windowSize + c] = snapshot.cells[(i * step + r) * snapshot.cols + j * step + c];
+        }
+
+    const nn::vec2d out = nn::Network::forward(*model, x);
+
+    PhasePrediction prediction;
+    prediction.serial = snapshot.serial;
+    prediction.windowSize = windowSize;
+    prediction.stride = step;
+    prediction.heatRows = heatRows;
+    prediction.heatCols = heatCols;
+    prediction.heatMap.resize(out.size());
+
+    for(size_t i = 0; i < out.size(); ++i)
+    {
+        prediction.disordered += out[i][0];
+        prediction.ordered += out[i][1];
+        prediction.heatMap[i] = out[i][1];
+    }
+    prediction.disordered /= out.size();
+    prediction.ordered /= out.size();
+    prediction.msec = elapsed.nsecsElapsed() * 1e-6;
+
+    emit predicted(prediction);
+}
+
+
+
+
+PhaseOverlayItem::PhaseOverlayItem(CellItem *cell)
+    : QGraphicsItem(cell)
+    , cell(cell)
+{
+}
+
+QRectF PhaseOverlayItem::boundingRect() const
+{
+    return cell->boundingRect();
+}
+
+/* 各ウィンドウの中心付近 stride 四方を，低温相なら赤，高温相なら青で塗る */
+void PhaseOverlayItem::paint(QPainter *painter, const QStyleOptionGraphicsItem*, QWidget*)
+{
+    if(prediction.heatMap.isEmpty()) return;
+
+    const int cellSize = cell->cellWidth();
+    const int offset = (prediction.windowSize - prediction.stride) / 2;
+
+    for(int i = 0; i < prediction.heatRows; ++i)
+        for(int j = 0; j < prediction.heatCols; ++j)
+        {
+            const double p = prediction.heatMap[i * prediction.heatCols + j];
+            const QColor color(static_cast<int>(255 * p), 0, static_cast<int>(255 * (1.0 - p)), 110);
+
+            painter->fillRect((i * prediction.stride + offset) * cellSize,
+                              (j * prediction.stride + offset) * cellSize,
+                              prediction.stride * cellSize,
+                              prediction.stride * cellSize,
+                              color);
+        }
+}
+
+void PhaseOverlayItem::setPrediction(const PhasePrediction& prediction)
+{
+    this->prediction = prediction;
+    update();
+}
+
+
+
+
+PhaseOverlayWidget::PhaseOverlayWidget(QWidget *parent, CellItem *cell)
+    : QWidget(parent)
+    , cell(cell)
+    , overlay(new PhaseOverlayItem(cell))
+    , predictor(new PhasePredictor)
+    , timer(new QTimer(this))
+{
+    qRegisterMetaType<PhasePrediction>();
+
+    QFormLayout *fLayout = new QFormLayout(this);
+    QPushButton *loadButton = new QPushButton("Load Network", this);
+    QCheckBox *heatMapCheck = new QCheckBox(this);
+    QSpinBox *strideSpin = new QSpinBox(this);
+    orderedLineEdit = new QLineEdit(this);
+    disorderedLineEdit = new QLineEdit(this);
+    latencyLineEdit = new QLineEdit(this);
+
+    setLayout(fLayout);
+    fLayout->addRow("", loadButton);
+    fLayout->addRow("Heat Map", heatMapCheck);
+    fLayout->addRow("Stride", strideSpin);
+    fLayout->addRow("P(ordered)", orderedLineEdit);
+    fLayout->addRow("P(disordered)", disorderedLineEdit);
+    fLayout->addRow("Latency [ms]", latencyLineEdit);
+
+    heatMapCheck->setChecked(true);
+    strideSpin->setRange(1, 50);
+    strideSpin->setValue(5);
+    orderedLineEdit->setReadOnly(true);
+    disorderedLineEdit->setReadOnly(true);
+    latencyLineEdit->setReadOnly(true);
+    timer->setInterval(33); //推論の結果に関係なく描画のフレームレートで投げる
+
+    predictor->moveToThread(&workerThread);
+    connect(&workerThread, &QThread::finished, predictor, &QObject::deleteLater);
+    workerThread.start();
+
+    connect(loadButton, &QPushButton::released, this, [this]()
+    {
+        const QString path = QFileDialog::getOpenFileName(this);
+
+        if(!path.isEmpty()) emit loadRequested(path);
+    });
+    connect(this, &PhaseOverlayWidget::loadRequested, predictor, &PhasePredictor::loadNetwork);
+    connect(predictor, &PhasePredictor::networkLoaded, this, [this](const bool ok, const int)
+    {
+        networkReady = ok;
+        cellChanged = true;
+        overlay->setPrediction(PhasePrediction());
+        if(ok) timer->start(); else timer->stop();
+    });
+    connect(predictor, &PhasePredictor::predicted, this, &PhaseOverlayWidget::showPrediction);
+    connect(heatMapCheck, &QCheckBox::toggled, this, [this](const bool checked){ overlay->setVisible(checked); });
+    connect(strideSpin, &QSpinBox::valueChanged, this, [this](const int value)
+    {
+        predictor->setStride(value);
+        cellChanged = true;
+    });
+    connect(cell, &CellItem::stepChanged, this, [this](){ cellChanged = true; });
+    connect(timer, &QTimer::timeout, this, &PhaseOverlayWidget::submitSnapshot);
+
+    setContentsMargins(0, 0, 0, 0);
+}
+
+PhaseOverlayWidget::~PhaseOverlayWidget()
+{
+    workerThread.quit();
+    workerThread.wait();
+}
+
+void PhaseOverlayWidget::submitSnapshot()
+{
+    if(!networkReady || !cellChanged) return;
+
+    PhasePredictor::Snapshot snapshot;
+    cell->snapshot(snapshot.cells, snapshot.rows, snapshot.cols);
+    snapshot.serial = ++serial;
+    cellChanged = false;
+
+    predictor->submit(std::move(snapshot));
+}
+
+void PhaseOverlayWidget::showPrediction(const PhasePrediction& prediction)
+{
+    orderedLineEdit->setText(QString::number(prediction.ordered));
+    disorderedLineEdit->setText(QString::number(prediction.disordered));
+    latencyLineEdit->setText(QString::number(prediction.msec) + " (" + QString::number(serial - prediction.serial) + " behind)");
+    overlay->setPrediction(prediction);
+}
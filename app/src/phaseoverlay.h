@@ -0,0 +1,126 @@
+#ifndef PHASEOVERLAY_H
+#define PHASEOVERLAY_H
+
+#include <QGraphicsItem>
+#include <QMutex>
+#include <QObject>
+#include <QThread>
+#include <QVector>
+#include <QWidget>
+#include <atomic>
+#include <vector>
+
+namespace nn { class NetworkModel; }
+
+class CellItem;
+class QLineEdit;
+class QTimer;
+
+
+/* 推論結果 */
+struct PhasePrediction
+{
+    quint64 serial = 0;        //推論したスナップショットの番号
+    double disordered = 0.0;   //高温相(ラベル{1,0})の確率．全ウィンドウの平均
+    double ordered = 0.0;      //低温相(ラベル{0,1})の確率．全ウィンドウの平均
+    int windowSize = 0;
+    int stride = 0;
+    int heatRows = 0;
+    int heatCols = 0;
+    QVector<double> heatMap;   //ウィンドウごとの低温相の確率
+    double msec = 0.0;         //推論にかかった時間
+};
+Q_DECLARE_METATYPE(PhasePrediction)
+
+
+/* ワーカースレッド上で学習済みネットワークの推論をする．
+ * submit() は最新のスナップショットだけを保持し，推論中に届いた古いものは捨てる．
+ */
+class PhasePredictor : public QObject
+{
+    Q_OBJECT
+public:
+    struct Snapshot
+    {
+        std::vector<double> cells;
+        int rows = 0;
+        int cols = 0;
+        quint64 serial = 0;
+    };
+
+    PhasePredictor();
+    ~PhasePredictor();
+
+    void submit(Snapshot&& snapshot);
+    void setStride(const int stride) { this->stride = stride; }
+
+public slots:
+    void loadNetwork(const QString& path);
+
+signals:
+    void networkLoaded(const bool ok, const int windowSize);
+    void predicted(const PhasePrediction& prediction);
+
+private slots:
+    void processLatest();
+
+private:
+    void predict(const Snapshot& snapshot);
+
+    QMutex mutex;
+    Snapshot pending;
+    bool hasPending = false;
+    bool scheduled = false;
+
+    nn::NetworkModel *model = nullptr; //ワーカースレッドからのみ触る
+    int windowSize = 0;
+    std::atomic<int> stride = 5;
+};
+
+/* セルの上に推論したヒートマップを重ねて描く */
+class PhaseOverlayItem : public QGraphicsItem
+{
+public:
+    PhaseOverlayItem(CellItem *cell);
+
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
+
+    void setPrediction(const PhasePrediction& prediction);
+
+private:
+    CellItem *cell;
+    PhasePrediction prediction;
+};
+
+class PhaseOverlayWidget : public QWidget
+{
+    Q_OBJECT
+public:
+    PhaseOverlayWidget(QWidget *parent, CellItem *cell);
+    ~PhaseOverlayWidget();
+
+signals:
+    void loadRequested(const QString& path);
+
+private slots:
+    void submitSnapshot();
+    void showPrediction(const PhasePrediction& prediction);
+
+private:
+    CellItem *cell;
+    PhaseOverlayItem *overlay;
+    QThread workerThread;
+    PhasePredictor *predictor;
+    QTimer *timer;
+
+    QLineEdit *orderedLineEdit;
+    QLineEdit *disorderedLineEdit;
+    QLineEdit *latencyLineEdit;
+
+    bool networkReady = false;
+    bool cellChanged = true;
+    quint64 serial = 0;
+};
+
+#endif // PHASEOVERLAY_H
@@ -0,0 +1,316 @@
+#include "trajectoryview.h"
+
+#include <QFileDialog>
+#include <QFormLayout>
+#include <QGraphicsScene>
+#include <QGraphicsView>
+#include <QHBoxLayout>
+#include <QLineEdit>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPushButton>
+#include <QSlider>
+#include <QSpinBox>
+#include <QTimer>
+#include <QVBoxLayout>
+#include <algorithm>
+#include <limits>
+
+TrajectoryItem::TrajectoryItem(QObject *obj, QGraphicsItem *parent)
+    : QObject(obj)
+    , QGraphicsItem(parent)
+{
+}
+
+QRectF TrajectoryItem::boundingRect() const
+{
+    return QRectF(0, 0, _reader.rows() * cellSize, _reader.cols() * cellSize);
+}
+
+void TrajectoryItem::paint(QPainter *painter, const QStyleOptionGraphicsItem*, QWidget*)
+{
+    if(image.isNull()) return;
+
+    painter->drawImage(boundingRect(), image);
+}
+
+void TrajectoryItem::setCellWidth(const int width)
+{
+    prepareGeometryChange();
+    cellSize = width;
+}
+
+bool TrajectoryItem::openFile(const QString& path)
+{
+    prepareGeometryChange();
+
+    if(!_reader.open(path.toLocal8Bit().toStdString()))
+    {
+        image = QImage();
+        return false;
+    }
+
+    //CellItemと同じく行をx方向，列をy方向に描く
+    image = QImage(static_cast<int>(_reader.rows()), static_cast<int>(_reader.cols()), QImage::Format_Grayscale8);
+
+    return showFrame(0);
+}
+
+bool TrajectoryItem::showFrame(const size_t frame)
+{
+    if(!_reader.seek(frame)) return false;
+
+    for(size_t j = 0; j < _reader.cols(); ++j)
+    {
+        uchar *line = image.scanLine(static_cast<int>(j));
+        for(size_t i = 0; i < _reader.rows(); ++i)
+            line[i] = (_reader.at(i, j)) ? 0 : 255;
+    }
+
+    update();
+
+    return true;
+}
+
+
+
+
+ObservableCurveWidget::ObservableCurveWidget(QWidget *parent)
+    : QWidget(parent)
+{
+    setMinimumHeight(120);
+}
+
+void ObservableCurveWidget::setCurve(const Trajectory::TrajectoryReader& reader)
+{
+    frameCount = reader.frameCount();
+    currentFrame = 0;
+
+    const size_t bucketCount = std::min(frameCount, maxBucketCount);
+    minValues.fill(std::numeric_limits<double>::max(), static_cast<int>(bucketCount));
+    maxValues.fill(- std::numeric_limits<double>::max(), static_cast<int>(bucketCount));
+
+    if(bucketCount == 0)
+    {
+        update();
+        return;
+    }
+
+    //全フレームのヘッダだけを走査し，区間ごとの磁化の最小・最大を求める
+    const double spinCount = static_cast<double>(reader.rows() * reader.cols());
+    reader.forEachFrameHeader([&](const size_t& frame, const Trajectory::TrajectoryReader::FrameHeader& header)
+    {
+        const int bucket = static_cast<int>(static_cast<double>(frame) / frameCount * bucketCount);
+        const double m = (2.0 * header.upCount - spinCount) / spinCount;
+        minValues[bucket] = std::min(minValues[bucket], m);
+        maxValues[bucket] = std::max(maxValues[bucket], m);
+    });
+
+    update();
+}
+
+void ObservableCurveWidget::setCurrentFrame(const size_t frame)
+{
+    currentFrame = frame;
+    update();
+}
+
+void ObservableCurveWidget::paintEvent(QPaintEvent*)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::white);
+
+    const double w = width();
+    const double h = height();
+    const auto toY = [h](const double& m){ return 0.5 * h * (1.0 - m); };
+
+    painter.setPen(Qt::lightGray);
+    painter.drawLine(QPointF(0, toY(0)), QPointF(w, toY(0)));
+
+    if(frameCount == 0) return;
+
+    const int bucketCount = minValues.size();
+    painter.setPen(Qt::blue);
+    for(int i = 0; i < bucketCount; ++i)
+    {
+        if(minValues[i] > maxValues[i]) continue;
+
+        const double x = w * (i + 0.5) / bucketCount;
+        painter.drawLine(QPointF(x, toY(minValues[i])), QPointF(x, toY(maxValues[i])));
+    }
+
+    const double cursorX = w * (static_cast<double>(currentFrame) + 0.5) / frameCount;
+    painter.setPen(Qt::red);
+    painter.drawLine(QPointF(cursorX, 0), QPointF(cursorX, h));
+}
+
+void ObservableCurveWidget::mousePressEvent(QMouseEvent *event)
+{
+    if(frameCount == 0) return;
+
+    const double ratio = std::clamp(event->position().x() / width(), 0.0, 1.0);
+    emit seekRequested(std::min(static_cast<size_t>(ratio * frameCount), frameCount - 1));
+}
+
+
+
+
+TrajectoryPlayerWidget::TrajectoryPlayerWidget(QWidget *parent)
+    : QWidget(parent)
+    , timer(new QTimer(this))
+{
+    QVBoxLayout *vLayout = new QVBoxLayout(this);
+    QWidget *contentsWidget = new QWidget(this);
+    QHBoxLayout *contentsLayout = new QHBoxLayout(contentsWidget);
+    QGraphicsView *view = new QGraphicsView(new QGraphicsScene(this), contentsWidget);
+    QWidget *settingWidget = new QWidget(contentsWidget);
+    QFormLayout *fLayout = new QFormLayout(settingWidget);
+    QPushButton *openButton = new QPushButton("Open", settingWidget);
+    QPushButton *playButton = new QPushButton("Play", settingWidget);
+    QPushButton *pauseButton = new QPushButton("Pause", settingWidget);
+    QSpinBox *intervalSpin = new QSpinBox(settingWidget);
+    QSpinBox *speedSpin = new QSpinBox(settingWidget);
+    QSpinBox *cellWidthSpin = new QSpinBox(settingWidget);
+    item = new TrajectoryItem(view, nullptr);
+    curve = new ObservableCurveWidget(this);
+    frameSlider = new QSlider(Qt::Horizontal, this);
+    stepLineEdit = new QLineEdit(settingWidget);
+    frameLineEdit = new QLineEdit(settingWidget);
+    magLineEdit = new QLineEdit(settingWidget);
+
+    view->scene()->addItem(item);
+
+    setLayout(vLayout);
+    vLayout->addWidget(contentsWidget);
+    vLayout->addWidget(frameSlider);
+    vLayout->addWidget(curve);
+    contentsWidget->setLayout(contentsLayout);
+    contentsLayout->addWidget(view);
+    contentsLayout->addWidget(settingWidget);
+    settingWidget->setLayout(fLayout);
+    fLayout->addRow("", openButton);
+    fLayout->addRow("Interval", intervalSpin);
+    fLayout->addRow("Speed", speedSpin);
+    fLayout->addRow("Cell Width", cellWidthSpin);
+    fLayout->addRow("Step", stepLineEdit);
+    fLayout->addRow("Frame", frameLineEdit);
+    fLayout->addRow("m", magLineEdit);
+    fLayout->addRow("", playButton);
+    fLayout->addRow("", pauseButton);
+
+    intervalSpin->setMaximum(100000);
+    intervalSpin->setValue(30);
+    speedSpin->setRange(-100000, 100000); //負の値で逆再生
+    speedSpin->setValue(speed);
+    cellWidthSpin->setRange(1, 50);
+    cellWidthSpin->setValue(5);
+    frameLineEdit->setReadOnly(true);
+    magLineEdit->setReadOnly(true);
+    pauseButton->hide();
+    timer->setInterval(intervalSpin->value());
+    timer->setTimerType(Qt::PreciseTimer);
+
+    connect(openButton, &QPushButton::released, this, &TrajectoryPlayerWidget::openRequested);
+    connect(intervalSpin, &QSpinBox::valueChanged, timer, [this](const int msec){ timer->setInterval(msec); });
+    connect(speedSpin, &QSpinBox::valueChanged, this, &TrajectoryPlayerWidget::setSpeed);
+    connect(cellWidthSpin, &QSpinBox::valueChanged, item, &TrajectoryItem::setCellWidth);
+    connect(playButton, &QPushButton::released, this, &TrajectoryPlayerWidget::startPlay);
+    connect(playButton, &QPushButton::released, playButton, &QPushButton::hide);
+    connect(playButton, &QPushButton::released, pauseButton, &QPushButton::show);
+    connect(pauseButton, &QPushButton::released, this, &TrajectoryPlayerWidget::stopPlay);
+    connect(pauseButton, &QPushButton::released, pauseButton, &QPushButton::hide);
+    connect(pauseButton, &QPushButton::released, playButton, &QPushButton::show);
+    connect(stepLineEdit, &QLineEdit::returnPressed, this, &TrajectoryPlayerWidget::seekStep);
+    connect(frameSlider, &QSlider::sliderMoved, this, [this](const int value)
+    {
+        seekFrame(static_cast<size_t>(value * sliderScale));
+    });
+    connect(curve, &ObservableCurveWidget::seekRequested, this, &TrajectoryPlayerWidget::seekFrame);
+    connect(timer, &QTimer::timeout, this, &TrajectoryPlayerWidget::advance);
+
+    setContentsMargins(0, 0, 0, 0);
+}
+
+void TrajectoryPlayerWidget::openRequested()
+{
+    const QString path = QFileDialog::getOpenFileName(this, QString(), QString(), "Trajectory (*.traj);;All Files (*)");
+
+    if(path.isEmpty()) return;
+
+    stopPlay();
+
+    if(!item->openFile(path))
+    {
+        curve->setCurve(item->reader());
+        frameSlider->setRange(0, 0);
+        return;
+    }
+
+    const size_t frameCount = item->reader().frameCount();
+    const size_t maxSlider = static_cast<size_t>(std::numeric_limits<int>::max());
+    sliderScale = (frameCount > maxSlider) ? static_cast<double>(frameCount) / maxSlider : 1.0;
+    frameSlider->setRange(0, static_cast<int>((frameCount - 1) / sliderScale));
+
+    curve->setCurve(item->reader());
+    seekFrame(0);
+}
+
+void TrajectoryPlayerWidget::startPlay()
+{
+    if(item->reader().isOpen()) timer->start();
+}
+
+void TrajectoryPlayerWidget::stopPlay()
+{
+    timer->stop();
+}
+
+void TrajectoryPlayerWidget::seekFrame(const size_t frame)
+{
+    Trajectory::TrajectoryReader& reader = item->reader();
+
+    if(!reader.isOpen() || !item->showFrame(frame)) return;
+
+    this->frame = frame;
+
+    const double spinCount = static_cast<double>(reader.rows() * reader.cols());
+    stepLineEdit->setText(QString::number(reader.step()));
+    frameLineEdit->setText(QString::number(frame) + " / " + QString::number(reader.frameCount()));
+    magLineEdit->setText(QString::number((2.0 * reader.upCount() - spinCount) / spinCount));
+    curve->setCurrentFrame(frame);
+    updateSlider();
+}
+
+/* 入力されたステップ以下で最も新しいフレームへ移動する */
+void TrajectoryPlayerWidget::seekStep()
+{
+    if(!item->reader().isOpen()) return;
+
+    bool ok = false;
+    const qulonglong step = stepLineEdit->text().toULongLong(&ok);
+
+    if(ok) seekFrame(item->reader().frameAtStep(step));
+}
+
+void TrajectoryPlayerWidget::advance()
+{
+    const size_t frameCount = item->reader().frameCount();
+
+    if(frameCount == 0 || speed == 0) return;
+
+    //端に達したらそこで止める
+    if(speed > 0)
+        seekFrame(std::min(frame + static_cast<size_t>(speed), frameCount - 1));
+    else
+    {
+        const size_t stride = static_cast<size_t>(- speed);
+        seekFrame((frame > stride) ? frame - stride : 0);
+    }
+}
+
+void TrajectoryPlayerWidget::updateSlider()
+{
+    if(frameSlider->isSliderDown()) return;
+
+    frameSlider->setValue(static_cast<int>(frame / sliderScale));
+}
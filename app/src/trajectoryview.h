@@ -0,0 +1,97 @@
+#ifndef TRAJECTORYVIEW_H
+#define TRAJECTORYVIEW_H
+
+#include <QGraphicsItem>
+#include <QImage>
+#include <QWidget>
+#include "trajectory.h"
+
+class QLineEdit;
+class QSlider;
+class QSpinBox;
+class QTimer;
+
+
+/* トラジェクトリの現在のフレームを描画する */
+class TrajectoryItem : public QObject, public QGraphicsItem
+{
+    Q_OBJECT
+public:
+    TrajectoryItem(QObject *obj, QGraphicsItem *parent);
+
+public:
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
+
+    Trajectory::TrajectoryReader& reader() { return _reader; }
+
+public slots:
+    void setCellWidth(const int width);
+    bool openFile(const QString& path);
+    bool showFrame(const size_t frame);
+
+private:
+    int cellSize = 5;
+    Trajectory::TrajectoryReader _reader;
+    QImage image;
+};
+
+/* 各フレームの平均磁化の推移を描画する．クリックした位置のフレームへ移動する． */
+class ObservableCurveWidget : public QWidget
+{
+    Q_OBJECT
+public:
+    ObservableCurveWidget(QWidget *parent);
+
+    void setCurve(const Trajectory::TrajectoryReader& reader);
+    void setCurrentFrame(const size_t frame);
+
+signals:
+    void seekRequested(const size_t frame);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+
+private:
+    static constexpr size_t maxBucketCount = 4096;
+
+    size_t frameCount = 0;
+    size_t currentFrame = 0;
+    QVector<double> minValues; //各区間の磁化の最小値
+    QVector<double> maxValues; //各区間の磁化の最大値
+};
+
+/* トラジェクトリファイルを開いて再生・移動する */
+class TrajectoryPlayerWidget : public QWidget
+{
+    Q_OBJECT
+public:
+    TrajectoryPlayerWidget(QWidget *parent);
+
+public slots:
+    void openRequested();
+    void startPlay();
+    void stopPlay();
+    void setSpeed(const int framesPerTick) { speed = framesPerTick; }
+    void seekFrame(const size_t frame);
+    void seekStep();
+
+private:
+    void advance();
+    void updateSlider();
+
+    TrajectoryItem *item;
+    ObservableCurveWidget *curve;
+    QSlider *frameSlider;
+    QLineEdit *stepLineEdit;
+    QLineEdit *frameLineEdit;
+    QLineEdit *magLineEdit;
+    QTimer *timer;
+
+    size_t frame = 0;
+    int speed = 1;
+    double sliderScale = 1.0; //フレーム数が int に収まらない場合のスライダの刻み
+};
+
+#endif // TRAJECTORYVIEW_H
@@ -0,0 +1,212 @@
+#ifndef AVALANCHE_H
+#define AVALANCHE_H
+
+#include "mathutil.h"
+#include "montecarlo.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <vector>
+
+
+/* 絶対零度のランダム磁場イジング模型 H = - J Σ_(ij) s_i s_j - Σ_i (H + h_i) s_i のヒステリシスと雪崩．
+ * h_i は標準偏差 R (disorder) の正規分布．外場 H をゆっくり上げる (下げる) と，局所場 H + h_i + J Σ_j s_j
+ * の符号が変わったスピンが反転し，その近傍が次々に反転する (雪崩)．
+ *
+ * 格子を走査せずに次に不安定になるスピンへ直接進む (Kuntz らの sorted list 法)．
+ * スピンを h_i の順に並べ，そろった向きの近傍の数 n = 0, ..., z ごとに並びの中のポインタを持つ．
+ * n 個の近傍がそろったスピンが反転する外場は h_i で決まるので，各ポインタの指すスピンの反転する外場の最小値が
+ * 次の雪崩の起きる外場になる．雪崩はスタックで広げ，反転したスピンの近傍だけを調べる．
+ * ポインタは枝の途中で戻らないので，1本の枝 (飽和から逆向きの飽和まで) は O(z N) で終わる．
+ *
+ *   RandomFieldAvalanche<LatticeType::Square> rfim(L, L, R);
+ *   rfim.begin(true);   //すべて下向きから外場を上げる
+ *   RandomFieldAvalanche<>::Avalanche avalanche;
+ *   while(rfim.next(avalanche)) ...;
+ *
+ * 格子は rows×cols の周期境界 (LatticeStencil::forEachNeighbor と同じ近傍)．
+ * 枝の途中で向きを変える小ループは扱わない (begin で飽和させてから始める)．
+ */
+template<LatticeType Lattice = LatticeType::Square>
+class RandomFieldAvalanche
+{
+public:
+    using Stencil = LatticeStencil<Lattice>;
+    static constexpr int z = Stencil::z;
+
+    struct Avalanche
+    {
+        double field;          //雪崩の起きた外場 H
+        size_t size;           //反転したスピンの数
+        double magnetization;  //雪崩のあとの磁化 (1サイトあたり)
+    };
+
+    RandomFieldAvalanche(const size_t& rows,
+                         const size_t& cols,
+                         const double& disorder,
+                         const double& J = 1.0,
+                         const uint64_t& seed = 0x9e3779b97f4a7c15ULL)
+        : rows(rows)
+        , cols(cols)
+        , siteCount(rows * cols)
+        , J(J)
+        , randomFields(rows * cols)
+        , order(rows * cols)
+        , sortedFields(rows * cols)
+        , aligned(rows * cols, 0)
+        , counts(rows * cols, 0)
+    {
+        setDisorder(disorder, seed);
+    }
+
+    /* ランダム磁場を引き直し，h_i の昇順の並びを作る */
+    void setDisorder(const double& disorder, const uint64_t& seed)
+    {
+        MonteCarlo::Xoshiro256 rng(seed);
+        std::normal_distribution<double> gaussian(0.0, disorder);
+        for(auto& h : randomFields) h = gaussian(rng);
+
+        std::iota(order.begin(), order.end(), uint32_t(0));
+        std::sort(order.begin(), order.end(), [&](const uint32_t& a, const uint32_t& b){ return randomFields[a] < randomFields[b]; });
+        for(size_t p = 0; p < siteCount; ++p) sortedFields[p] = randomFields[order[p]];
+
+        begin(true);
+    }
+
+    /* すべてのスピンを -d (ascending なら下向き) にそろえ，枝の始めに戻す */
+    void begin(const bool& ascending)
+    {
+        direction = (ascending) ? 1.0 : -1.0;
+        std::fill(aligned.begin(), aligned.end(), 0);
+        std::fill(counts.begin(), counts.end(), 0);
+        std::fill(std::begin(pointers), std::end(pointers), size_t(0));
+        alignedCount = 0;
+        reduced = -std::numeric_limits<double>::infinity();
+    }
+
+    /* 次の雪崩まで外場を進めて雪崩を起こす．枝の向きに測った外場 d H が limit を越えるか
+     * (上りの枝では H > limit，下りの枝では H < -limit)，すべてのスピンがそろったら false
+     */
+    bool next(Avalanche& avalanche, const double& limit = std::numeric_limits<double>::infinity())
+    {
+        while(true)
+        {
+            //各 n のポインタが指すスピンの反転する外場のうち最小のもの
+            int n = -1;
+            double trigger = std::numeric_limits<double>::infinity();
+            for(int k = 0; k <= z; ++k)
+            {
+                if(pointers[k] >= siteCount) continue;
+
+                const double value = -direction * sortedAt(pointers[k]) - J * (2 * k - z);
+                if(value < trigger)
+                {
+                    trigger = value;
+                    n = k;
+                }
+            }
+
+            if(n < 0 || trigger > limit) return false;
+
+            reduced = std::max(reduced, trigger);
+            const uint32_t site = siteAt(pointers[n]++);
+
+            //まだそろっていなくて，そろった近傍がちょうど n 個のスピンだけがこの外場で反転する
+            if(aligned[site] || counts[site] != n) continue;
+
+            avalanche.field = direction * reduced;
+            avalanche.size = propagate(site);
+            avalanche.magnetization = magnetization();
+            return true;
+        }
+    }
+
+    /* 枝の終わりまで雪崩を順に f(avalanche) に渡す */
+    template<typename Func>
+    void branch(const bool& ascending, Func&& f)
+    {
+        begin(ascending);
+        Avalanche avalanche;
+        while(next(avalanche)) f(avalanche);
+    }
+
+    double field() const noexcept { return direction * reduced; }
+    double magnetization() const noexcept { return direction * (2.0 * alignedCount - siteCount) / siteCount; }
+
+    /* サイト (r, c) のスピン (上向きなら true) */
+    bool spin(const size_t& r, const size_t& c) const noexcept
+    {
+        return (aligned[r * cols + c] != 0) == (direction > 0.0);
+    }
+
+    size_t size() const noexcept { return siteCount; }
+
+private:
+    /* 向きを d 倍した外場 G = d H で，n 個の近傍がそろったスピン i が反転する値 */
+    double threshold(const uint32_t& i, const int& n) const noexcept
+    {
+        return -direction * randomFields[i] - J * (2 * n - z);
+    }
+
+    /* 枝の向きに並べたときの p 番目 (d h_i の大きい順) のサイトとその h_i */
+    uint32_t siteAt(const size_t& p) const noexcept
+    {
+        return (direction > 0.0) ? order[siteCount - 1 - p] : order[p];
+    }
+    double sortedAt(const size_t& p) const noexcept
+    {
+        return (direction > 0.0) ? sortedFields[siteCount - 1 - p] : sortedFields[p];
+    }
+
+    /* site から雪崩を広げ，反転したスピンの数を返す */
+    size_t propagate(const uint32_t& site)
+    {
+        size_t size = 0;
+        stack.clear();
+        stack.push_back(site);
+        aligned[site] = 1;
+
+        while(!stack.empty())
+        {
+            const uint32_t i = stack.back();
+            stack.pop_back();
+            size++;
+
+            Stencil::forEachNeighbor(i / cols, i % cols, rows, cols, [&](const size_t& r, const size_t& c)
+            {
+                const uint32_t j = static_cast<uint32_t>(r * cols + c);
+                counts[j]++;
+                if(!aligned[j] && threshold(j, counts[j]) <= reduced)
+                {
+                    aligned[j] = 1;
+                    stack.push_back(j);
+                }
+            });
+        }
+
+        alignedCount += size;
+        return size;
+    }
+
+    size_t rows;
+    size_t cols;
+    size_t siteCount;
+    double J;
+
+    std::vector<double> randomFields;
+    std::vector<uint32_t> order;       //h_i の昇順
+    std::vector<double> sortedFields;  //order の順に並べた h_i (ポインタを進めるときに連続して読む)
+    std::vector<uint8_t> aligned;      //枝の向きにそろったら1
+    std::vector<uint8_t> counts;       //そろった近傍の数
+    std::vector<uint32_t> stack;
+
+    size_t pointers[z + 1] = {};
+    size_t alignedCount = 0;
+    double direction = 1.0;
+    double reduced = 0.0;              //d H
+};
+
+#endif // AVALANCHE_H
@@ -0,0 +1,461 @@
+#ifndef BLOCKSPIN_H
+#define BLOCKSPIN_H
+
+#include "mathutil.h"
+#include "montecarlo.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+
+/* 多数決のブロックスピン変換による繰り込み群．
+ * b×b のブロックの多数決で粗視化したスピンを作り (同数なら乱数で決める)，
+ * 粗視化の各段で相互作用の演算子を測って MCRG (Swendsen) の線形化した繰り込み変換を求める．
+ *
+ * スピンは1ビット1スピン (1 が上向き) の行ごとのワード列で扱う．
+ * 演算子や多数決は XOR と popcount でワード単位に計算するので，粗視化にかかる時間は配位の生成に比べて無視できる．
+ */
+namespace BlockSpin
+{
+
+/* 大きさを実行時に決めるビット詰めのスピン配位．ワードの並びは BitState と同じで，周期境界条件 */
+class Spins
+{
+public:
+    Spins(const size_t& rows = 0, const size_t& cols = 0)
+        : _rows(rows)
+        , _cols(cols)
+        , _wordsPerRow((cols + 63) / 64)
+        , words(rows * _wordsPerRow, 0) {}
+
+    /* N×M 全体を周期境界の格子とする (TrajectoryReader::copyTo で読んだ配位など)．
+     * State を詰めた BitState<N, M>(state) は複製した最終行・最終列を含むので，State のコンストラクタを使う．
+     */
+    template<size_t N, size_t M>
+    explicit Spins(const BitState<N, M>& state)
+        : Spins(N, M)
+    {
+        std::copy(state.data(), state.data() + BitState<N, M>::wordCount, words.begin());
+    }
+
+    /* State の (N - 1)×(M - 1) の格子 (複製した最終行・最終列を除く) */
+    template<size_t N, size_t M>
+    explicit Spins(const State<N, M, bool>& state)
+        : Spins(N - 1, M - 1)
+    {
+        for(size_t r = 0; r < _rows; ++r)
+            for(size_t c = 0; c < _cols; ++c)
+                if(state.at(r, c)) row(r)[c / 64] |= uint64_t(1) << (c % 64);
+    }
+
+    size_t rows() const noexcept { return _rows; }
+    size_t cols() const noexcept { return _cols; }
+    size_t wordsPerRow() const noexcept { return _wordsPerRow; }
+    size_t siteCount() const noexcept { return _rows * _cols; }
+
+    bool at(const size_t& row, const size_t& col) const noexcept
+    {
+        return (words[row * _wordsPerRow + col / 64] >> (col % 64)) & 1;
+    }
+
+    uint64_t *row(const size_t& row) noexcept { return words.data() + row * _wordsPerRow; }
+    const uint64_t *row(const size_t& row) const noexcept { return words.data() + row * _wordsPerRow; }
+
+    /* 行末の有効ビットのマスク */
+    uint64_t tailMask() const noexcept
+    {
+        return (_cols % 64 == 0) ? ~uint64_t(0) : ((uint64_t(1) << (_cols % 64)) - 1);
+    }
+
+    /* 行の col 列目から count (<= 64) 列分のビット (col + count <= cols) */
+    uint64_t bits(const size_t& r, const size_t& col, const size_t& count) const noexcept
+    {
+        const uint64_t *w = row(r) + col / 64;
+        const size_t offset = col % 64;
+
+        uint64_t value = w[0] >> offset;
+        if(offset != 0 && offset + count > 64) value |= w[1] << (64 - offset);
+        return (count == 64) ? value : value & ((uint64_t(1) << count) - 1);
+    }
+
+    /* 行 r を shift 列だけ左に回したもの (out の c 列目 = r 行の (c + shift) % cols 列目) */
+    void rotatedRow(const size_t& r, const size_t& shift, uint64_t *out) const noexcept
+    {
+        for(size_t i = 0; i < _wordsPerRow; ++i)
+        {
+            const size_t count = std::min<size_t>(64, _cols - i * 64);
+            const size_t start = (i * 64 + shift) % _cols;
+            const size_t first = std::min(count, _cols - start);
+
+            out[i] = bits(r, start, first);
+            if(first < count) out[i] |= bits(r, 0, count - first) << first;
+        }
+    }
+
+    size_t upCount() const noexcept
+    {
+        size_t count = 0;
+        for(const auto& w : words) count += bitCount(w);
+        return count;
+    }
+
+    /* 0/1 の1次元のベクトル (行優先) にする．ニューラルネットワークの入力に使う */
+    template<typename U>
+    void createVector1d(std::vector<U>& vec) const
+    {
+        vec.resize(_rows * _cols);
+        for(size_t r = 0; r < _rows; ++r)
+            for(size_t c = 0; c < _cols; ++c)
+                vec[r * _cols + c] = static_cast<U>(at(r, c));
+    }
+
+private:
+    size_t _rows;
+    size_t _cols;
+    size_t _wordsPerRow;
+    std::vector<uint64_t> words;
+};
+
+
+/* 偶数番目のビットを下位32ビットに詰める */
+inline uint64_t compressEvenBits(uint64_t x) noexcept
+{
+    x &= 0x5555555555555555ULL;
+    x = (x | (x >> 1)) & 0x3333333333333333ULL;
+    x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+    x = (x | (x >> 4)) & 0x00ff00ff00ff00ffULL;
+    x = (x | (x >> 8)) & 0x0000ffff0000ffffULL;
+    x = (x | (x >> 16)) & 0x00000000ffffffffULL;
+    return x;
+}
+
+/* b×b のブロックの多数決で fine を粗視化して coarse ((rows / b)×(cols / b)) に入れる．同数のときは rng で決める．
+ * b = 2 は 64 列をまとめてビット演算で，それ以外はブロックの各行を popcount で数える．
+ */
+template<typename Rng>
+void coarsen(const Spins& fine, Spins& coarse, const size_t& b, Rng& rng)
+{
+    const size_t rows = fine.rows() / b;
+    const size_t cols = fine.cols() / b;
+    if(coarse.rows() != rows || coarse.cols() != cols) coarse = Spins(rows, cols);
+
+    if(b == 2)
+    {
+        static constexpr uint64_t even = 0x5555555555555555ULL;
+
+        for(size_t r = 0; r < rows; ++r)
+        {
+            const uint64_t *a = fine.row(2 * r);
+            const uint64_t *d = fine.row(2 * r + 1);
+            uint64_t *out = coarse.row(r);
+
+            for(size_t i = 0; i < coarse.wordsPerRow(); ++i)
+            {
+                uint64_t value = 0;
+                for(size_t half = 0; half < 2; ++half)
+                {
+                    const size_t w = 2 * i + half;
+                    if(w >= fine.wordsPerRow()) break;
+
+                    //縦の2つの和を (c, s) = (2の位, 1の位) で表し，横の2つを足す
+                    const uint64_t s = a[w] ^ d[w];
+                    const uint64_t c = a[w] & d[w];
+                    const uint64_t se = s & even, so = (s >> 1) & even;
+                    const uint64_t ce = c & even, co = (c >> 1) & even;
+
+                    const uint64_t up = (ce & co) | ((ce ^ co) & (se | so));         //和 >= 3
+                    const uint64_t tie = ((ce ^ co) & ~(se | so)) | (~(ce | co) & se & so); //和 == 2
+
+                    value |= compressEvenBits(up | (tie & rng())) << (32 * half);
+                }
+                out[i] = value;
+            }
+            out[coarse.wordsPerRow() - 1] &= coarse.tailMask();
+        }
+        return;
+    }
+
+    const size_t threshold = b * b;
+    uint64_t random = 0;
+    size_t randomBits = 0;
+
+    for(size_t r = 0; r < rows; ++r)
+    {
+        uint64_t *out = coarse.row(r);
+        std::fill(out, out + coarse.wordsPerRow(), 0);
+
+        for(size_t c = 0; c < cols; ++c)
+        {
+            size_t count = 0;
+            for(size_t i = 0; i < b; ++i) count += bitCount(fine.bits(b * r + i, b * c, b));
+
+            bool up = 2 * count > threshold;
+            if(2 * count == threshold)
+            {
+                if(randomBits == 0)
+                {
+                    random = rng();
+                    randomBits = 64;
+                }
+                up = random & 1;
+                random >>= 1;
+                --randomBits;
+            }
+            if(up) out[c / 64] |= uint64_t(1) << (c % 64);
+        }
+    }
+}
+
+
+/* MCRG で使う演算子 (周期境界条件での格子全体の和)．
+ * 偶の演算子: 最近接，次近接 (対角)，4スピンのプラケット，距離2 (縦横)．奇の演算子: 磁化．
+ * 2スピンの積は反平行なボンドの数から，4スピンの積は4つのビットの XOR から求める．
+ */
+static constexpr size_t evenOperatorCount = 4;
+static constexpr size_t operatorCount = evenOperatorCount + 1;
+
+inline void measureOperators(const Spins& spins, double *values)
+{
+    const size_t rows = spins.rows();
+    const size_t wordCount = spins.wordsPerRow();
+    const uint64_t tail = spins.tailMask();
+
+    std::vector<uint64_t> buffer(4 * wordCount);
+    uint64_t *right = buffer.data();              //(r, c + 1)
+    uint64_t *right2 = right + wordCount;         //(r, c + 2)
+    uint64_t *downRight = right2 + wordCount;     //(r + 1, c + 1)
+    uint64_t *downLeft = downRight + wordCount;   //(r + 1, c - 1)
+
+    size_t antiNearest = 0, antiDiagonal = 0, oddPlaquette = 0, antiDistance2 = 0;
+    for(size_t r = 0; r < rows; ++r)
+    {
+        const uint64_t *s = spins.row(r);
+        const uint64_t *down = spins.row((r + 1) % rows);
+        const uint64_t *down2 = spins.row((r + 2) % rows);
+
+        spins.rotatedRow(r, 1, right);
+        spins.rotatedRow(r, 2, right2);
+        spins.rotatedRow((r + 1) % rows, 1, downRight);
+        spins.rotatedRow((r + 1) % rows, spins.cols() - 1, downLeft);
+
+        for(size_t i = 0; i < wordCount; ++i)
+        {
+            const uint64_t mask = (i + 1 == wordCount) ? tail : ~uint64_t(0);
+            antiNearest += bitCount((s[i] ^ right[i]) & mask) + bitCount((s[i] ^ down[i]) & mask);
+            antiDiagonal += bitCount((s[i] ^ downRight[i]) & mask) + bitCount((s[i] ^ downLeft[i]) & mask);
+            oddPlaquette += bitCount((s[i] ^ right[i] ^ down[i] ^ downRight[i]) & mask);
+            antiDistance2 += bitCount((s[i] ^ right2[i]) & mask) + bitCount((s[i] ^ down2[i]) & mask);
+        }
+    }
+
+    const double n = static_cast<double>(spins.siteCount());
+    values[0] = 2.0 * n - 2.0 * antiNearest;
+    values[1] = 2.0 * n - 2.0 * antiDiagonal;
+    values[2] = n - 2.0 * oddPlaquette;
+    values[3] = 2.0 * n - 2.0 * antiDistance2;
+    values[4] = 2.0 * spins.upCount() - n;
+}
+
+
+/* MCRG．配位を加えるたびに levelCount - 1 回粗視化し，各段の演算子 S^(n) について
+ *   <S^(n)_α S^(n)_β> と <S^(n)_α S^(n-1)_β>
+ * を積算する．線形化した繰り込み変換 T^(n) は
+ *   Σ_γ (<S^(n)_α S^(n)_γ>_c) T_γβ = <S^(n)_α S^(n-1)_β>_c     (_c は連結相関)
+ * の解で，その最大固有値 λ から指数 y = log λ / log b (2次元イジング模型では y_t = 1，y_h = 15/8) が得られる．
+ */
+class Renormalization
+{
+public:
+    Renormalization(const size_t& levelCount = 4, const size_t& blockSize = 2, const uint64_t& seed = 0x2545f4914f6cdd1dULL)
+        : b(std::max<size_t>(blockSize, 2))
+        , levels(std::max<size_t>(levelCount, 1))
+        , rng(seed)
+        , means(levels.size() * operatorCount, 0.0)
+        , same(levels.size() * operatorCount * operatorCount, 0.0)
+        , mixed(levels.size() * operatorCount * operatorCount, 0.0) {}
+
+    size_t blockSize() const noexcept { return b; }
+    size_t levelCount() const noexcept { return levels.size(); }
+    size_t sampleCount() const noexcept { return count; }
+
+    /* 最後に加えた配位の n 段目 (0 が元の配位) */
+    const Spins& level(const size_t& n) const noexcept { return levels[n]; }
+
+    /* 配位を1サンプルとして加える．粗視化できない大きさなら false */
+    bool add(const Spins& spins)
+    {
+        size_t rows = spins.rows(), cols = spins.cols();
+        for(size_t n = 1; n < levels.size(); ++n)
+        {
+            if(rows % b != 0 || cols % b != 0 || rows / b < 2 || cols / b < 2) return false;
+            rows /= b;
+            cols /= b;
+        }
+
+        levels[0] = spins;
+        for(size_t n = 1; n < levels.size(); ++n) coarsen(levels[n - 1], levels[n], b, rng);
+
+        std::vector<double> previous(operatorCount), current(operatorCount);
+        for(size_t n = 0; n < levels.size(); ++n)
+        {
+            measureOperators(levels[n], current.data());
+
+            for(size_t a = 0; a < operatorCount; ++a)
+            {
+                means[n * operatorCount + a] += current[a];
+                for(size_t c = 0; c < operatorCount; ++c)
+                {
+                    same[index(n, a, c)] += current[a] * current[c];
+                    if(n > 0) mixed[index(n, a, c)] += current[a] * previous[c];
+                }
+            }
+            previous.swap(current);
+        }
+
+        ++count;
+        return true;
+    }
+
+    template<size_t N, size_t M>
+    bool add(const State<N, M, bool>& state) { return add(Spins(state)); }
+
+    template<size_t N, size_t M>
+    bool add(const BitState<N, M>& state) { return add(Spins(state)); }
+
+    void clear()
+    {
+        std::fill(means.begin(), means.end(), 0.0);
+        std::fill(same.begin(), same.end(), 0.0);
+        std::fill(mixed.begin(), mixed.end(), 0.0);
+        count = 0;
+    }
+
+    /* n 段目の演算子の平均 <S^(n)_α> */
+    double mean(const size_t& n, const size_t& a) const noexcept
+    {
+        return (count == 0) ? 0.0 : means[n * operatorCount + a] / count;
+    }
+
+    /* 連結相関 <S^(n)_α S^(n)_β>_c と <S^(n)_α S^(n-1)_β>_c (n >= 1) */
+    double correlation(const size_t& n, const size_t& a, const size_t& c) const noexcept
+    {
+        return (count == 0) ? 0.0 : same[index(n, a, c)] / count - mean(n, a) * mean(n, c);
+    }
+
+    double mixedCorrelation(const size_t& n, const size_t& a, const size_t& c) const noexcept
+    {
+        return (count == 0 || n == 0) ? 0.0 : mixed[index(n, a, c)] / count - mean(n, a) * mean(n - 1, c);
+    }
+
+    /* n 段目 (n >= 1) の偶の演算子を前から evenCount 個使った T の最大固有値．求まらなければ NaN */
+    double thermalEigenvalue(const size_t& n, const size_t& evenCount = evenOperatorCount) const
+    {
+        const size_t k = std::min(std::max<size_t>(evenCount, 1), evenOperatorCount);
+        if(n == 0 || n >= levels.size() || count < 2) return std::nan("");
+
+        //T の各列 β を D T_β = U_β で解く
+        std::vector<double> t(k * k);
+        for(size_t beta = 0; beta < k; ++beta)
+        {
+            std::vector<std::vector<double>> a(k, std::vector<double>(k + 1));
+            for(size_t i = 0; i < k; ++i)
+            {
+                for(size_t j = 0; j < k; ++j) a[i][j] = correlation(n, i, j);
+                a[i][k] = mixedCorrelation(n, i, beta);
+            }
+            if(!solve(a)) return std::nan("");
+            for(size_t i = 0; i < k; ++i) t[i * k + beta] = a[i][k];
+        }
+
+        //べき乗法
+        std::vector<double> v(k, 1.0), w(k);
+        double lambda = 0.0;
+        for(size_t iteration = 0; iteration < 1000; ++iteration)
+        {
+            for(size_t i = 0; i < k; ++i)
+            {
+                w[i] = 0.0;
+                for(size_t j = 0; j < k; ++j) w[i] += t[i * k + j] * v[j];
+            }
+
+            double norm = 0.0;
+            for(const auto& x : w) norm = std::max(norm, std::abs(x));
+            if(norm == 0.0) return std::nan("");
+
+            double next = 0.0, denominator = 0.0;
+            for(size_t i = 0; i < k; ++i)
+            {
+                next += w[i] * v[i];
+                denominator += v[i] * v[i];
+                v[i] = w[i] / norm;
+            }
+            next /= denominator;
+
+            if(std::abs(next - lambda) < 1e-12 * std::abs(next)) return next;
+            lambda = next;
+        }
+        return lambda;
+    }
+
+    /* 磁化だけを使った奇の T の固有値 */
+    double magneticEigenvalue(const size_t& n) const
+    {
+        if(n == 0 || n >= levels.size() || count < 2) return std::nan("");
+
+        const size_t m = evenOperatorCount;
+        const double d = correlation(n, m, m);
+        return (d == 0.0) ? std::nan("") : mixedCorrelation(n, m, m) / d;
+    }
+
+    double thermalExponent(const size_t& n, const size_t& evenCount = evenOperatorCount) const
+    {
+        return std::log(thermalEigenvalue(n, evenCount)) / std::log(static_cast<double>(b));
+    }
+
+    double magneticExponent(const size_t& n) const
+    {
+        return std::log(magneticEigenvalue(n)) / std::log(static_cast<double>(b));
+    }
+
+private:
+    size_t index(const size_t& n, const size_t& a, const size_t& c) const noexcept
+    {
+        return (n * operatorCount + a) * operatorCount + c;
+    }
+
+    /* 拡大係数行列 a (k×(k+1)) を部分ピボット選択つきのガウスの消去法で解き，解を最後の列に入れる */
+    static bool solve(std::vector<std::vector<double>>& a)
+    {
+        const size_t k = a.size();
+        for(size_t col = 0; col < k; ++col)
+        {
+            size_t pivot = col;
+            for(size_t i = col + 1; i < k; ++i)
+                if(std::abs(a[i][col]) > std::abs(a[pivot][col])) pivot = i;
+            if(std::abs(a[pivot][col]) < 1e-300) return false;
+
+            std::swap(a[col], a[pivot]);
+            for(size_t i = 0; i < k; ++i)
+            {
+                if(i == col) continue;
+                const double f = a[i][col] / a[col][col];
+                for(size_t j = col; j <= k; ++j) a[i][j] -= f * a[col][j];
+            }
+        }
+        for(size_t i = 0; i < k; ++i) a[i][k] /= a[i][i];
+        return true;
+    }
+
+    size_t b;
+    std::vector<Spins> levels;
+    MonteCarlo::Xoshiro256 rng;
+
+    size_t count = 0;
+    std::vector<double> means;
+    std::vector<double> same;    //[段][α][β] の <S^(n)_α S^(n)_β> の和
+    std::vector<double> mixed;   //[段][α][β] の <S^(n)_α S^(n-1)_β> の和
+};
+
+} //namespace BlockSpin
+
+#endif // BLOCKSPIN_H
@@ -0,0 +1,170 @@
+#ifndef CAMPAIGN_H
+#define CAMPAIGN_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/* 有限サイズスケーリングのように多数のシミュレーションを流すためのスケジューラ．
+ *
+ *   1. 各ジョブの calibrate() を並列に呼んで計算量を見積もる (短いシミュレーションの時間 × 倍率など)
+ *   2. 見積もりの大きい順に並べ，空いたスレッドから順に次のジョブを取る (LPT)
+ *   3. 終わったジョブの結果は1つの CSV (key,cost,seconds,結果...) に追記してすぐに書き出す
+ *
+ * 結果のファイルがチェックポイントを兼ねる．同じファイルで run() をやり直すと，
+ * 既に書かれている key のジョブは飛ばす．key にはカンマと改行を含めない．
+ */
+class CampaignScheduler
+{
+public:
+    struct Job
+    {
+        std::string key;
+        std::function<double()> calibrate;           //計算量の見積もり (単位は揃っていれば何でもよい)
+        std::function<std::vector<double>()> run;    //本番のシミュレーション．結果の列を返す
+        double cost = 0.0;
+    };
+
+    explicit CampaignScheduler(const std::string& storePath,
+                               const size_t& threadCount = std::thread::hardware_concurrency())
+        : storePath(storePath)
+        , threadCount(std::max<size_t>(threadCount, 1)) {}
+
+    void add(const std::string& key, std::function<double()> calibrate, std::function<std::vector<double>()> run)
+    {
+        jobs.push_back({ key, std::move(calibrate), std::move(run), 0.0 });
+    }
+
+    /* 終わっていないジョブをすべて実行し，実行したジョブの数を返す */
+    size_t run()
+    {
+        bool partialTail;
+        uintmax_t completeLength;
+        const std::set<std::string> done = completedKeys(partialTail, completeLength);
+
+        std::vector<Job*> pending;
+        for(auto& job : jobs)
+            if(done.count(job.key) == 0) pending.push_back(&job);
+
+        //見積もり
+        parallel(pending.size(), [&](const size_t& i)
+        {
+            pending[i]->cost = (pending[i]->calibrate) ? pending[i]->calibrate() : 1.0;
+        });
+
+        std::stable_sort(pending.begin(), pending.end(), [](const Job *a, const Job *b){ return a->cost > b->cost; });
+
+        //書き込みの途中で止まった最後の行は最後の改行まで切り詰めて捨てる
+        if(partialTail)
+        {
+            std::error_code ec;
+            std::filesystem::resize_file(storePath, completeLength, ec);
+            if(ec) return 0;
+        }
+
+        std::ofstream fout(storePath, std::ios::out | std::ios::app);
+        if(!fout) return 0;
+
+        const auto start = std::chrono::steady_clock::now();
+        _workSeconds = 0.0;
+
+        parallel(pending.size(), [&](const size_t& i)
+        {
+            Job& job = *pending[i];
+            const auto jobStart = std::chrono::steady_clock::now();
+            const std::vector<double> result = job.run();
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - jobStart).count();
+
+            std::ostringstream line;
+            line.precision(12);
+            line << job.key << ',' << job.cost << ',' << seconds;
+            for(const auto& value : result) line << ',' << value;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            fout << line.str() << '\n';
+            fout.flush();
+            _workSeconds += seconds;
+
+            std::cout << job.key << '\t' << seconds << "s" << std::endl;
+        });
+
+        _wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return pending.size();
+    }
+
+    /* 直前の run() での各ジョブの時間の和と経過時間．効率は workSeconds / (wallSeconds × threadCount) */
+    double workSeconds() const noexcept { return _workSeconds; }
+    double wallSeconds() const noexcept { return _wallSeconds; }
+
+private:
+    /* 結果のファイルに書かれている key．書き込みの途中で止まった最後の行 (改行で終わっていない行) は数えない．
+     * completeLength は最後の改行までのバイト数
+     */
+    std::set<std::string> completedKeys(bool& partialTail, uintmax_t& completeLength) const
+    {
+        std::set<std::string> keys;
+        partialTail = false;
+        completeLength = 0;
+
+        std::ifstream fin(storePath, std::ios::in | std::ios::binary);
+        if(!fin) return keys;
+
+        const std::string text((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+        size_t begin = 0;
+        while(begin < text.size())
+        {
+            const size_t end = text.find('\n', begin);
+            if(end == std::string::npos)
+            {
+                partialTail = true;
+                break;
+            }
+
+            const size_t comma = text.find(',', begin);
+            if(comma < end) keys.insert(text.substr(begin, comma - begin));
+            begin = end + 1;
+            completeLength = begin;
+        }
+        return keys;
+    }
+
+    /* [0, count) の添字を空いたスレッドから順に取って f(i) を呼ぶ */
+    template<typename Func>
+    void parallel(const size_t& count, Func&& f)
+    {
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> threads;
+
+        for(size_t t = 0; t < std::min(threadCount, count); ++t)
+        {
+            threads.emplace_back([&]()
+            {
+                for(size_t i = next++; i < count; i = next++) f(i);
+            });
+        }
+        for(auto& thread : threads) thread.join();
+    }
+
+    std::string storePath;
+    size_t threadCount;
+    std::vector<Job> jobs;
+    std::mutex mutex;
+
+    double _workSeconds = 0.0;
+    double _wallSeconds = 0.0;
+};
+
+#endif // CAMPAIGN_H
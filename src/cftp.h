@@ -0,0 +1,148 @@
+#ifndef CFTP_H
+#define CFTP_H
+
+#include "mathutil.h"
+#include "isingmodel.h"
+#include "montecarlo.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+
+/* Propp-Wilson の coupling from the past による厳密サンプリング．
+ * 強磁性 (J > 0) の熱浴法は単調なので，全スピン up と全スピン down から始めた2つの鎖を
+ * 同じ乱数で進めれば，他のすべての初期配位はその間に挟まれる．
+ * 時刻 -T から 0 まで進めて2つの鎖が一致すれば，その配位は平衡分布からの厳密なサンプルになる．
+ * 一致しなければ T を2倍にして過去へさかのぼる．このとき既に使った区間の乱数は同じものを使い直す．
+ *
+ * 上側・下側の鎖は (N - 1)×(M - 1) の BitState (複製した最終行・最終列を除いたもの) に持ち，
+ * 格子の順に1サイトずつ熱浴法で更新する．
+ */
+template<LatticeType Lattice = LatticeType::Square>
+class CouplingFromThePast
+{
+public:
+    using Stencil = LatticeStencil<Lattice>;
+
+    /* 最初は initialSweepCount 回の走査からさかのぼり，最大で maxDoubling 回まで2倍にする */
+    CouplingFromThePast(IsingModel *ising, const size_t& initialSweepCount = 1, const size_t& maxDoubling = 24)
+        : ising(ising)
+        , initialSweepCount(std::max<size_t>(initialSweepCount, 1))
+        , maxDoubling(maxDoubling) {}
+
+    /* seed から決まる乱数列で厳密サンプルを1つ作り state に書き込む．
+     * J <= 0 の場合や maxDoubling 回さかのぼっても一致しなかった場合は false を返し，state は変更しない．
+     */
+    template<size_t N, size_t M>
+    bool sample(State<N, M, bool>& state, const uint64_t& seed)
+    {
+        static_assert(N > 2 && M > 2, "lattice is too small");
+
+        if(ising->param.J <= 0) return false;
+        prepare();
+
+        BitState<N - 1, M - 1> upper, lower;
+        std::vector<uint64_t> seeds;
+
+        for(size_t k = 0; k <= maxDoubling; ++k)
+        {
+            //区間 k は時刻 [-2^k T0, -2^(k-1) T0) (区間 0 は [-T0, 0))
+            seeds.push_back(epochSeed(seed, k));
+
+            upper.init(true);
+            lower.init(false);
+
+            for(size_t i = seeds.size(); i-- > 0;)
+            {
+                const size_t sweepCount = (i == 0) ? initialSweepCount : initialSweepCount << (i - 1);
+                MonteCarlo::Xoshiro256 rng(seeds[i]);
+
+                for(size_t s = 0; s < sweepCount; ++s) sweep(upper, lower, rng);
+            }
+
+            _lookBack = initialSweepCount << k;
+
+            if(coalesced(upper, lower))
+            {
+                for(size_t r = 0; r < N - 1; ++r)
+                    for(size_t c = 0; c < M - 1; ++c)
+                        Stencil::setSpin(state, r, c, upper.at(r, c));
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /* 直前の sample() でさかのぼった走査の回数 */
+    size_t lookBack() const noexcept { return _lookBack; }
+
+private:
+    static uint64_t epochSeed(const uint64_t& seed, const size_t& epoch) noexcept
+    {
+        //splitmix64 で区間ごとに独立なシード値を作る
+        uint64_t z = seed + 0x9e3779b97f4a7c15ULL * (epoch + 1);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    /* 温度と J が変わっていれば up になる確率の表を作り直す */
+    void prepare() noexcept
+    {
+        const double J = ising->param.J;
+        const double kbT = ising->kbT();
+        if(J == tableJ && kbT == tableKbT) return;
+
+        for(int h = - Stencil::z; h <= Stencil::z; ++h)
+            table[h + Stencil::z] = (h == 0) ? 0.5 : 0.5 * (std::tanh(J * h / kbT) + 1.0);
+
+        tableJ = J;
+        tableKbT = kbT;
+    }
+
+    /* 上側・下側の鎖を同じ乱数で1回ずつ走査する．
+     * 局所場は上側の鎖の方が常に大きいので，同じ一様乱数で判定すれば上下の順序が保たれる．
+     */
+    template<size_t R, size_t C>
+    void sweep(BitState<R, C>& upper, BitState<R, C>& lower, MonteCarlo::Xoshiro256& rng) const noexcept
+    {
+        for(size_t r = 0; r < R; ++r)
+            for(size_t c = 0; c < C; ++c)
+            {
+                const double u = (rng() >> 11) * (1.0 / 9007199254740992.0);
+
+                int hUpper = 0, hLower = 0;
+                Stencil::forEachNeighbor(r, c, R, C, [&](const size_t& nr, const size_t& nc)
+                {
+                    hUpper += (upper.at(nr, nc)) ? 1 : -1;
+                    hLower += (lower.at(nr, nc)) ? 1 : -1;
+                });
+
+                upper.set(r, c, u < table[hUpper + Stencil::z]);
+                lower.set(r, c, u < table[hLower + Stencil::z]);
+            }
+    }
+
+    template<size_t R, size_t C>
+    static bool coalesced(const BitState<R, C>& upper, const BitState<R, C>& lower) noexcept
+    {
+        const uint64_t *a = upper.data();
+        const uint64_t *b = lower.data();
+        for(size_t i = 0; i < BitState<R, C>::wordCount; ++i)
+            if(a[i] != b[i]) return false;
+        return true;
+    }
+
+    IsingModel *ising; //this has no ownership
+    size_t initialSweepCount;
+    size_t maxDoubling;
+    size_t _lookBack = 0;
+
+    double table[2 * Stencil::z + 1];
+    double tableJ = std::numeric_limits<double>::quiet_NaN();
+    double tableKbT = std::numeric_limits<double>::quiet_NaN();
+};
+
+#endif // CFTP_H
@@ -0,0 +1,294 @@
+#ifndef CLUSTERANALYSIS_H
+#define CLUSTERANALYSIS_H
+
+#include "mathutil.h"
+#include "montecarlo.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <vector>
+
+
+/* Hoshen-Kopelman 法で1行ずつクラスターを数える．
+ * 保持するのは直前の行・最初の行のラベルと，その行にかかっているクラスターの Union-Find だけなので，
+ * 作業領域は列数に比例し，格子全体を保存しなくてよい (シミュレーションの途中で行を順に渡せばよい)．
+ *
+ *   ClusterAnalysis::Analyzer<> analyzer(cols);
+ *   analyzer.begin();
+ *   for(...) analyzer.addRow(bitRow);
+ *   const ClusterAnalysis::Statistics statistics = analyzer.finish();
+ *
+ * 境界は上下・左右とも周期境界条件．BondRule で隣り合う2サイトをつなぐかどうかを決める
+ * (GeometricBond: 同じ向きのスピンの磁区，FortuinKasteleynBond: 同じ向きのボンドを確率 p でつなぐ FK クラスター)．
+ */
+namespace ClusterAnalysis
+{
+
+/* 同じ向きのスピンをつなぐ (幾何学的な磁区) */
+struct GeometricBond
+{
+    bool operator()(const bool& a, const bool& b) noexcept { return a == b; }
+};
+
+/* 同じ向きのスピンを確率 p = 1 - exp(-2J/kT) でつなぐ (Fortuin-Kasteleyn クラスター) */
+struct FortuinKasteleynBond
+{
+    explicit FortuinKasteleynBond(const double& p = 0.0, const uint64_t& seed = 0x9e3779b97f4a7c15ULL)
+        : threshold(static_cast<uint64_t>(std::min(std::max(p, 0.0), 1.0) * 18446744073709549568.0))
+        , rng(seed) {}
+
+    static double probability(const double& J, const double& kbT) { return 1.0 - std::exp(-2.0 * J / kbT); }
+
+    bool operator()(const bool& a, const bool& b) noexcept { return a == b && rng() < threshold; }
+
+    uint64_t threshold;
+    MonteCarlo::Xoshiro256 rng;
+};
+
+struct Statistics
+{
+    std::map<size_t, size_t> sizeCounts;  //クラスターの大きさ → 個数
+    size_t clusterCount = 0;
+    size_t largest = 0;
+    size_t siteCount = 0;
+    size_t spanningCount = 0;             //最初の行と最後の行をつなぐクラスターの数 (上下の周期境界のボンドは使わない)
+    size_t domainWallLength = 0;          //反平行な最近接ボンドの数
+
+    bool percolates() const noexcept { return spanningCount > 0; }
+
+    /* 平均クラスターサイズ Σ s^2 / サイト数 (excludeLargest なら最大のクラスターを除く) */
+    double meanClusterSize(const bool& excludeLargest = false) const noexcept
+    {
+        if(siteCount == 0) return 0.0;
+
+        double sum = 0.0;
+        for(const auto& [size, count] : sizeCounts) sum += static_cast<double>(size) * size * count;
+        if(excludeLargest) sum -= static_cast<double>(largest) * largest;
+        return sum / siteCount;
+    }
+};
+
+
+template<typename BondRule = GeometricBond>
+class Analyzer
+{
+public:
+    explicit Analyzer(const size_t& cols, BondRule rule = BondRule())
+        : cols(cols)
+        , rule(rule)
+        , spins(cols)
+        , prevSpins(cols)
+        , firstSpins(cols)
+        , prevIds(cols)
+        , firstIds(cols)
+        , rowIds(cols) {}
+
+    BondRule& bondRule() noexcept { return rule; }
+
+    void begin()
+    {
+        statistics = Statistics();
+        nodes.clear();
+        rowCount = 0;
+    }
+
+    /* 1行分のスピンを渡す．列 c は words[c / 64] の c % 64 ビット目 (BitState の行と同じ) */
+    void addRow(const uint64_t *words)
+    {
+        for(size_t c = 0; c < cols; ++c) spins[c] = (words[c / 64] >> (c % 64)) & 1;
+        processRow();
+    }
+
+    /* State の行 row の (M - 1) 列 (複製した最終列を除く) を渡す */
+    template<size_t N, size_t M>
+    void addRow(const State<N, M, bool>& state, const size_t& row)
+    {
+        for(size_t c = 0; c < cols; ++c) spins[c] = state.at(row, c);
+        processRow();
+    }
+
+    /* 最後の行と最初の行をつなぎ，残りのクラスターを数えて結果を返す */
+    Statistics finish()
+    {
+        if(rowCount == 0) return statistics;
+
+        //上下の周期境界のボンドを使う前に，最初の行とつながっているクラスターを数える
+        std::vector<size_t> spanning;
+        for(size_t c = 0; c < cols; ++c)
+        {
+            const size_t root = find(prevIds[c]);
+            if(nodes[root].touchesTop) spanning.push_back(root);
+        }
+        std::sort(spanning.begin(), spanning.end());
+        statistics.spanningCount = std::unique(spanning.begin(), spanning.end()) - spanning.begin();
+
+        //2行なら上下の周期境界のボンドは縦のボンドと同じなので，横の cols > 2 と同じように数えない
+        if(rowCount > 2)
+        {
+            for(size_t c = 0; c < cols; ++c)
+            {
+                if(prevSpins[c] != firstSpins[c]) statistics.domainWallLength++;
+                if(rule(prevSpins[c], firstSpins[c])) unite(prevIds[c], firstIds[c]);
+            }
+        }
+
+        for(size_t i = 0; i < nodes.size(); ++i)
+            if(find(i) == i) record(nodes[i].size);
+
+        nodes.clear();
+        return statistics;
+    }
+
+    /* N×M 全体を周期境界の格子とする．State を詰めた BitState は複製した最終行・最終列を含むので，
+     * State はそのまま下の analyze に渡す
+     */
+    template<size_t N, size_t M>
+    Statistics analyze(const BitState<N, M>& state)
+    {
+        begin();
+        for(size_t r = 0; r < N; ++r) addRow(state.row(r));
+        return finish();
+    }
+
+    template<size_t N, size_t M>
+    Statistics analyze(const State<N, M, bool>& state)
+    {
+        begin();
+        for(size_t r = 0; r + 1 < N; ++r) addRow(state, r);
+        return finish();
+    }
+
+private:
+    struct Node
+    {
+        size_t parent;
+        size_t size;
+        bool touchesTop;
+    };
+
+    size_t find(size_t i) noexcept
+    {
+        while(nodes[i].parent != i)
+        {
+            nodes[i].parent = nodes[nodes[i].parent].parent;
+            i = nodes[i].parent;
+        }
+        return i;
+    }
+
+    void unite(const size_t& a, const size_t& b) noexcept
+    {
+        size_t ra = find(a), rb = find(b);
+        if(ra == rb) return;
+        if(nodes[ra].size < nodes[rb].size) std::swap(ra, rb);
+
+        nodes[rb].parent = ra;
+        nodes[ra].size += nodes[rb].size;
+        nodes[ra].touchesTop = nodes[ra].touchesTop || nodes[rb].touchesTop;
+    }
+
+    void record(const size_t& size)
+    {
+        statistics.sizeCounts[size]++;
+        statistics.clusterCount++;
+        statistics.largest = std::max(statistics.largest, size);
+    }
+
+    void processRow()
+    {
+        const size_t carried = nodes.size();
+        for(size_t c = 0; c < cols; ++c) nodes.push_back({ carried + c, 1, rowCount == 0 });
+        statistics.siteCount += cols;
+
+        //横のボンド (左右の周期境界を含む)
+        for(size_t c = 1; c < cols; ++c)
+        {
+            if(spins[c - 1] != spins[c]) statistics.domainWallLength++;
+            if(rule(spins[c - 1], spins[c])) unite(carried + c - 1, carried + c);
+        }
+        if(cols > 2)
+        {
+            if(spins[cols - 1] != spins[0]) statistics.domainWallLength++;
+            if(rule(spins[cols - 1], spins[0])) unite(carried + cols - 1, carried);
+        }
+
+        //縦のボンド
+        if(rowCount > 0)
+        {
+            for(size_t c = 0; c < cols; ++c)
+            {
+                if(prevSpins[c] != spins[c]) statistics.domainWallLength++;
+                if(rule(prevSpins[c], spins[c])) unite(prevIds[c], carried + c);
+            }
+        }
+        else
+        {
+            for(size_t c = 0; c < cols; ++c) firstIds[c] = carried + c;
+            firstSpins = spins;
+        }
+
+        compact(carried);
+
+        prevSpins.swap(spins);
+        rowCount++;
+    }
+
+    /* 今の行と最初の行にかかっているクラスターだけを残して番号を詰める．
+     * どちらにもかからなくなったクラスターはもう大きくならないので，ここで数える．
+     */
+    void compact(const size_t& carried)
+    {
+        std::vector<Node>& next = buffer;
+        next.clear();
+        remap.assign(nodes.size(), npos);
+
+        const auto keep = [&](const size_t& id)
+        {
+            const size_t root = find(id);
+            if(remap[root] == npos)
+            {
+                remap[root] = next.size();
+                next.push_back({ next.size(), nodes[root].size, nodes[root].touchesTop });
+            }
+            return remap[root];
+        };
+
+        for(size_t c = 0; c < cols; ++c) rowIds[c] = keep(carried + c);
+        for(size_t c = 0; c < cols; ++c) firstIds[c] = keep(firstIds[c]);
+
+        for(size_t i = 0; i < carried; ++i)
+        {
+            const size_t root = find(i);
+            if(remap[root] == npos)
+            {
+                record(nodes[root].size);
+                remap[root] = npos - 1; //数えた印
+            }
+        }
+
+        nodes.swap(next);
+        prevIds.swap(rowIds);
+    }
+
+    static constexpr size_t npos = ~size_t(0);
+
+    size_t cols;
+    BondRule rule;
+
+    std::vector<uint8_t> spins;
+    std::vector<uint8_t> prevSpins;
+    std::vector<uint8_t> firstSpins;
+    std::vector<size_t> prevIds;   //直前の行の各サイトのノード
+    std::vector<size_t> firstIds;  //最初の行の各サイトのノード
+    std::vector<size_t> rowIds;
+    std::vector<size_t> remap;
+    std::vector<Node> nodes;
+    std::vector<Node> buffer;
+
+    size_t rowCount = 0;
+    Statistics statistics;
+};
+
+} //namespace ClusterAnalysis
+
+#endif // CLUSTERANALYSIS_H
@@ -0,0 +1,396 @@
+#ifndef CORRELATION_H
+#define CORRELATION_H
+
+#include "mathutil.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+
+/* FFT によるスピン相関の測定．
+ * 配位 s(x) のフーリエ変換から構造因子 S(k) = |s(k)|^2 / サイト数 を求め，サンプルごとに平均する．
+ * 平均した S(k) を逆変換すると相関関数 G(r) = <s(x) s(x + r)> になる (直接計算すると O(サイト数^2))．
+ * 二次モーメントの相関長は ξ = sqrt(S(0) / S(kmin) - 1) / (2 sin(kmin / 2))，kmin = 2π / L で，L = rows，cols の
+ * 方向ごとに求めて平均する．
+ *
+ * 格子は周期境界条件の rows×cols．rows と cols が2のべき乗でなければ FFT の代わりに O(n^2) の DFT になる．
+ */
+namespace Correlation
+{
+
+using complex = std::complex<double>;
+static constexpr double pi = 3.14159265358979323846;
+
+inline bool isPowerOfTwo(const size_t& n) noexcept { return n != 0 && (n & (n - 1)) == 0; }
+
+
+/* 長さ n の複素 FFT (基数2，時間間引き)．回転因子とビット反転の表は作成時に用意する．
+ * n が2のべき乗でなければ DFT で計算する．
+ */
+class FFT
+{
+public:
+    explicit FFT(const size_t& n = 1)
+        : n(n)
+        , twiddles((isPowerOfTwo(n)) ? n / 2 : n)
+        , reversed(n)
+    {
+        for(size_t k = 0; k < twiddles.size(); ++k)
+        {
+            const double angle = -2.0 * pi * k / n;
+            twiddles[k] = complex(std::cos(angle), std::sin(angle));
+        }
+
+        size_t bits = 0;
+        while((size_t(1) << bits) < n) ++bits;
+        for(size_t i = 0; i < n; ++i)
+        {
+            size_t r = 0;
+            for(size_t b = 0; b < bits; ++b) r |= ((i >> b) & 1) << (bits - 1 - b);
+            reversed[i] = r;
+        }
+    }
+
+    size_t size() const noexcept { return n; }
+
+    /* data[0..n) をその場で変換する．inverse なら exp(+ikx) で，1/n 倍はしない． */
+    void transform(complex *data, const bool& inverse = false) const
+    {
+        if(!isPowerOfTwo(n))
+        {
+            std::vector<complex> x(data, data + n);
+            for(size_t k = 0; k < n; ++k)
+            {
+                complex value = 0.0;
+                for(size_t j = 0; j < n; ++j)
+                {
+                    const complex w = twiddles[(j * k) % n];
+                    value += x[j] * ((inverse) ? std::conj(w) : w);
+                }
+                data[k] = value;
+            }
+            return;
+        }
+
+        for(size_t i = 0; i < n; ++i)
+            if(i < reversed[i]) std::swap(data[i], data[reversed[i]]);
+
+        for(size_t half = 1; half < n; half <<= 1)
+        {
+            const size_t step = n / (2 * half);
+            for(size_t start = 0; start < n; start += 2 * half)
+                for(size_t k = 0; k < half; ++k)
+                {
+                    const complex w = (inverse) ? std::conj(twiddles[k * step]) : twiddles[k * step];
+                    const complex t = w * data[start + k + half];
+                    data[start + k + half] = data[start + k] - t;
+                    data[start + k] += t;
+                }
+        }
+    }
+
+private:
+    size_t n;
+    std::vector<complex> twiddles;
+    std::vector<size_t> reversed;
+};
+
+
+/* rows×cols の実数の2次元 FFT．出力は k_col が 0〜cols/2 の半分 (rows×(cols/2+1))，残りはエルミート対称．
+ * 行の変換は2行を実部・虚部に詰めて1回の複素 FFT で済ませ，列の変換は数列ずつまとめて連続な領域に集めてから行う．
+ * inverse は forward の逆で，エルミート対称な半分のスペクトルから実数の配列に戻す．
+ */
+class RealFFT2D
+{
+public:
+    static constexpr size_t columnBatch = 8;
+
+    RealFFT2D(const size_t& rows, const size_t& cols)
+        : _rows(rows)
+        , _cols(cols)
+        , rowFFT(cols)
+        , colFFT(rows)
+        , buffer(std::max(cols, rows * columnBatch))
+        , work(rows * (cols / 2 + 1)) {}
+
+    size_t rows() const noexcept { return _rows; }
+    size_t cols() const noexcept { return _cols; }
+    size_t halfCols() const noexcept { return _cols / 2 + 1; }
+
+    void forward(const double *in, complex *out)
+    {
+        const size_t half = halfCols();
+
+        for(size_t r = 0; r < _rows; r += 2)
+        {
+            const double *a = in + r * _cols;
+            const double *b = (r + 1 < _rows) ? in + (r + 1) * _cols : nullptr;
+
+            for(size_t c = 0; c < _cols; ++c) buffer[c] = complex(a[c], (b) ? b[c] : 0.0);
+            rowFFT.transform(buffer.data());
+
+            //Z = A + iB から A(k) = (Z(k) + Z*(-k)) / 2，B(k) = (Z(k) - Z*(-k)) / 2i
+            for(size_t k = 0; k < half; ++k)
+            {
+                const complex z = buffer[k];
+                const complex zc = std::conj(buffer[(_cols - k) % _cols]);
+                out[r * half + k] = 0.5 * (z + zc);
+                if(b) out[(r + 1) * half + k] = complex(0.0, -0.5) * (z - zc);
+            }
+        }
+
+        for(size_t c0 = 0; c0 < half; c0 += columnBatch)
+        {
+            const size_t count = std::min(columnBatch, half - c0);
+
+            for(size_t r = 0; r < _rows; ++r)
+                for(size_t j = 0; j < count; ++j)
+                    buffer[j * _rows + r] = out[r * half + c0 + j];
+
+            for(size_t j = 0; j < count; ++j) colFFT.transform(buffer.data() + j * _rows);
+
+            for(size_t r = 0; r < _rows; ++r)
+                for(size_t j = 0; j < count; ++j)
+                    out[r * half + c0 + j] = buffer[j * _rows + r];
+        }
+    }
+
+    /* 半分のスペクトル in (rows×(cols/2+1)) を逆変換して out (rows×cols) に入れる．
+     * 1/(rows cols) 倍はしない．in は変更しない．
+     */
+    void inverse(const complex *in, double *out)
+    {
+        const size_t half = halfCols();
+
+        for(size_t c0 = 0; c0 < half; c0 += columnBatch)
+        {
+            const size_t count = std::min(columnBatch, half - c0);
+
+            for(size_t r = 0; r < _rows; ++r)
+                for(size_t j = 0; j < count; ++j)
+                    buffer[j * _rows + r] = in[r * half + c0 + j];
+
+            for(size_t j = 0; j < count; ++j) colFFT.transform(buffer.data() + j * _rows, true);
+
+            for(size_t r = 0; r < _rows; ++r)
+                for(size_t j = 0; j < count; ++j)
+                    work[r * half + c0 + j] = buffer[j * _rows + r];
+        }
+
+        //2行の実数の結果 a, b を Z = A + iB の逆変換の実部・虚部として一度に求める
+        for(size_t r = 0; r < _rows; r += 2)
+        {
+            const complex *A = &work[r * half];
+            const complex *B = (r + 1 < _rows) ? &work[(r + 1) * half] : nullptr;
+
+            for(size_t k = 0; k < _cols; ++k)
+            {
+                const complex a = (k < half) ? A[k] : std::conj(A[_cols - k]);
+                const complex b = (B) ? ((k < half) ? B[k] : std::conj(B[_cols - k])) : complex(0.0);
+                buffer[k] = a + complex(0.0, 1.0) * b;
+            }
+            rowFFT.transform(buffer.data(), true);
+
+            for(size_t c = 0; c < _cols; ++c)
+            {
+                out[r * _cols + c] = buffer[c].real();
+                if(B) out[(r + 1) * _cols + c] = buffer[c].imag();
+            }
+        }
+    }
+
+private:
+    size_t _rows;
+    size_t _cols;
+    FFT rowFFT;
+    FFT colFFT;
+    std::vector<complex> buffer;
+    std::vector<complex> work;   //inverse の列の変換の結果
+};
+
+
+/* 構造因子・相関関数・相関長をサンプルごとに積算する */
+class StructureFactor
+{
+public:
+    StructureFactor(const size_t& rows, const size_t& cols)
+        : fft(rows, cols)
+        , spins(rows * cols)
+        , spectrum(rows * fft.halfCols())
+        , sum(rows * fft.halfCols(), 0.0) {}
+
+    size_t rows() const noexcept { return fft.rows(); }
+    size_t cols() const noexcept { return fft.cols(); }
+
+    /* State の (N - 1)×(M - 1) の格子 (複製した最終行・最終列を除く) を1サンプルとして加える */
+    template<size_t N, size_t M>
+    bool add(const State<N, M, bool>& state)
+    {
+        if(N - 1 != rows() || M - 1 != cols()) return false;
+
+        for(size_t r = 0; r < rows(); ++r)
+            for(size_t c = 0; c < cols(); ++c)
+                spins[r * cols() + c] = (state.at(r, c)) ? 1.0 : -1.0;
+
+        accumulate();
+        return true;
+    }
+
+    template<size_t N, size_t M>
+    bool add(const BitState<N, M>& state)
+    {
+        if(N != rows() || M != cols()) return false;
+
+        for(size_t r = 0; r < rows(); ++r)
+            for(size_t c = 0; c < cols(); ++c)
+                spins[r * cols() + c] = (state.at(r, c)) ? 1.0 : -1.0;
+
+        accumulate();
+        return true;
+    }
+
+    void clear()
+    {
+        std::fill(sum.begin(), sum.end(), 0.0);
+        count = 0;
+        s0.clear();
+        sMin.clear();
+    }
+
+    size_t sampleCount() const noexcept { return count; }
+
+    /* 平均した S(k)．(kRow, kCol) は 0〜rows-1，0〜cols-1 の波数の番号 */
+    double structureFactor(const size_t& kRow, const size_t& kCol) const noexcept
+    {
+        if(count == 0) return 0.0;
+
+        const size_t half = fft.halfCols();
+        if(kCol < half) return sum[kRow * half + kCol] / count;
+        return sum[((rows() - kRow) % rows()) * half + (cols() - kCol)] / count;
+    }
+
+    /* 二次モーメントの相関長．行方向 (波数 2π / rows) と列方向 (2π / cols) でそれぞれ求めて平均する．
+     * 長さ1の方向には最小の波数がないので使わない．
+     */
+    double correlationLength() const noexcept
+    {
+        if(count == 0) return 0.0;
+
+        const double S0 = structureFactor(0, 0);
+        const auto length = [&](const double& S1, const size_t& size)
+        {
+            if(S1 <= 0.0 || S0 <= S1) return 0.0;
+            return std::sqrt(S0 / S1 - 1.0) / (2.0 * std::sin(pi / size));
+        };
+
+        double total = 0.0;
+        size_t directions = 0;
+        if(rows() > 1)
+        {
+            total += length(structureFactor(1, 0), rows());
+            directions++;
+        }
+        if(cols() > 1)
+        {
+            total += length(structureFactor(0, 1), cols());
+            directions++;
+        }
+        return (directions > 0) ? total / directions : 0.0;
+    }
+
+    /* サンプルごとの S(0) = (サイト数) m^2 と S(kmin) (2つの方向の平均) */
+    const RunningStat& zeroModeStat() const noexcept { return s0; }
+    const RunningStat& minModeStat() const noexcept { return sMin; }
+
+    /* 相関関数 G(r) (rows×cols，G(0) = 1)．平均した S(k) を逆変換して求める． */
+    std::vector<double> correlation()
+    {
+        std::vector<double> g(rows() * cols(), 0.0);
+        if(count == 0) return g;
+
+        //S(k) は実数で S(-k) = S(k) なので，逆変換は S を実数の配列として順変換したものと同じ
+        for(size_t r = 0; r < rows(); ++r)
+            for(size_t c = 0; c < cols(); ++c)
+                spins[r * cols() + c] = structureFactor(r, c);
+
+        fft.forward(spins.data(), spectrum.data());
+
+        const size_t half = fft.halfCols();
+        const double scale = 1.0 / (rows() * cols());
+        for(size_t r = 0; r < rows(); ++r)
+            for(size_t c = 0; c < cols(); ++c)
+            {
+                const complex value = (c < half) ? spectrum[r * half + c]
+                                                 : std::conj(spectrum[((rows() - r) % rows()) * half + (cols() - c)]);
+                g[r * cols() + c] = value.real() * scale;
+            }
+
+        return g;
+    }
+
+    /* G(r) を最小像の距離 |r| (幅1の区間) ごとに平均する．i 番目は距離 [i - 0.5, i + 0.5) */
+    std::vector<double> radialCorrelation()
+    {
+        const std::vector<double> g = correlation();
+        const size_t maxDistance = static_cast<size_t>(std::ceil(0.5 * std::sqrt(double(rows() * rows() + cols() * cols())))) + 1;
+
+        std::vector<double> total(maxDistance, 0.0);
+        std::vector<size_t> number(maxDistance, 0);
+
+        for(size_t r = 0; r < rows(); ++r)
+            for(size_t c = 0; c < cols(); ++c)
+            {
+                const double dr = static_cast<double>(std::min(r, rows() - r));
+                const double dc = static_cast<double>(std::min(c, cols() - c));
+                const size_t bin = static_cast<size_t>(std::lround(std::sqrt(dr * dr + dc * dc)));
+
+                total[bin] += g[r * cols() + c];
+                number[bin]++;
+            }
+
+        for(size_t i = 0; i < maxDistance; ++i)
+            if(number[i] > 0) total[i] /= number[i];
+
+        return total;
+    }
+
+private:
+    void accumulate()
+    {
+        fft.forward(spins.data(), spectrum.data());
+
+        const double scale = 1.0 / (rows() * cols());
+        for(size_t i = 0; i < spectrum.size(); ++i) sum[i] += std::norm(spectrum[i]) * scale;
+        ++count;
+
+        s0.push(std::norm(spectrum[0]) * scale);
+
+        //長さ1の方向には最小の波数がない
+        double minMode = 0.0;
+        size_t directions = 0;
+        if(rows() > 1)
+        {
+            minMode += std::norm(spectrum[fft.halfCols()]);
+            directions++;
+        }
+        if(cols() > 1)
+        {
+            minMode += std::norm(spectrum[1]);
+            directions++;
+        }
+        if(directions > 0) sMin.push(minMode / directions * scale);
+    }
+
+    RealFFT2D fft;
+    std::vector<double> spins;       //入力 (±1) と逆変換の作業領域
+    std::vector<complex> spectrum;
+    std::vector<double> sum;         //S(k) の和 (k_col は半分だけ)
+    size_t count = 0;
+    RunningStat s0;
+    RunningStat sMin;
+};
+
+} //namespace Correlation
+
+#endif // CORRELATION_H
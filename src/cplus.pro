@@ -16,9 +16,29 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
 HEADERS += \
+    avalanche.h \
+    blockspin.h \
+    campaign.h \
+    cftp.h \
+    clusteranalysis.h \
+    correlation.h \
+    creutz.h \
+    equilibriumcache.h \
     isingmodel.h \
     isingspinconfig.h \
+    kawasaki.h \
+    longrange.h \
     mathutil.h \
+    meanfield.h \
+    montecarlo.h \
     neuralnetwork.h \
+    pca.h \
+    populationannealing.h \
+    potts.h \
+    selflearningmc.h \
     solve_selfconsistent.h \
-    train-isingmodel.h
+    temperaturegrid.h \
+    tensornetwork.h \
+    train-isingmodel.h \
+    trajectory.h \
+    vectorspin.h
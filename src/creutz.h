@@ -0,0 +1,396 @@
+#ifndef CREUTZ_H
+#define CREUTZ_H
+
+#include "mathutil.h"
+#include "isingmodel.h"
+#include <cmath>
+#include <random>
+#include <vector>
+
+
+/* Creutz のデーモン法(小正準集団)．
+ * 系とデーモンの全エネルギーを一定に保ち，スピンを反転させたときのエネルギー差を
+ * デーモンとやり取りする．デーモンのエネルギーは負にならない範囲で受け渡すので，
+ * 採択の判定は整数の比較だけで乱数を使わない．
+ * 温度はデーモンのエネルギー分布 P(Ed) ∝ exp(-Ed / kT) から求める．
+ */
+template<LatticeType Lattice = LatticeType::Square>
+class CreutzDemon
+{
+public:
+    using Stencil = LatticeStencil<Lattice>;
+
+    /* demonCount 個のデーモンを用意し，サイト k はデーモン k % demonCount とやり取りする */
+    CreutzDemon(IsingModel *ising, const size_t& demonCount = 1)
+        : ising(ising)
+        , demons(std::max<size_t>(demonCount, 1), 0) {}
+
+    /* デーモンのエネルギーの刻み．z が偶数なら 4J，奇数なら 2J */
+    int quantum() const noexcept { return ((Stencil::z % 2 == 0) ? 4 : 2) * std::abs(ising->param.J); }
+
+    /* 各デーモンに energy を与える．刻みの倍数に丸める． */
+    void initDemons(const int& energy)
+    {
+        const int q = quantum();
+        for(auto& d : demons) d = (q == 0) ? 0 : (std::max(energy, 0) / q) * q;
+        clearHistogram();
+    }
+
+    /* 全スピン up から乱数で選んだサイトを反転させ，1サイトあたりのエネルギーが
+     * energyPerSite 以上の配位を作る．全スピンが揃った配位から順に走査すると
+     * 同じ反転を繰り返す周期軌道に入りやすいので，初期配位はこれで用意する．
+     * (乱数を使うのは初期配位の準備だけで，sweep() は乱数を使わない)
+     */
+    template<size_t N, size_t M>
+    void prepare(State<N, M, bool>& state, const double& energyPerSite, const unsigned int& seed = 0)
+    {
+        std::mt19937 mt(seed);
+        std::uniform_int_distribution<size_t> randRow(0, N - 2);
+        std::uniform_int_distribution<size_t> randCol(0, M - 2);
+
+        const double target = energyPerSite * (N - 1) * (M - 1);
+        state.init(true);
+        double energy = Stencil::energy(state, ising->param.J);
+
+        while(energy < target)
+        {
+            const size_t r = randRow(mt);
+            const size_t c = randCol(mt);
+            const int spin = (state.at(r, c)) ? 1 : -1;
+
+            energy += 2 * ising->param.J * spin * Stencil::neighborSpin(state, r, c);
+            Stencil::setSpin(state, r, c, !state.at(r, c));
+        }
+    }
+
+    /* 格子を順に1回走査する．サイトとデーモンの対応は走査ごとに1つずらす． */
+    template<size_t N, size_t M>
+    void sweep(State<N, M, bool>& state) noexcept
+    {
+        static_assert(N > 2 && M > 2, "lattice is too small");
+
+        const int J = ising->param.J;
+        const size_t demonCount = demons.size();
+        size_t site = sweepCount++;
+
+        for(size_t r = 0; r < N - 1; ++r)
+            for(size_t c = 0; c < M - 1; ++c, ++site)
+            {
+                int& demon = demons[site % demonCount];
+                const int spin = (state.at(r, c)) ? 1 : -1;
+                const int dE = 2 * J * spin * Stencil::neighborSpin(state, r, c);
+
+                if(dE <= demon)
+                {
+                    demon -= dE;
+                    Stencil::setSpin(state, r, c, !state.at(r, c));
+                }
+            }
+
+        record();
+    }
+
+    template<size_t sweepCount, size_t N, size_t M>
+    void optimize(State<N, M, bool>& state) noexcept
+    {
+        for(size_t i = 0; i < sweepCount; ++i) sweep(state);
+    }
+
+    /* 系のエネルギーとデーモンのエネルギーの和 (保存量) */
+    template<size_t N, size_t M>
+    double totalEnergy(const State<N, M, bool>& state) const noexcept
+    {
+        return Stencil::energy(state, ising->param.J) + demonEnergy();
+    }
+
+    double demonEnergy() const noexcept
+    {
+        double sum = 0;
+        for(const auto& d : demons) sum += d;
+        return sum;
+    }
+
+    /* 平均デーモンエネルギー <Ed> = q / (exp(q / kT) - 1) から温度を求める */
+    double temperature() const noexcept
+    {
+        double count = 0, sum = 0;
+        for(size_t i = 0; i < histogram.size(); ++i)
+        {
+            count += histogram[i];
+            sum += histogram[i] * i;
+        }
+        if(count == 0 || sum == 0) return 0.0;
+
+        return 1.0 / (ising->param.kb * std::log(1.0 + count / sum) / quantum());
+    }
+
+    /* ln P(Ed) を Ed について最小二乗で直線に当てはめ，傾きから温度を求める */
+    double fitTemperature() const noexcept
+    {
+        double sw = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+        for(size_t i = 0; i < histogram.size(); ++i)
+        {
+            if(histogram[i] == 0) continue;
+            const double w = histogram[i]; //出現数で重み付けする
+            const double x = static_cast<double>(i) * quantum();
+            const double y = std::log(static_cast<double>(histogram[i]));
+            sw += w; sx += w * x; sy += w * y; sxx += w * x * x; sxy += w * x * y;
+        }
+        const double slope = (sw * sxy - sx * sy) / (sw * sxx - sx * sx);
+        if(!(slope < 0)) return 0.0;
+
+        return - 1.0 / (ising->param.kb * slope);
+    }
+
+    const std::vector<size_t>& demonHistogram() const noexcept { return histogram; }
+    const std::vector<int>& demonEnergies() const noexcept { return demons; }
+    void clearHistogram() { histogram.clear(); }
+
+private:
+    void record()
+    {
+        const int q = quantum();
+        if(q == 0) return;
+
+        for(const auto& d : demons)
+        {
+            const size_t level = static_cast<size_t>(d / q);
+            if(level >= histogram.size()) histogram.resize(level + 1, 0);
+            histogram[level]++;
+        }
+    }
+
+    IsingModel *ising; //this has no ownership
+    std::vector<int> demons;
+    std::vector<size_t> histogram; //デーモンのエネルギー(刻み単位)ごとの出現数
+    size_t sweepCount = 0;
+};
+
+
+
+
+/* 正方格子のスピンとデーモンを1サイト1bitずつ詰めて，64サイトを同時に更新する Creutz のセル・オートマトン．
+ * 各サイトに容量 3 (単位 4J) のデーモンを置き，そのエネルギーを2枚のビット平面で持つ．
+ * 市松模様の副格子ごとに更新するので，同時に更新するサイトは互いに隣接しない．
+ * 格子は最終行・最終列を複製しない N×M のトーラスで，M は64の倍数，N と M は偶数とする．
+ * q2rSweep() はデーモンを使わず，エネルギーが変わらない反転だけを行う決定論的な Q2R 則．
+ */
+template<size_t N, size_t M>
+class CreutzDemonBit
+{
+public:
+    static_assert(M % 64 == 0 && N % 2 == 0, "M must be a multiple of 64 and N must be even");
+
+    static constexpr size_t wordsPerRow = M / 64;
+    static constexpr int capacity = 3;
+
+    CreutzDemonBit(IsingModel *ising) : ising(ising) {}
+
+    BitState<N, M>& spins() noexcept { return _spins; }
+    const BitState<N, M>& spins() const noexcept { return _spins; }
+
+    /* 全スピン up から乱数で選んだサイトを反転させ，1サイトあたりのエネルギーが energyPerSite 以上の配位を作る */
+    void prepare(const double& energyPerSite, const unsigned int& seed = 0)
+    {
+        std::mt19937 mt(seed);
+        std::uniform_int_distribution<size_t> randRow(0, N - 1);
+        std::uniform_int_distribution<size_t> randCol(0, M - 1);
+
+        const double target = energyPerSite * N * M;
+        _spins.init(true);
+        double e = energy();
+
+        while(e < target)
+        {
+            const size_t r = randRow(mt);
+            const size_t c = randCol(mt);
+            const bool s = _spins.at(r, c);
+
+            int aligned = 0;
+            aligned += (_spins.at((r + N - 1) % N, c) == s);
+            aligned += (_spins.at((r + 1) % N, c) == s);
+            aligned += (_spins.at(r, (c + M - 1) % M) == s);
+            aligned += (_spins.at(r, (c + 1) % M) == s);
+
+            e += 2.0 * ising->param.J * (2 * aligned - 4);
+            _spins.flip(r, c);
+        }
+    }
+
+    /* 全サイトのデーモンに level (0〜3，単位 4J) を与える．
+     * 全スピンが揃った配位から反転させるには level 2 以上が必要．
+     */
+    void initDemons(const int& level)
+    {
+        for(size_t i = 0; i < N * wordsPerRow; ++i)
+        {
+            demon0[i] = (level & 1) ? ~uint64_t(0) : 0;
+            demon1[i] = (level & 2) ? ~uint64_t(0) : 0;
+        }
+        for(auto& h : histogram) h = 0;
+    }
+
+    /* 両方の副格子を1回ずつ更新する */
+    void sweep() noexcept
+    {
+        update<false>(0);
+        update<false>(1);
+        record();
+    }
+
+    void q2rSweep() noexcept
+    {
+        update<true>(0);
+        update<true>(1);
+    }
+
+    /* 反平行な最近接ボンドの数 */
+    size_t antiBondCount() const noexcept
+    {
+        size_t count = 0;
+        for(size_t r = 0; r < N; ++r)
+        {
+            const uint64_t *row = _spins.row(r);
+            const uint64_t *down = _spins.row((r + 1) % N);
+            for(size_t w = 0; w < wordsPerRow; ++w)
+                count += bitCount(row[w] ^ right(row, w)) + bitCount(row[w] ^ down[w]);
+        }
+        return count;
+    }
+
+    /* 系のエネルギー */
+    double energy() const noexcept
+    {
+        const double bonds = 2.0 * N * M;
+        return - ising->param.J * (bonds - 2.0 * antiBondCount());
+    }
+
+    /* 系とデーモンのエネルギーの和 (保存量) */
+    double totalEnergy() const noexcept
+    {
+        size_t level = 0;
+        for(size_t i = 0; i < N * wordsPerRow; ++i)
+            level += bitCount(demon0[i]) + 2 * bitCount(demon1[i]);
+        return energy() + 4.0 * ising->param.J * level;
+    }
+
+    double averageSpin() const noexcept
+    {
+        return (2.0 * _spins.upCount() - static_cast<double>(N * M)) / (N * M);
+    }
+
+    /* デーモンの分布 P(d) ∝ exp(-4Jd / kT) (d = 0〜3) を最小二乗で当てはめて温度を求める */
+    double temperature() const noexcept
+    {
+        double sw = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+        for(int d = 0; d <= capacity; ++d)
+        {
+            if(histogram[d] == 0) continue;
+            const double w = static_cast<double>(histogram[d]);
+            const double x = 4.0 * ising->param.J * d;
+            const double y = std::log(w);
+            sw += w; sx += w * x; sy += w * y; sxx += w * x * x; sxy += w * x * y;
+        }
+        const double slope = (sw * sxy - sx * sy) / (sw * sxx - sx * sx);
+        if(!(slope < 0)) return 0.0;
+
+        return - 1.0 / (ising->param.kb * slope);
+    }
+
+    const size_t *demonHistogram() const noexcept { return histogram; }
+    void clearHistogram() noexcept { for(auto& h : histogram) h = 0; }
+
+private:
+    /* 列方向に1つずらした行 (左隣・右隣のスピンを各ビットに並べる) */
+    static uint64_t left(const uint64_t *row, const size_t& w) noexcept
+    {
+        const uint64_t prev = row[(w == 0) ? wordsPerRow - 1 : w - 1];
+        return (row[w] << 1) | (prev >> 63);
+    }
+    static uint64_t right(const uint64_t *row, const size_t& w) noexcept
+    {
+        const uint64_t next = row[(w + 1 == wordsPerRow) ? 0 : w + 1];
+        return (row[w] >> 1) | (next << 63);
+    }
+
+    /* (r + c) % 2 == parity の副格子を更新する．
+     * 反平行な近傍の数 a (0〜4) に対して ΔE = 4J(2 - a)．
+     * デーモン法では s = d + a が 2〜5 のとき採択し d ← s - 2 とする．
+     * Q2R では a = 2 のとき反転する．
+     */
+    template<bool Q2R>
+    void update(const size_t& parity) noexcept
+    {
+        static constexpr uint64_t evenMask = 0x5555555555555555ULL;
+
+        for(size_t r = 0; r < N; ++r)
+        {
+            uint64_t *row = _spins.row(r);
+            const uint64_t *up = _spins.row((r == 0) ? N - 1 : r - 1);
+            const uint64_t *down = _spins.row((r + 1 == N) ? 0 : r + 1);
+            const uint64_t mask = ((r + parity) % 2 == 0) ? evenMask : ~evenMask;
+
+            for(size_t w = 0; w < wordsPerRow; ++w)
+            {
+                const uint64_t s = row[w];
+                const uint64_t x0 = s ^ up[w];
+                const uint64_t x1 = s ^ down[w];
+                const uint64_t x2 = s ^ left(row, w);
+                const uint64_t x3 = s ^ right(row, w);
+
+                //a = x0 + x1 + x2 + x3 (ビットスライスの加算)
+                const uint64_t p0 = x0 ^ x1, p1 = x0 & x1;
+                const uint64_t q0 = x2 ^ x3, q1 = x2 & x3;
+                const uint64_t a0 = p0 ^ q0;
+                const uint64_t c0 = p0 & q0;
+                const uint64_t a1 = p1 ^ q1 ^ c0;
+                const uint64_t a2 = (p1 & q1) | ((p1 ^ q1) & c0);
+
+                uint64_t accept;
+                if constexpr(Q2R)
+                {
+                    accept = a1 & ~a2 & ~a0 & mask;
+                }
+                else
+                {
+                    const size_t i = r * wordsPerRow + w;
+                    const uint64_t d0 = demon0[i], d1 = demon1[i];
+
+                    //t = d + a (3bit)
+                    const uint64_t t0 = d0 ^ a0;
+                    const uint64_t k0 = d0 & a0;
+                    const uint64_t t1 = d1 ^ a1 ^ k0;
+                    const uint64_t k1 = (d1 & a1) | ((d1 ^ a1) & k0);
+                    const uint64_t t2 = a2 ^ k1;
+
+                    accept = (t2 ^ t1) & mask;
+
+                    demon0[i] = (d0 & ~accept) | (t0 & accept);
+                    demon1[i] = (d1 & ~accept) | (~t1 & accept);
+                }
+
+                row[w] = s ^ accept;
+            }
+        }
+    }
+
+    void record() noexcept
+    {
+        for(size_t i = 0; i < N * wordsPerRow; ++i)
+        {
+            const uint64_t d0 = demon0[i], d1 = demon1[i];
+            histogram[0] += bitCount(~d0 & ~d1);
+            histogram[1] += bitCount(d0 & ~d1);
+            histogram[2] += bitCount(~d0 & d1);
+            histogram[3] += bitCount(d0 & d1);
+        }
+    }
+
+    IsingModel *ising; //this has no ownership
+    BitState<N, M> _spins;
+    std::vector<uint64_t> demon0 = std::vector<uint64_t>(N * wordsPerRow, 0); //デーモンのエネルギーの下位ビット
+    std::vector<uint64_t> demon1 = std::vector<uint64_t>(N * wordsPerRow, 0); //デーモンのエネルギーの上位ビット
+    size_t histogram[capacity + 1] = {};
+};
+
+#endif // CREUTZ_H
@@ -0,0 +1,236 @@
+#ifndef EQUILIBRIUMCACHE_H
+#define EQUILIBRIUMCACHE_H
+
+#include "mathutil.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+
+/* 平衡化したスピン配位をディスクに保存し，同じパラメータのシミュレーションで再利用するキャッシュ．
+ * 1エントリ1ファイル (directory/<キーのハッシュ>.eqc) で，中身はキー・自己相関時間・BitState のワード列．
+ * 読み込むたびにファイルの更新時刻を今にするので，更新時刻の古い順に消せば LRU になる．
+ * 合計の大きさが maxBytes を超えたら古いものから消す．
+ */
+class EquilibriumCache
+{
+public:
+    struct Key
+    {
+        size_t rows = 0;
+        size_t cols = 0;
+        LatticeType lattice = LatticeType::Square;
+        double T = 0.0;
+        double J = 0.0;
+        std::string engine;   //更新方法の名前 (更新規則や走査順ごとに変える)
+
+        /* FNV-1a */
+        uint64_t hash() const noexcept
+        {
+            uint64_t h = 0xcbf29ce484222325ULL;
+            const auto mix = [&h](const void *data, const size_t& size)
+            {
+                const unsigned char *p = static_cast<const unsigned char*>(data);
+                for(size_t i = 0; i < size; ++i)
+                {
+                    h ^= p[i];
+                    h *= 0x100000001b3ULL;
+                }
+            };
+
+            const uint64_t r = rows, c = cols;
+            const int l = static_cast<int>(lattice);
+            mix(&r, sizeof(r));
+            mix(&c, sizeof(c));
+            mix(&l, sizeof(l));
+            mix(&T, sizeof(T));
+            mix(&J, sizeof(J));
+            mix(engine.data(), engine.size());
+            return h;
+        }
+
+        bool operator==(const Key& other) const noexcept
+        {
+            return rows == other.rows && cols == other.cols && lattice == other.lattice &&
+                   T == other.T && J == other.J && engine == other.engine;
+        }
+    };
+
+    explicit EquilibriumCache(const std::string& directory, const uintmax_t& maxBytes = 256ULL << 20)
+        : directory(directory)
+        , maxBytes(maxBytes)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+    }
+
+    /* キャッシュにあれば state に読み込み，自己相関時間を tau に入れて true を返す */
+    template<size_t N, size_t M>
+    bool load(Key key, State<N, M, bool>& state, double *tau = nullptr)
+    {
+        key.rows = N;
+        key.cols = M;
+
+        const std::filesystem::path path = pathOf(key);
+        std::ifstream fin(path, std::ios::in | std::ios::binary);
+        if(!fin) return false;
+
+        Key stored;
+        double storedTau = 0.0;
+        if(!readHeader(fin, stored, storedTau) || !(stored == key)) return false;
+
+        BitState<N, M> bits;
+        fin.read(reinterpret_cast<char*>(bits.data()), BitState<N, M>::wordCount * sizeof(uint64_t));
+        if(!fin) return false;
+        fin.close();
+
+        bits.unpack(state);
+        if(tau) *tau = storedTau;
+
+        //LRU のために更新時刻を今にする
+        std::error_code ec;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+        return true;
+    }
+
+    /* state を保存し，大きさの上限を超えていれば古いエントリを消す */
+    template<size_t N, size_t M>
+    bool store(Key key, const State<N, M, bool>& state, const double& tau)
+    {
+        key.rows = N;
+        key.cols = M;
+
+        const std::filesystem::path path = pathOf(key);
+        const std::filesystem::path temporary = path.string() + ".tmp";
+        {
+            std::ofstream fout(temporary, std::ios::out | std::ios::binary | std::ios::trunc);
+            if(!fout) return false;
+
+            writeHeader(fout, key, tau);
+            const BitState<N, M> bits(state);
+            fout.write(reinterpret_cast<const char*>(bits.data()), BitState<N, M>::wordCount * sizeof(uint64_t));
+            if(!fout) return false;
+        }
+
+        //書き込みが終わってから置き換えるので，途中で止まっても壊れたエントリは残らない
+        std::error_code ec;
+        std::filesystem::rename(temporary, path, ec);
+        if(ec) return false;
+
+        evict();
+        return true;
+    }
+
+    /* キャッシュにあれば読み込み，なければ equilibrate(state) (自己相関時間を返す) で平衡化して保存する．
+     * 自己相関時間を返す．
+     */
+    template<size_t N, size_t M, typename Equilibrate>
+    double acquire(Key key, State<N, M, bool>& state, Equilibrate&& equilibrate)
+    {
+        key.rows = N;
+        key.cols = M;
+
+        double tau = 0.0;
+        if(load(key, state, &tau)) return tau;
+
+        tau = equilibrate(state);
+        store(key, state, tau);
+        return tau;
+    }
+
+    /* 合計の大きさが maxBytes 以下になるまで更新時刻の古いエントリから消す */
+    void evict()
+    {
+        struct Entry
+        {
+            std::filesystem::path path;
+            std::filesystem::file_time_type time;
+            uintmax_t size;
+        };
+
+        std::vector<Entry> entries;
+        uintmax_t total = 0;
+        std::error_code ec;
+
+        for(const auto& item : std::filesystem::directory_iterator(directory, ec))
+        {
+            if(item.path().extension() != ".eqc") continue;
+
+            const uintmax_t size = item.file_size(ec);
+            if(ec) continue;
+            entries.push_back({ item.path(), item.last_write_time(ec), size });
+            total += size;
+        }
+        if(total <= maxBytes) return;
+
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b){ return a.time < b.time; });
+        for(const auto& entry : entries)
+        {
+            if(total <= maxBytes) break;
+            if(std::filesystem::remove(entry.path, ec)) total -= entry.size;
+        }
+    }
+
+    void setMaxBytes(const uintmax_t& bytes) { maxBytes = bytes; }
+
+private:
+    static constexpr char magic[4] = { 'E', 'Q', 'C', '1' };
+
+    std::filesystem::path pathOf(const Key& key) const
+    {
+        static const char digits[] = "0123456789abcdef";
+        uint64_t h = key.hash();
+        std::string name(16, '0');
+        for(size_t i = 0; i < 16; ++i, h >>= 4) name[15 - i] = digits[h & 0xf];
+
+        return std::filesystem::path(directory) / (name + ".eqc");
+    }
+
+    template<typename T>
+    static void put(std::ostream& out, const T& value) { out.write(reinterpret_cast<const char*>(&value), sizeof(T)); }
+    template<typename T>
+    static bool get(std::istream& in, T& value) { return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T))); }
+
+    static void writeHeader(std::ostream& out, const Key& key, const double& tau)
+    {
+        out.write(magic, sizeof(magic));
+        put<uint64_t>(out, key.rows);
+        put<uint64_t>(out, key.cols);
+        put<int32_t>(out, static_cast<int32_t>(key.lattice));
+        put<double>(out, key.T);
+        put<double>(out, key.J);
+        put<uint32_t>(out, static_cast<uint32_t>(key.engine.size()));
+        out.write(key.engine.data(), key.engine.size());
+        put<double>(out, tau);
+    }
+
+    static bool readHeader(std::istream& in, Key& key, double& tau)
+    {
+        char head[sizeof(magic)];
+        if(!in.read(head, sizeof(head)) || std::memcmp(head, magic, sizeof(magic)) != 0) return false;
+
+        uint64_t rows, cols;
+        int32_t lattice;
+        uint32_t engineSize;
+        if(!get(in, rows) || !get(in, cols) || !get(in, lattice) || !get(in, key.T) || !get(in, key.J) || !get(in, engineSize))
+            return false;
+        if(engineSize > 4096) return false;
+
+        key.rows = rows;
+        key.cols = cols;
+        key.lattice = static_cast<LatticeType>(lattice);
+        key.engine.resize(engineSize);
+        if(!in.read(key.engine.data(), engineSize)) return false;
+
+        return get(in, tau);
+    }
+
+    std::string directory;
+    uintmax_t maxBytes;
+};
+
+#endif // EQUILIBRIUMCACHE_H
@@ -18,6 +18,12 @@ public:
         int J = 1;
         double T = 0.1;
         double kb = 1.0;
+
+        //MonteCarlo::Engine で Interaction に含めたときだけ使う項
+        double h = 0.0;   //外場
+        double Jx = 1.0;  //異方的な結合 (Anisotropic では J の代わりに横のボンドに Jx，それ以外に Jy)
+        double Jy = 1.0;
+        double J2 = 0.0;  //次近接の結合
     } param;
 
     explicit IsingModel(const Parameter& param = Parameter())
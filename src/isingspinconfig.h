@@ -3,8 +3,29 @@
 
 #include "isingmodel.h"
 #include "mathutil.h"
+#include "avalanche.h"
+#include "blockspin.h"
+#include "campaign.h"
+#include "cftp.h"
+#include "clusteranalysis.h"
+#include "correlation.h"
+#include "creutz.h"
+#include "equilibriumcache.h"
+#include "kawasaki.h"
+#include "longrange.h"
+#include "meanfield.h"
+#include "montecarlo.h"
+#include "populationannealing.h"
+#include "potts.h"
+#include "selflearningmc.h"
+#include "temperaturegrid.h"
+#include "tensornetwork.h"
+#include "trajectory.h"
+#include "vectorspin.h"
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <sstream>
 
 
 
@@ -135,4 +156,1058 @@ void magnetizationOfSpinConfigurationHeatBathFixedSeed()
     }
 }
 
+
+
+
+/* 方策を組み合わせたモンテカルロ法によってイジングモデルのスピン配位をシミュレートする．
+ * メトロポリス法を市松模様の順に走査し，格子ごとに磁化の温度依存性を求める．
+ */
+template<LatticeType Lattice = LatticeType::Square>
+void magnetizationOfSpinConfigurationEngine()
+{
+    using StateType = State<21, 21, bool>;
+    StateType state;
+
+    IsingModel ising;
+    MonteCarlo::Engine<Lattice,
+                       MonteCarlo::Metropolis,
+                       MonteCarlo::CheckerboardScan,
+                       MonteCarlo::Xoshiro256> engine(&ising);
+
+    double T = 0.0;
+    const double Tc = ising.Tc();
+    static constexpr size_t sweepCount = 2500;
+
+    std::ofstream fout;
+    fout.open("isingspinconfig_engine_" + std::to_string(sweepCount) + ".csv");
+
+    while(T < 4.0 * Tc)
+    {
+        state.initRand();
+        ising.param.T = T;
+        for(size_t i = 0; i < sweepCount; ++i) engine.sweep(state);
+
+        const double t = T / Tc;
+        fout << t << ',' << IsingModel::averageSpin(state) << ',' << engine.energy(state) << '\n';
+        std::cout << t << std::endl;
+
+        T += 0.005;
+    }
+
+    fout.close();
+}
+
+
+
+/* 熱浴法で更新したスピン配位の時系列をトラジェクトリファイルに記録する．
+ * 記録したファイルをメモリマップで読み直し，各フレームの平均磁化を書き出す．
+ */
+void recordSpinConfigurationTrajectory()
+{
+    using StateType = State<64, 64, bool>;
+    StateType state;
+    IsingModel ising;
+    IsingHeatBathMethod hbMethod(&ising);
+
+    static constexpr size_t updateCount = 1e6;
+    static constexpr size_t interval = 100;
+    const std::string path = "isingspinconfig_hb.traj";
+
+    ising.param.T = 0.9 * 2 * ising.param.J / (ising.param.kb * std::log(std::sqrt(2) + 1));
+    state.initRand();
+
+    {
+        Trajectory::TrajectoryWriter<63, 63> writer(path);   //State の複製の行と列を除いた格子
+        hbMethod.optimize<updateCount>(state, writer, interval);
+    }
+
+    Trajectory::TrajectoryReader reader;
+    if(!reader.open(path)) return;
+
+    std::ofstream fout;
+    fout.open("isingspinconfig_hb_traj.csv");
+
+    const double spinCount = reader.rows() * reader.cols();
+    reader.forEachFrameHeader([&](const size_t&, const Trajectory::TrajectoryReader::FrameHeader& header)
+    {
+        fout << header.step << ',' << (2.0 * header.upCount - spinCount) / spinCount << '\n';
+    });
+
+    fout.close();
+}
+
+
+
+/* Creutz のデーモン法でスピン配位をシミュレートする．
+ * 温度ではなく1サイトあたりのエネルギーを与え，デーモンのエネルギー分布から温度を求める．
+ */
+void magnetizationOfSpinConfigurationCreutz()
+{
+    using StateType = State<65, 65, bool>;
+    StateType state;
+
+    IsingModel ising;
+    CreutzDemon<LatticeType::Square> demon(&ising, 64);
+
+    const double Tc = ising.Tc();
+    static constexpr size_t relaxCount = 1000;
+    static constexpr size_t sweepCount = 5000;
+    static constexpr double siteCount = 64 * 64;
+
+    std::ofstream fout;
+    fout.open("isingspinconfig_creutz_" + std::to_string(sweepCount) + ".csv");
+
+    for(double e = -1.95; e < 0.0; e += 0.025)
+    {
+        demon.prepare(state, e);
+        demon.initDemons(0);
+        demon.optimize<relaxCount>(state);
+        demon.clearHistogram();
+
+        double m = 0.0, energy = 0.0;
+        for(size_t i = 0; i < sweepCount; ++i)
+        {
+            demon.sweep(state);
+            m += std::abs(IsingModel::averageSpin(state));
+            energy += LatticeStencil<LatticeType::Square>::energy(state, ising.param.J);
+        }
+
+        const double t = demon.temperature() / Tc;
+        fout << t << ',' << m / sweepCount << ',' << energy / sweepCount / siteCount << '\n';
+        std::cout << t << std::endl;
+    }
+
+    fout.close();
+}
+
+
+
+/* coupling from the past で平衡分布から厳密にサンプリングし，磁化の温度依存性を求める．
+ * 緩和に必要な走査の回数を決める必要はない．高温側から下げていき，さかのぼる走査の回数が
+ * 上限を超えて一致しなくなった温度で終える．
+ */
+template<LatticeType Lattice = LatticeType::Square>
+void magnetizationOfSpinConfigurationCFTP()
+{
+    using StateType = State<17, 17, bool>;
+    StateType state;
+
+    IsingModel ising;
+    CouplingFromThePast<Lattice> cftp(&ising, 1, 14);
+
+    const double Tc = ising.Tc();
+    static constexpr size_t sampleCount = 200;
+
+    std::ofstream fout;
+    fout.open("isingspinconfig_cftp_" + std::to_string(sampleCount) + ".csv");
+
+    uint64_t seed = 0;
+    for(double T = 4.0 * Tc; T > 0.0; T -= 0.02)
+    {
+        ising.param.T = T;
+
+        double m = 0.0, energy = 0.0, lookBack = 0.0;
+        size_t i = 0;
+        for(; i < sampleCount; ++i)
+        {
+            if(!cftp.sample(state, seed++)) break;
+
+            m += std::abs(IsingModel::averageSpin(state));
+            energy += LatticeStencil<Lattice>::energy(state, ising.param.J);
+            lookBack += cftp.lookBack();
+        }
+        if(i < sampleCount) break;
+
+        const double t = T / Tc;
+        fout << t << ',' << m / sampleCount << ',' << energy / sampleCount << ',' << lookBack / sampleCount << '\n';
+        std::cout << t << std::endl;
+    }
+
+    fout.close();
+}
+
+
+
+/* ポピュレーション・アニーリングによってイジングモデルのスピン配位をシミュレートする．
+ * β を等間隔に上げながら冷やし，各温度でのエネルギー・比熱・磁化・自由エネルギーを求める．
+ */
+void magnetizationOfSpinConfigurationPopulationAnnealing()
+{
+    IsingModel ising;
+    const double Tc = ising.Tc();
+    static constexpr size_t population = 2000;
+    static constexpr size_t stepCount = 300;
+
+    std::vector<double> temperatures;
+    for(size_t i = 1; i <= stepCount; ++i)
+        temperatures.push_back(Tc / (i * (1.0 / stepCount)));
+
+    PopulationAnnealing<33, 33> annealing(ising.param, population, 10);
+    const auto results = annealing.run(temperatures);
+
+    std::ofstream fout;
+    fout.open("isingspinconfig_pa_" + std::to_string(population) + ".csv");
+
+    for(const auto& result : results)
+    {
+        fout << result.T / Tc << ',' << result.magnetization << ',' << result.energy << ','
+             << result.specificHeat << ',' << result.freeEnergy << ','
+             << result.population << ',' << result.familyCount << '\n';
+    }
+
+    fout.close();
+}
+
+
+
+/* 自己学習モンテカルロ法によってイジングモデルのスピン配位をシミュレートする．
+ * 各温度で熱浴法の配位から有効ハミルトニアンを学習し，クラスター更新に切り替える．
+ * 熱浴法 (1走査ごと) と自己学習モンテカルロ法 (1クラスターごと) の |m| の積分自己相関時間を比べる．
+ */
+void magnetizationOfSpinConfigurationSelfLearning()
+{
+    using StateType = State<33, 33, bool>;
+    StateType state;
+
+    IsingModel ising;
+    MonteCarlo::Engine<LatticeType::Square, MonteCarlo::HeatBath, MonteCarlo::RandomScan, MonteCarlo::Xoshiro256> engine(&ising);
+    SelfLearningMonteCarlo<33, 33> slmc(&ising, &ising);
+
+    const double Tc = ising.Tc();
+    static constexpr size_t relaxCount = 500;
+    static constexpr size_t measureCount = 4000;
+    static constexpr size_t trainInterval = 10;
+
+    std::ofstream fout;
+    fout.open("isingspinconfig_slmc.csv");
+
+    for(double T = 1.8 * Tc; T < 3.2 * Tc; T += 0.05)
+    {
+        ising.param.T = T;
+        state.init(true);
+        for(size_t i = 0; i < relaxCount; ++i) engine.sweep(state);
+
+        //熱浴法で学習データを集める
+        std::vector<double> localSeries;
+        slmc.clearSamples();
+        for(size_t i = 0; i < measureCount; ++i)
+        {
+            engine.sweep(state);
+            localSeries.push_back(std::abs(IsingModel::averageSpin(state)));
+            if(i % trainInterval == 0) slmc.addSample(state);
+        }
+        if(!slmc.fit()) continue;
+
+        std::vector<double> slmcSeries;
+        double m = 0.0, energy = 0.0, clusterSize = 0.0;
+        slmc.invalidate();
+        slmc.resetStatistics();
+        for(size_t i = 0; i < measureCount; ++i)
+        {
+            slmc.update(state);
+            slmcSeries.push_back(std::abs(IsingModel::averageSpin(state)));
+            m += slmcSeries.back();
+            energy += ising.energy(state);
+            clusterSize += slmc.lastClusterSize();
+        }
+
+        const double t = T / Tc;
+        fout << t << ',' << m / measureCount << ',' << energy / measureCount << ','
+             << slmc.couplings()[0] << ',' << slmc.couplings()[1] << ',' << slmc.couplings()[2] << ','
+             << slmc.acceptanceRatio() << ',' << clusterSize / measureCount << ','
+             << integratedAutocorrelationTime(localSeries) << ',' << integratedAutocorrelationTime(slmcSeries) << '\n';
+        std::cout << t << std::endl;
+    }
+
+    fout.close();
+}
+
+
+
+/* magnetizationOfSpinConfigurationEngine と同じシミュレーションを，等間隔ではなく
+ * 磁化の変化や誤差が大きい温度に集めて行う．測定の総数は等間隔 (0.005 刻みで 800 点) の半分にする．
+ */
+template<LatticeType Lattice = LatticeType::Square>
+void magnetizationOfSpinConfigurationAdaptive()
+{
+    using StateType = State<21, 21, bool>;
+    StateType state;
+
+    IsingModel ising;
+    MonteCarlo::Engine<Lattice,
+                       MonteCarlo::Metropolis,
+                       MonteCarlo::CheckerboardScan,
+                       MonteCarlo::Xoshiro256> engine(&ising);
+
+    const double Tc = ising.Tc();
+    static constexpr size_t sweepCount = 2500;
+    static constexpr size_t budget = 400;
+
+    AdaptiveTemperatureGrid grid(0.0, 4.0 * Tc, 17, 4, 0.005 * Tc);
+    grid.run([&](const double& T)
+    {
+        state.initRand();
+        ising.param.T = T;
+        for(size_t i = 0; i < sweepCount; ++i) engine.sweep(state);
+
+        std::cout << T / Tc << std::endl;
+        return std::abs(IsingModel::averageSpin(state));
+    }, budget);
+
+    std::ofstream fout;
+    fout.open("isingspinconfig_adaptive_" + std::to_string(budget) + ".csv");
+
+    for(const auto& point : grid.points())
+    {
+        fout << point.T / Tc << ',' << point.stat.mean() << ',' << point.stat.standardError() << ','
+             << point.stat.count() << '\n';
+    }
+
+    fout.close();
+}
+
+
+
+/* magnetizationOfSpinConfigurationEngine と同じシミュレーションを，平衡状態のキャッシュから始める．
+ * キャッシュに無い温度だけ initRand() から緩和させ，自己相関時間と一緒に保存する．
+ * キャッシュから始めた場合は 2τ 回だけ走査して前回と独立な配位にし，その配位でキャッシュを更新する．
+ */
+template<LatticeType Lattice = LatticeType::Square>
+void magnetizationOfSpinConfigurationCached()
+{
+    using StateType = State<21, 21, bool>;
+    StateType state;
+
+    IsingModel ising;
+    MonteCarlo::Engine<Lattice,
+                       MonteCarlo::Metropolis,
+                       MonteCarlo::CheckerboardScan,
+                       MonteCarlo::Xoshiro256> engine(&ising);
+    EquilibriumCache cache("equilibrium_cache");
+
+    double T = 0.0;
+    const double Tc = ising.Tc();
+    static constexpr size_t sweepCount = 2500;
+    static constexpr size_t tauSweepCount = 500;
+
+    std::ofstream fout;
+    fout.open("isingspinconfig_cached.csv");
+
+    while(T < 4.0 * Tc)
+    {
+        ising.param.T = T;
+
+        EquilibriumCache::Key key;
+        key.lattice = Lattice;
+        key.T = T;
+        key.J = ising.param.J;
+        key.engine = "metropolis-checkerboard";
+
+        bool cached = true;
+        const double tau = cache.acquire(key, state, [&](StateType& s)
+        {
+            cached = false;
+            s.initRand();
+            for(size_t i = 0; i < sweepCount; ++i) engine.sweep(s);
+
+            std::vector<double> series;
+            for(size_t i = 0; i < tauSweepCount; ++i)
+            {
+                engine.sweep(s);
+                series.push_back(std::abs(IsingModel::averageSpin(s)));
+            }
+            return integratedAutocorrelationTime(series);
+        });
+
+        if(cached)
+        {
+            const size_t decorrelation = std::max<size_t>(1, static_cast<size_t>(std::ceil(2.0 * tau)));
+            for(size_t i = 0; i < decorrelation; ++i) engine.sweep(state);
+            cache.store(key, state, tau);
+        }
+
+        const double t = T / Tc;
+        fout << t << ',' << IsingModel::averageSpin(state) << ',' << engine.energy(state) << ',' << tau << '\n';
+        std::cout << t << (cached ? " (cached)" : "") << std::endl;
+
+        T += 0.005;
+    }
+
+    fout.close();
+}
+
+
+
+/* FFT で構造因子を測り，各温度の二次モーメントの相関長と，距離ごとに平均した相関関数 G(r) を求める．
+ * 出力は T/Tc，ξ，S(0)，G(0)，G(1)，... G(L/2)．
+ */
+void correlationOfSpinConfiguration()
+{
+    static constexpr size_t L = 64;
+    using StateType = State<L + 1, L + 1, bool>;
+    StateType state;
+
+    IsingModel ising;
+    MonteCarlo::Engine<LatticeType::Square,
+                       MonteCarlo::Metropolis,
+                       MonteCarlo::CheckerboardScan,
+                       MonteCarlo::Xoshiro256> engine(&ising);
+    Correlation::StructureFactor structureFactor(L, L);
+
+    const double Tc = ising.Tc();
+    static constexpr size_t relaxCount = 1000;
+    static constexpr size_t sampleCount = 500;
+    static constexpr size_t interval = 5;
+
+    std::ofstream fout;
+    fout.open("isingspinconfig_correlation.csv");
+
+    state.init(true);
+    for(double T = 1.5 * Tc; T < 4.0 * Tc; T += 0.05)
+    {
+        ising.param.T = T;
+        for(size_t i = 0; i < relaxCount; ++i) engine.sweep(state);
+
+        structureFactor.clear();
+        for(size_t i = 0; i < sampleCount; ++i)
+        {
+            for(size_t j = 0; j < interval; ++j) engine.sweep(state);
+            structureFactor.add(state);
+        }
+
+        const std::vector<double> g = structureFactor.radialCorrelation();
+
+        fout << T / Tc << ',' << structureFactor.correlationLength() << ',' << structureFactor.zeroModeStat().mean();
+        for(size_t r = 0; r <= L / 2; ++r) fout << ',' << g[r];
+        fout << '\n';
+        std::cout << T / Tc << std::endl;
+    }
+
+    fout.close();
+}
+
+
+
+/* 各温度で磁区 (同じ向きのスピンのクラスター) と FK クラスターを数える．
+ * 配位は State から1行ずつ Analyzer に渡すので，格子の複製は作らない．
+ * 出力は T/Tc，磁区・FK クラスターそれぞれの 最大クラスターの割合，平均クラスターサイズ (最大を除く)，パーコレーション確率，
+ * 最後に磁壁の密度 (反平行なボンドの割合)．
+ */
+void clusterOfSpinConfiguration()
+{
+    static constexpr size_t L = 256;
+    using StateType = State<L + 1, L + 1, bool>;
+    StateType state;
+
+    IsingModel ising;
+    MonteCarlo::Engine<LatticeType::Square,
+                       MonteCarlo::Metropolis,
+                       MonteCarlo::CheckerboardScan,
+                       MonteCarlo::Xoshiro256> engine(&ising);
+    ClusterAnalysis::Analyzer<> domains(L);
+    ClusterAnalysis::Analyzer<ClusterAnalysis::FortuinKasteleynBond> clusters(L);
+
+    const double Tc = ising.Tc();
+    static constexpr size_t relaxCount = 1000;
+    static constexpr size_t sampleCount = 200;
+    static constexpr size_t interval = 5;
+
+    std::ofstream fout;
+    fout.open("isingspinconfig_cluster.csv");
+
+    state.init(true);
+    for(double T = 1.5 * Tc; T < 4.0 * Tc; T += 0.05)
+    {
+        ising.param.T = T;
+        clusters.bondRule() = ClusterAnalysis::FortuinKasteleynBond(
+            ClusterAnalysis::FortuinKasteleynBond::probability(ising.param.J, ising.param.kb * T), engine.rng()());
+
+        for(size_t i = 0; i < relaxCount; ++i) engine.sweep(state);
+
+        RunningStat largest[2], meanSize[2], percolation[2], wall;
+        for(size_t i = 0; i < sampleCount; ++i)
+        {
+            for(size_t j = 0; j < interval; ++j) engine.sweep(state);
+            const ClusterAnalysis::Statistics statistics[2] = { domains.analyze(state), clusters.analyze(state) };
+            for(size_t k = 0; k < 2; ++k)
+            {
+                largest[k].push(static_cast<double>(statistics[k].largest) / statistics[k].siteCount);
+                meanSize[k].push(statistics[k].meanClusterSize(true));
+                percolation[k].push((statistics[k].percolates()) ? 1.0 : 0.0);
+            }
+            wall.push(0.5 * statistics[0].domainWallLength / statistics[0].siteCount);
+        }
+
+        fout << T / Tc;
+        for(size_t k = 0; k < 2; ++k) fout << ',' << largest[k].mean() << ',' << meanSize[k].mean() << ',' << percolation[k].mean();
+        fout << ',' << wall.mean() << '\n';
+        std::cout << T / Tc << std::endl;
+    }
+
+    fout.close();
+}
+
+
+
+/* 転移温度の近くで MCRG を行い，粗視化の各段の熱的な指数 y_t と磁気的な指数 y_h を求める
+ * (2次元イジング模型の厳密な値は y_t = 1，y_h = 15/8)．
+ * 出力は T/Tc，段 n，偶の演算子を1，2，4個使った y_t，y_h．
+ */
+void renormalizationOfSpinConfiguration()
+{
+    static constexpr size_t L = 64;
+    static constexpr size_t levelCount = 4;
+    using StateType = State<L + 1, L + 1, bool>;
+    StateType state;
+
+    IsingModel ising;
+    MonteCarlo::Engine<LatticeType::Square,
+                       MonteCarlo::Metropolis,
+                       MonteCarlo::CheckerboardScan,
+                       MonteCarlo::Xoshiro256> engine(&ising);
+    BlockSpin::Renormalization renormalization(levelCount, 2);
+
+    const double Tc = 2 * ising.param.J / (ising.param.kb * std::log(std::sqrt(2) + 1));
+    static constexpr size_t relaxCount = 2000;
+    static constexpr size_t sampleCount = 20000;
+    static constexpr size_t interval = 2;
+
+    std::ofstream fout;
+    fout.open("isingspinconfig_mcrg.csv");
+
+    state.init(true);
+    for(double t = 0.98; t < 1.021; t += 0.01)
+    {
+        ising.param.T = t * Tc;
+        for(size_t i = 0; i < relaxCount; ++i) engine.sweep(state);
+
+        renormalization.clear();
+        for(size_t i = 0; i < sampleCount; ++i)
+        {
+            for(size_t j = 0; j < interval; ++j) engine.sweep(state);
+            renormalization.add(state);
+        }
+
+        for(size_t n = 1; n < levelCount; ++n)
+        {
+            fout << t << ',' << n;
+            for(const size_t evenCount : { 1, 2, 4 }) fout << ',' << renormalization.thermalExponent(n, evenCount);
+            fout << ',' << renormalization.magneticExponent(n) << '\n';
+        }
+        std::cout << t << std::endl;
+    }
+
+    fout.close();
+}
+
+
+
+/* テンソル繰り込み群 (HOTRG) で無限に大きな正方格子の自由エネルギー，内部エネルギー，磁化の温度依存性を求める．
+ * 各温度の縮約は1回だけにし，比熱は隣り合う温度の内部エネルギーの差分から求める．
+ */
+void tensorRenormalizationOfSpinConfiguration()
+{
+    IsingModel ising;
+    HOTRG<LatticeType::Square> trg(&ising, 12);
+
+    const double Tc = 2 * ising.param.J / (ising.param.kb * std::log(std::sqrt(2) + 1));
+
+    std::vector<HOTRG<LatticeType::Square>::Result> results;
+    std::vector<double> errors;
+    for(double t = 0.5; t < 1.501; t += 0.01)
+    {
+        ising.param.T = t * Tc;
+        results.push_back(trg.run(0.0));
+        errors.push_back(trg.truncationError());
+        std::cout << t << std::endl;
+    }
+
+    std::ofstream fout;
+    fout.open("isingspinconfig_hotrg.csv");
+
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        //両端は片側の差分
+        const size_t prev = (i == 0) ? i : i - 1;
+        const size_t next = (i + 1 == results.size()) ? i : i + 1;
+        const double specificHeat = (results[next].energy - results[prev].energy) / (results[next].T - results[prev].T);
+
+        fout << results[i].T / Tc << ',' << results[i].freeEnergy << ',' << results[i].energy << ','
+             << specificHeat << ',' << results[i].magnetization << ',' << errors[i] << '\n';
+    }
+
+    fout.close();
+}
+
+
+
+/* 確率伝搬法 (Bethe 近似) と TAP 方程式で正方格子の磁化と自由エネルギーの温度依存性を求める．
+ * 低温側から温度を上げ，直前の温度の解から反復を始める．
+ */
+void meanFieldOfSpinConfiguration()
+{
+    static constexpr size_t L = 256;
+    static constexpr double siteCount = L * L;
+
+    IsingModel ising;
+    const MeanField::SparseGraph graph = MeanField::SparseGraph::lattice<LatticeType::Square>(L, L, ising.param.J);
+    MeanField::BeliefPropagation bp(&graph, &ising);
+    MeanField::TAP tap(&graph, &ising);
+
+    const double Tc = 2 * ising.param.J / (ising.param.kb * std::log(std::sqrt(2) + 1));
+
+    std::ofstream fout;
+    fout.open("isingspinconfig_meanfield.csv");
+
+    bp.init(1.0);
+    tap.init(1.0);
+    for(double t = 0.5; t < 1.501; t += 0.01)
+    {
+        ising.param.T = t * Tc;
+        const bool bpConverged = bp.solve(1000);
+        const bool tapConverged = tap.solve(1000);
+
+        double bpM = 0.0, tapM = 0.0;
+        for(const auto& m : bp.magnetizations()) bpM += m;
+        for(const auto& m : tap.magnetizations()) tapM += m;
+
+        fout << t << ','
+             << bpM / siteCount << ',' << bp.freeEnergy() / siteCount << ',' << bpConverged << ','
+             << tapM / siteCount << ',' << tap.freeEnergy() / siteCount << ',' << tapConverged << '\n';
+        std::cout << t << std::endl;
+    }
+
+    fout.close();
+}
+
+
+
+/* 絶対零度のランダム磁場イジング模型で外場を往復させ，乱れの強さ R ごとのヒステリシスループと
+ * 雪崩の大きさの分布 (上りの枝) を求める．
+ */
+void avalancheOfRandomFieldIsing()
+{
+    static constexpr size_t L = 1024;
+    static constexpr size_t binCount = 24;
+
+    std::ofstream loop, sizes;
+    loop.open("isingspinconfig_rfim_loop.csv");
+    sizes.open("isingspinconfig_rfim_avalanche.csv");
+
+    RandomFieldAvalanche<LatticeType::Square> rfim(L, L, 1.0);
+
+    for(const double R : { 0.7, 0.9, 1.2 })
+    {
+        rfim.setDisorder(R, 1);
+
+        //大きさ [2^k, 2^(k+1)) の雪崩の数 (上りの枝)
+        std::vector<size_t> histogram(binCount, 0);
+
+        for(const bool ascending : { true, false })
+        {
+            double lastM = -2.0;
+            rfim.branch(ascending, [&](const RandomFieldAvalanche<LatticeType::Square>::Avalanche& avalanche)
+            {
+                if(ascending)
+                {
+                    size_t k = 0;
+                    while(k + 1 < binCount && (size_t(2) << k) <= avalanche.size) ++k;
+                    histogram[k]++;
+                }
+
+                //ヒステリシスループは磁化が 1e-3 以上変わったところだけ書く
+                if(std::abs(avalanche.magnetization - lastM) >= 1e-3)
+                {
+                    loop << R << ',' << ascending << ',' << avalanche.field << ',' << avalanche.magnetization << '\n';
+                    lastM = avalanche.magnetization;
+                }
+            });
+        }
+
+        for(size_t k = 0; k < binCount; ++k)
+            sizes << R << ',' << (size_t(1) << k) << ',' << histogram[k] << '\n';
+        std::cout << R << std::endl;
+    }
+
+    loop.close();
+    sizes.close();
+}
+
+
+
+/* 外場をかけたメトロポリス法で外場を -maxField と maxField の間で往復させ，
+ * 低温での磁化とエネルギーのヒステリシスを求める．
+ */
+void hysteresisOfSpinConfiguration()
+{
+    static constexpr size_t L = 64;
+    using StateType = State<L + 1, L + 1, bool>;
+    StateType state;
+
+    IsingModel ising;
+    MonteCarlo::Engine<LatticeType::Square,
+                       MonteCarlo::Metropolis,
+                       MonteCarlo::CheckerboardScan,
+                       MonteCarlo::Xoshiro256,
+                       MonteCarlo::ExternalField> engine(&ising);
+
+    const double Tc = 2 * ising.param.J / (ising.param.kb * std::log(std::sqrt(2) + 1));
+    static constexpr size_t sweepCount = 20;
+    static constexpr double maxField = 2.0;
+    static constexpr double fieldStep = 0.02;
+
+    const auto magnetization = [&]()
+    {
+        long long sum = 0;
+        for(size_t r = 0; r < L; ++r)
+            for(size_t c = 0; c < L; ++c)
+                sum += (state.at(r, c)) ? 1 : -1;
+        return static_cast<double>(sum) / (L * L);
+    };
+
+    std::ofstream fout;
+    fout.open("isingspinconfig_hysteresis.csv");
+
+    for(const double t : { 0.6, 0.8, 0.9 })
+    {
+        ising.param.T = t * Tc;
+        state.init(false);
+
+        //-maxField → maxField → -maxField と外場を往復させる
+        const size_t stepCount = static_cast<size_t>(2.0 * maxField / fieldStep + 0.5);
+        for(size_t i = 0; i <= 2 * stepCount; ++i)
+        {
+            const size_t k = (i <= stepCount) ? i : 2 * stepCount - i;
+            ising.param.h = -maxField + k * fieldStep;
+            for(size_t s = 0; s < sweepCount; ++s) engine.sweep(state);
+
+            fout << t << ',' << ising.param.h << ',' << magnetization() << ',' << engine.energy(state) / (L * L) << '\n';
+        }
+        std::cout << t << std::endl;
+    }
+
+    fout.close();
+}
+
+
+
+/* 2次元 Heisenberg 模型の熱浴法 + 過緩和と Wolff 法のエネルギーと磁化．
+ * 列は T，更新法 (0: 熱浴法 + 過緩和，1: Wolff)，<e>，<|m|>，<m^2>．
+ */
+void vectorSpinOfSpinConfiguration()
+{
+    static constexpr size_t L = 64;
+    static constexpr size_t thermalizeCount = 1000;
+    static constexpr size_t sampleCount = 5000;
+    static constexpr size_t overRelaxationCount = 4;
+    static constexpr double siteCount = L * L;
+
+    IsingModel ising;
+    VectorSpin::Lattice<3> lattice(L);
+    VectorSpin::Heisenberg engine(&ising);
+
+    std::ofstream fout;
+    fout.open("isingspinconfig_heisenberg.csv");
+
+    for(const double t : { 0.3, 0.5, 0.7, 1.0, 1.5, 2.0 })
+    {
+        ising.param.T = t;
+
+        for(const int method : { 0, 1 })
+        {
+            const auto update = [&]()
+            {
+                if(method == 0)
+                {
+                    engine.heatBathSweep(lattice);
+                    for(size_t k = 0; k < overRelaxationCount; ++k) engine.overRelaxationSweep(lattice);
+                }
+                else
+                {
+                    //1回に siteCount 個程度のスピンを更新する
+                    size_t updated = 0;
+                    while(updated < siteCount) updated += engine.wolffUpdate(lattice);
+                }
+            };
+
+            lattice.initRand(engine.rng());
+            for(size_t i = 0; i < thermalizeCount; ++i) update();
+
+            RunningStat energy, absMagnetization, squareMagnetization;
+            for(size_t i = 0; i < sampleCount; ++i)
+            {
+                update();
+
+                double m[3];
+                VectorSpin::Heisenberg::magnetization(lattice, m);
+                const double m2 = m[0] * m[0] + m[1] * m[1] + m[2] * m[2];
+                energy.push(engine.energy(lattice) / siteCount);
+                absMagnetization.push(std::sqrt(m2));
+                squareMagnetization.push(m2);
+            }
+
+            fout << t << ',' << method << ',' << energy.mean() << ',' << absMagnetization.mean() << ',' << squareMagnetization.mean() << '\n';
+        }
+        std::cout << t << std::endl;
+    }
+
+    fout.close();
+}
+
+
+
+/* 正方格子の q 状態 Potts 模型の Tc 付近の温度ごとの熱浴法と Swendsen-Wang 法の結果．
+ * 列は q，T / Tc，更新法 (0: 熱浴法，1: Swendsen-Wang 法)，<e>，<m>，比熱 N (<e^2> - <e>^2) / T^2．
+ */
+void pottsOfSpinConfiguration()
+{
+    static constexpr size_t L = 128;
+    static constexpr size_t thermalizeCount = 2000;
+    static constexpr size_t sampleCount = 10000;
+    static constexpr double siteCount = L * L;
+
+    Potts::Lattice lattice(L);
+
+    std::ofstream fout;
+    fout.open("isingspinconfig_potts.csv");
+
+    for(const int q : { 3, 5, 8 })
+    {
+        PottsModel potts;
+        potts.param.q = q;
+        Potts::Engine engine(&potts);
+        const double Tc = potts.Tc();
+
+        for(const double t : { 0.96, 0.98, 0.99, 1.0, 1.01, 1.02, 1.04 })
+        {
+            potts.param.T = t * Tc;
+
+            for(const int method : { 0, 1 })
+            {
+                const auto update = [&]()
+                {
+                    if(method == 0) engine.heatBathSweep(lattice);
+                    else engine.swendsenWang(lattice);
+                };
+
+                lattice.initRand(engine.rng(), q);
+                for(size_t i = 0; i < thermalizeCount; ++i) update();
+
+                RunningStat energy, order;
+                for(size_t i = 0; i < sampleCount; ++i)
+                {
+                    update();
+                    energy.push(engine.energy(lattice) / siteCount);
+                    order.push(engine.orderParameter(lattice));
+                }
+
+                const double specificHeat = siteCount * energy.variance() / (potts.param.T * potts.param.T);
+                fout << q << ',' << t << ',' << method << ',' << energy.mean() << ',' << order.mean() << ',' << specificHeat << '\n';
+            }
+            std::cout << q << ' ' << t << std::endl;
+        }
+    }
+
+    fout.close();
+}
+
+
+
+/* べき乗の長距離相互作用 J(r) = 1 / r^(2+σ) のイジング模型 (最近接の項なし) の温度ごとの結果．
+ * 温度は平均場の転移温度 Σ_r J(r) / kb を単位にする．
+ * 列は σ，T / T_MF，<e>，<|m|>，Binder 比 U = 1 - <m^4> / (3 <m^2>^2)．
+ */
+void longRangeOfSpinConfiguration()
+{
+    static constexpr size_t L = 128;
+    static constexpr size_t thermalizeCount = 500;
+    static constexpr size_t sampleCount = 2000;
+    static constexpr double siteCount = L * L;
+
+    IsingModel ising;
+    ising.param.J = 0;
+    LongRange::Engine engine(&ising, L);
+
+    std::ofstream fout;
+    fout.open("isingspinconfig_longrange.csv");
+
+    for(const double sigma : { 0.5, 1.0, 1.5 })
+    {
+        engine.setInteraction(1.0, 2.0 + sigma);
+
+        double meanFieldTc = 0.0;
+        for(size_t r = 0; r < L; ++r)
+            for(size_t c = 0; c < L; ++c)
+                meanFieldTc += engine.coupling(r, c);
+        meanFieldTc /= ising.param.kb;
+
+        for(const double t : { 0.5, 0.6, 0.7, 0.8, 0.9, 1.0 })
+        {
+            ising.param.T = t * meanFieldTc;
+            engine.initRand();
+            for(size_t i = 0; i < thermalizeCount; ++i) engine.sweep();
+
+            RunningStat energy, absMagnetization, m2, m4;
+            for(size_t i = 0; i < sampleCount; ++i)
+            {
+                engine.sweep();
+                const double m = engine.magnetization();
+                energy.push(engine.energy() / siteCount);
+                absMagnetization.push(std::abs(m));
+                m2.push(m * m);
+                m4.push(m * m * m * m);
+            }
+
+            const double binder = 1.0 - m4.mean() / (3.0 * m2.mean() * m2.mean());
+            fout << sigma << ',' << t << ',' << energy.mean() << ',' << absMagnetization.mean() << ',' << binder << '\n';
+            std::cout << sigma << ' ' << t << std::endl;
+        }
+    }
+
+    fout.close();
+}
+
+
+
+/* 磁化を保存する Kawasaki ダイナミクスの粗視化 (m = 0 のランダムな配位から T < Tc へ急冷)．
+ * 時刻は対数の等間隔．列は T / Tc，時刻 (MCS)，e，ドメインの大きさ 2N / M (M は向きの違うボンドの数)．
+ * 成長則 L(t) ∝ t^(1/3) (Lifshitz-Slyozov) を見る．
+ */
+void kawasakiOfSpinConfiguration()
+{
+    static constexpr size_t L = 256;
+    static constexpr double maxTime = 1e5;
+    static constexpr size_t pointsPerDecade = 10;
+
+    IsingModel ising;
+    KawasakiDynamics kawasaki(&ising, L, L);
+
+    const double Tc = 2 * ising.param.J / (ising.param.kb * std::log(std::sqrt(2) + 1));
+
+    std::ofstream fout;
+    fout.open("isingspinconfig_kawasaki.csv");
+
+    for(const double t : { 0.4, 0.6 })
+    {
+        ising.param.T = t * Tc;
+        kawasaki.init(0.0);
+
+        for(size_t i = 0;; ++i)
+        {
+            const double next = std::pow(10.0, static_cast<double>(i) / pointsPerDecade);
+            if(next > maxTime) break;
+
+            kawasaki.advance(next - kawasaki.time());
+            fout << t << ',' << kawasaki.time() << ',' << kawasaki.energy() / (L * L) << ',' << kawasaki.domainSize() << '\n';
+        }
+        std::cout << t << std::endl;
+    }
+
+    fout.close();
+}
+
+
+
+/* 一辺 L の格子の各温度のジョブを scheduler に加える．
+ * 見積もりでは短い走査から1走査の時間と |m| の自己相関時間 τ を測り，
+ * 本番の走査の回数を独立なサンプルが independentCount 個になるように決める (計算量は L^2 × τ に比例)．
+ * 結果の列は <|m|>，<m^2>，<m^4>，<e>，Binder 比 U = 1 - <m^4> / (3 <m^2>^2)，τ，走査の回数．
+ */
+template<LatticeType Lattice, size_t L>
+void addFiniteSizeScalingJobs(CampaignScheduler& scheduler, const std::vector<double>& temperatures)
+{
+    using StateType = State<L + 1, L + 1, bool>;
+    using EngineType = MonteCarlo::Engine<Lattice, MonteCarlo::Metropolis, MonteCarlo::CheckerboardScan, MonteCarlo::Xoshiro256>;
+
+    static constexpr size_t calibrationCount = 200;
+    static constexpr size_t independentCount = 200;
+    static constexpr size_t minSweepCount = 1000;
+    static constexpr double siteCount = L * L;
+
+    //格子の (L × L) 個のスピンの平均
+    const auto averageSpin = [](const StateType& state)
+    {
+        long long sum = 0;
+        for(size_t r = 0; r < L; ++r)
+            for(size_t c = 0; c < L; ++c)
+                sum += (state.at(r, c)) ? 1 : -1;
+        return sum / siteCount;
+    };
+
+    for(const auto& T : temperatures)
+    {
+        std::ostringstream key;
+        key << static_cast<int>(Lattice) << ' ' << L << ' ' << T;
+
+        auto sweepCount = std::make_shared<size_t>(minSweepCount);
+        auto tau = std::make_shared<double>(0.5);
+
+        scheduler.add(key.str(), [=]()
+        {
+            IsingModel ising;
+            ising.param.T = T;
+            EngineType engine(&ising);
+            StateType state;
+            state.init(true);
+
+            std::vector<double> series;
+            const auto start = std::chrono::steady_clock::now();
+            for(size_t i = 0; i < calibrationCount; ++i)
+            {
+                engine.sweep(state);
+                series.push_back(std::abs(averageSpin(state)));
+            }
+            const double secondsPerSweep = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / calibrationCount;
+
+            *tau = integratedAutocorrelationTime(series);
+            *sweepCount = std::max(minSweepCount, static_cast<size_t>(2.0 * *tau * independentCount));
+            return secondsPerSweep * (*sweepCount + *sweepCount / 5);
+        },
+        [=]()
+        {
+            IsingModel ising;
+            ising.param.T = T;
+            EngineType engine(&ising);
+            StateType state;
+            state.init(true);
+
+            for(size_t i = 0; i < *sweepCount / 5; ++i) engine.sweep(state);
+
+            RunningStat m, m2, m4, e;
+            for(size_t i = 0; i < *sweepCount; ++i)
+            {
+                engine.sweep(state);
+                const double spin = averageSpin(state);
+                m.push(std::abs(spin));
+                m2.push(spin * spin);
+                m4.push(spin * spin * spin * spin);
+                e.push(engine.energy(state) / siteCount);
+            }
+
+            const double binder = 1.0 - m4.mean() / (3.0 * m2.mean() * m2.mean());
+            return std::vector<double>{ m.mean(), m2.mean(), m4.mean(), e.mean(), binder, *tau, static_cast<double>(*sweepCount) };
+        });
+    }
+}
+
+/* 格子の大きさと温度を変えたジョブをまとめて流し，有限サイズスケーリング用の結果を1つのファイルに集める．
+ * 途中で止めても，もう一度呼べば終わっていないジョブから再開する．
+ */
+void finiteSizeScalingCampaign()
+{
+    CampaignScheduler scheduler("isingspinconfig_fss.csv");
+
+    std::vector<double> temperatures;
+    for(double T = 2.0; T < 2.6; T += 0.02) temperatures.push_back(T);
+
+    addFiniteSizeScalingJobs<LatticeType::Square, 8>(scheduler, temperatures);
+    addFiniteSizeScalingJobs<LatticeType::Square, 16>(scheduler, temperatures);
+    addFiniteSizeScalingJobs<LatticeType::Square, 32>(scheduler, temperatures);
+    addFiniteSizeScalingJobs<LatticeType::Square, 64>(scheduler, temperatures);
+
+    scheduler.run();
+
+    std::cout << "work:" << scheduler.workSeconds() << "s\t" << "wall:" << scheduler.wallSeconds() << "s" << std::endl;
+}
+
 #endif // ISINGSPINCONFIG_H
@@ -0,0 +1,292 @@
+#ifndef KAWASAKI_H
+#define KAWASAKI_H
+
+#include "mathutil.h"
+#include "isingmodel.h"
+#include "montecarlo.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+
+/* 磁化を保存する Kawasaki ダイナミクス (隣り合うスピンの交換)．正方格子 rows×cols の周期境界．
+ *
+ * 交換して配位が変わるのは向きの違うボンドだけなので，そのボンドの一覧を持って反転のたびに近くだけ直す．
+ * 素朴な方法 (ランダムなボンドを選び，向きが同じなら何もしない) と同じダイナミクスを，むだな試行を飛ばして進める．
+ *
+ *   step:           一覧から一様にボンドを選んで Metropolis 法で交換する．その前のむだな試行の回数は
+ *                   成功確率 M / B の幾何分布で引いて時間に足す (M は向きの違うボンドの数，B = 2N)．
+ *   continuousStep: 棄却なしの連続時間 (BKL 法，n-fold way)．交換の ΔE はボンドの両端の
+ *                   同じ向きの近傍の数の和 n = 0, ..., 6 だけで決まる (ΔE = 4J (n - 3)) ので，
+ *                   ボンドを n ごとの一覧に分け，重み count_n min(1, exp(-βΔE_n)) で n を選んで必ず交換する．
+ *
+ * 時間の単位は N 回の試行 (1 MCS)．低温ではほとんどのボンドが同じ向きなので，素朴な方法よりずっと速い．
+ *
+ *   KawasakiDynamics kawasaki(&ising, 256, 256);
+ *   kawasaki.init(0.0);
+ *   kawasaki.advance(100.0);   //100 MCS
+ */
+class KawasakiDynamics
+{
+public:
+    static constexpr int classCount = 7;
+
+    KawasakiDynamics(IsingModel *ising,
+                     const size_t& rows,
+                     const size_t& cols,
+                     const uint64_t& seed = 0x9e3779b97f4a7c15ULL)
+        : ising(ising)
+        , rows(rows)
+        , cols(cols)
+        , siteCount(rows * cols)
+        , bondCount(2 * rows * cols)
+        , _rng(seed)
+        , spins(rows * cols, 0)
+        , classes(2 * rows * cols, aligned)
+        , where(2 * rows * cols, 0)
+    {
+        init(0.0);
+    }
+
+    /* 磁化が magnetization に最も近くなる数の上向きスピンをランダムに置き，時間を 0 に戻す */
+    void init(const double& magnetization)
+    {
+        const double fraction = std::min(1.0, std::max(0.0, 0.5 * (1.0 + magnetization)));
+        const size_t upCount = static_cast<size_t>(std::lround(fraction * siteCount));
+
+        std::fill(spins.begin(), spins.end(), 0);
+        std::fill(spins.begin(), spins.begin() + upCount, 1);
+        std::shuffle(spins.begin(), spins.end(), _rng);
+
+        rebuild();
+        _time = 0.0;
+    }
+
+    /* サイト (r, c) のスピンを設定する (一覧は rebuild で作り直す) */
+    void set(const size_t& r, const size_t& c, const bool& up) noexcept { spins[r * cols + c] = (up) ? 1 : 0; }
+
+    /* 向きの違うボンドの一覧をスピンから作り直す */
+    void rebuild()
+    {
+        for(auto& list : lists) list.clear();
+        std::fill(classes.begin(), classes.end(), aligned);
+        for(uint32_t b = 0; b < bondCount; ++b) refresh(b);
+    }
+
+    /* 素朴な方法の試行を (むだな試行を飛ばして) 1回の交換の候補まで進め，Metropolis 法で判定する．交換したら true．
+     * 候補の時刻が limit を越えるなら時間を limit にして何もしない (待ち時間は無記憶なので捨ててよい)．
+     */
+    bool step(const double& limit = std::numeric_limits<double>::infinity())
+    {
+        const size_t M = antiAlignedCount();
+        if(M == 0) return stop(limit);
+        prepareRates();
+
+        //向きの違うボンドを引くまでの試行の回数 (成功を含む)
+        const double p = static_cast<double>(M) / bondCount;
+        const double attempts = (p >= 1.0) ? 1.0 : 1.0 + std::floor(std::log(1.0 - uniform01()) / std::log1p(-p));
+        if(_time + attempts / siteCount > limit) return stop(limit);
+        _time += attempts / siteCount;
+
+        //一覧をつないだ並びの中の一様な位置
+        size_t k = static_cast<size_t>(uniform01() * M);
+        int n = 0;
+        while(k >= lists[n].size())
+        {
+            k -= lists[n].size();
+            n++;
+        }
+
+        if(uniform01() >= rates[n]) return false;
+        exchange(lists[n][k]);
+        return true;
+    }
+
+    /* 棄却なしの連続時間の1回の交換．時間は指数分布の待ち時間だけ進む．
+     * 交換できるボンドがないか，交換の時刻が limit を越えるなら時間を limit にして false を返す．
+     */
+    bool continuousStep(const double& limit = std::numeric_limits<double>::infinity())
+    {
+        prepareRates();
+
+        double weights[classCount];
+        double total = 0.0;
+        for(int n = 0; n < classCount; ++n)
+        {
+            weights[n] = lists[n].size() * rates[n];
+            total += weights[n];
+        }
+        if(total <= 0.0) return stop(limit);
+
+        //1試行あたりの交換の確率は total / B
+        const double wait = -std::log(1.0 - uniform01()) * bondCount / (total * siteCount);
+        if(_time + wait > limit) return stop(limit);
+        _time += wait;
+
+        int n = 0;
+        for(double x = uniform01() * total; n + 1 < classCount; ++n)
+        {
+            if(weights[n] > 0.0 && x < weights[n]) break;
+            x -= weights[n];
+        }
+        while(weights[n] <= 0.0) n--;  //丸め誤差で重み 0 の n まで進んだとき
+
+        const size_t k = static_cast<size_t>(uniform01() * lists[n].size());
+        exchange(lists[n][k]);
+        return true;
+    }
+
+    /* 時間をちょうど duration (MCS) 進める．rejectionFree なら continuousStep，そうでなければ step を使う．
+     * 終わりの配位はその時刻の配位 (終わりを越える交換はしない) なので，一定の時間おきの測定に偏りがない．
+     */
+    void advance(const double& duration, const bool& rejectionFree = true)
+    {
+        const double end = _time + duration;
+        while(_time < end)
+        {
+            if(rejectionFree) continuousStep(end);
+            else step(end);
+        }
+    }
+
+    double time() const noexcept { return _time; }
+
+    size_t antiAlignedCount() const noexcept
+    {
+        size_t M = 0;
+        for(const auto& list : lists) M += list.size();
+        return M;
+    }
+
+    /* E = - J (B - 2M) */
+    double energy() const noexcept
+    {
+        return - ising->param.J * (static_cast<double>(bondCount) - 2.0 * antiAlignedCount());
+    }
+
+    double magnetization() const noexcept
+    {
+        size_t up = 0;
+        for(const auto& s : spins) up += s;
+        return (2.0 * up - siteCount) / siteCount;
+    }
+
+    /* 向きの違うボンドの密度から見積もったドメインの大きさ 2N / M (界面の長さあたりの面積) */
+    double domainSize() const noexcept
+    {
+        const size_t M = antiAlignedCount();
+        return (M == 0) ? std::numeric_limits<double>::infinity() : 2.0 * siteCount / M;
+    }
+
+    bool spin(const size_t& r, const size_t& c) const noexcept { return spins[r * cols + c] != 0; }
+
+    void setSeed(const uint64_t& seed) { _rng.seed(seed); }
+
+private:
+    static constexpr uint8_t aligned = 0xFF;
+
+    /* 交換せずに時間を limit まで進める (limit が無限なら進めない) */
+    bool stop(const double& limit) noexcept
+    {
+        if(limit < std::numeric_limits<double>::infinity()) _time = std::max(_time, limit);
+        return false;
+    }
+
+    size_t right(const size_t& i) const noexcept { return (i % cols + 1 == cols) ? i + 1 - cols : i + 1; }
+    size_t left(const size_t& i) const noexcept { return (i % cols == 0) ? i + cols - 1 : i - 1; }
+    size_t down(const size_t& i) const noexcept { return (i + cols >= siteCount) ? i + cols - siteCount : i + cols; }
+    size_t up(const size_t& i) const noexcept { return (i < cols) ? i + siteCount - cols : i - cols; }
+
+    /* ボンド b = 2i + d の両端 (d = 0 は右，1 は下) */
+    size_t head(const uint32_t& b) const noexcept { return b / 2; }
+    size_t tail(const uint32_t& b) const noexcept { return (b & 1) ? down(b / 2) : right(b / 2); }
+
+    /* サイト i と同じ向きの近傍の数 */
+    int alignedNeighbors(const size_t& i) const noexcept
+    {
+        const uint8_t s = spins[i];
+        return (spins[right(i)] == s) + (spins[left(i)] == s) + (spins[down(i)] == s) + (spins[up(i)] == s);
+    }
+
+    /* ボンド b の一覧の所属をスピンに合わせる (何度呼んでもよい) */
+    void refresh(const uint32_t& b)
+    {
+        const size_t i = head(b), j = tail(b);
+        const uint8_t next = (spins[i] == spins[j]) ? aligned : static_cast<uint8_t>(alignedNeighbors(i) + alignedNeighbors(j));
+        const uint8_t prev = classes[b];
+        if(next == prev) return;
+
+        if(prev != aligned)
+        {
+            //末尾と入れ替えて取り除く
+            auto& list = lists[prev];
+            const uint32_t last = list.back();
+            list[where[b]] = last;
+            where[last] = where[b];
+            list.pop_back();
+        }
+        if(next != aligned)
+        {
+            where[b] = static_cast<uint32_t>(lists[next].size());
+            lists[next].push_back(b);
+        }
+        classes[b] = next;
+    }
+
+    /* サイト i に接する4本のボンド */
+    void refreshSite(const size_t& i)
+    {
+        refresh(static_cast<uint32_t>(2 * i));
+        refresh(static_cast<uint32_t>(2 * i + 1));
+        refresh(static_cast<uint32_t>(2 * left(i)));
+        refresh(static_cast<uint32_t>(2 * up(i) + 1));
+    }
+
+    /* ボンド b の両端を交換し，両端とその近傍に接するボンドの所属を直す */
+    void exchange(const uint32_t& b)
+    {
+        const size_t i = head(b), j = tail(b);
+        std::swap(spins[i], spins[j]);
+
+        for(const size_t k : { i, j })
+        {
+            refreshSite(k);
+            refreshSite(right(k));
+            refreshSite(left(k));
+            refreshSite(down(k));
+            refreshSite(up(k));
+        }
+    }
+
+    /* n ごとの受理確率 min(1, exp(-β 4J (n - 3))) を温度と J が変わったときだけ作る */
+    void prepareRates()
+    {
+        const double K = ising->param.J / ising->kbT();
+        if(K == ratesK) return;
+
+        for(int n = 0; n < classCount; ++n) rates[n] = std::min(1.0, std::exp(-4.0 * K * (n - 3)));
+        ratesK = K;
+    }
+
+    double uniform01() noexcept { return static_cast<double>(_rng() >> 11) * (1.0 / 9007199254740992.0); }
+
+    IsingModel *ising; //this has no ownership
+    size_t rows;
+    size_t cols;
+    size_t siteCount;
+    size_t bondCount;
+    MonteCarlo::Xoshiro256 _rng;
+
+    std::vector<uint8_t> spins;              //上向きなら1
+    std::vector<uint32_t> lists[classCount]; //向きの違うボンドを n ごとに
+    std::vector<uint8_t> classes;            //ボンドの n (同じ向きなら aligned)
+    std::vector<uint32_t> where;             //ボンドの lists[n] の中の位置
+
+    double rates[classCount] = {};
+    double ratesK = std::numeric_limits<double>::quiet_NaN();
+    double _time = 0.0;
+};
+
+#endif // KAWASAKI_H
@@ -0,0 +1,322 @@
+#ifndef LONGRANGE_H
+#define LONGRANGE_H
+
+#include "mathutil.h"
+#include "isingmodel.h"
+#include "correlation.h"
+#include "montecarlo.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+
+/* 長距離相互作用のイジング模型 H = - J Σ_(ij) s_i s_j - A Σ_(i<j) s_i s_j / r_ij^p - h Σ_i s_i のモンテカルロ法．
+ * A > 0，p = 2 + σ ならべき乗の強磁性，A < 0，p = 3 なら面に垂直な双極子 (最近接の交換相互作用 J と競合する)．
+ *
+ * 1回のスピン反転の ΔE は全サイトの和 (O(N)) になるので，局所場 f_i = Σ_j C(i - j) s_j を配列で持つ．
+ * C は周期 L×L の格子の結合 (最近接の J と長距離の項のすべての像の和)．
+ * 反転を受け入れるたびに全サイトの f を直すと O(N) かかるので，前回の再計算からの反転を pending に溜めて
+ * f_i + Σ_pending ΔC を使い，pending が batchSize 個になったら f = C * s を FFT の畳み込み (O(N log N)) で作り直す．
+ * 作り直すのは差分でなくスピンからなので，誤差は溜まらない．
+ *
+ * 像の和 Σ_n 1 / |x + n L|^p は p ≤ 4 ではゆっくりしか収束しないので，Ewald 法で実空間の速く減衰する部分と
+ * 逆格子空間の部分に分けて求める (不完全ガンマ関数による分割)．
+ *
+ *   LongRange::Engine engine(&ising, 256);
+ *   engine.setInteraction(1.0, 3.0);
+ *   engine.sweep();
+ */
+namespace LongRange
+{
+
+namespace detail
+{
+
+/* 上側不完全ガンマ関数 Γ(a, x) (x > 0)．a > 0 かつ x < a + 1 では Γ(a) - γ(a, x) を級数で，
+ * それ以外 (a ≤ 0 を含む) は Legendre の連分数を修正 Lentz 法で求める．
+ */
+inline double upperGamma(const double& a, const double& x)
+{
+    static constexpr double tiny = 1e-300;
+    static constexpr double epsilon = 1e-15;
+
+    if(a > 0.0 && x < a + 1.0)
+    {
+        double term = 1.0 / a, sum = term;
+        for(int n = 1; n < 1000; ++n)
+        {
+            term *= x / (a + n);
+            sum += term;
+            if(std::abs(term) < std::abs(sum) * epsilon) break;
+        }
+        return std::tgamma(a) - sum * std::exp(-x + a * std::log(x));
+    }
+
+    double b = x + 1.0 - a;
+    double c = 1.0 / tiny;
+    double d = 1.0 / b;
+    double h = d;
+    for(int i = 1; i < 1000; ++i)
+    {
+        const double an = -i * (i - a);
+        b += 2.0;
+        d = an * d + b;
+        if(std::abs(d) < tiny) d = tiny;
+        c = b + an / c;
+        if(std::abs(c) < tiny) c = tiny;
+        d = 1.0 / d;
+
+        const double delta = d * c;
+        h *= delta;
+        if(std::abs(delta - 1.0) < epsilon) break;
+    }
+    return std::exp(-x + a * std::log(x)) * h;
+}
+
+} //namespace detail
+
+
+/* 周期 L×L の正方格子の像の和 K(x) = Σ_n 1 / |x + n L|^p (L×L の配列，行優先) を Ewald 法で求める．
+ * 1 / r^p = Γ(p/2, α^2 r^2) / (Γ(p/2) r^p) + γ(p/2, α^2 r^2) / (Γ(p/2) r^p) と分け，前者は実空間で，
+ * 後者はフーリエ変換 (π / Γ(p/2)) (G / 2)^(p-2) Γ(1 - p/2, G^2 / 4α^2) を逆格子ベクトル G で和をとる．
+ * α = √π / L では両方の和が |n|, |m| ≤ 4 で倍精度まで収束する．
+ * K(0) は 0 にする (自己相互作用は定数)．和が収束しない p ≤ 2 では空の配列を返す．
+ */
+inline std::vector<double> powerLawKernel(const size_t& L, const double& p)
+{
+    static constexpr int imageCount = 4;
+    static constexpr double pi = Correlation::pi;
+
+    if(!(p > 2.0) || L == 0) return std::vector<double>();
+
+    const double alpha = std::sqrt(pi) / L;
+    const double gammaP = std::tgamma(0.5 * p);
+    const double length = static_cast<double>(L);
+
+    //逆格子空間の係数 (G = 0 は γ の r → ∞ の振る舞いから 2π α^(p-2) / ((p - 2) Γ(p/2)))
+    struct Wave
+    {
+        double gx, gy, weight;
+    };
+    std::vector<Wave> waves;
+    const double zeroWeight = 2.0 * pi * std::pow(alpha, p - 2.0) / ((p - 2.0) * gammaP);
+    for(int mx = -imageCount; mx <= imageCount; ++mx)
+        for(int my = -imageCount; my <= imageCount; ++my)
+        {
+            if(mx == 0 && my == 0) continue;
+
+            const double gx = 2.0 * pi * mx / length, gy = 2.0 * pi * my / length;
+            const double g = std::sqrt(gx * gx + gy * gy);
+            const double weight = pi / gammaP * std::pow(0.5 * g, p - 2.0) * detail::upperGamma(1.0 - 0.5 * p, g * g / (4.0 * alpha * alpha));
+            waves.push_back({ gx, gy, weight });
+        }
+
+    const auto value = [&](const size_t& dx, const size_t& dy)
+    {
+        double sum = 0.0;
+        for(int nx = -imageCount; nx <= imageCount; ++nx)
+            for(int ny = -imageCount; ny <= imageCount; ++ny)
+            {
+                const double x = dx + nx * length, y = dy + ny * length;
+                const double r2 = x * x + y * y;
+                if(r2 == 0.0) continue;
+                sum += detail::upperGamma(0.5 * p, alpha * alpha * r2) / (gammaP * std::pow(r2, 0.5 * p));
+            }
+
+        double reciprocal = zeroWeight;
+        for(const auto& wave : waves) reciprocal += wave.weight * std::cos(wave.gx * dx + wave.gy * dy);
+
+        return sum + reciprocal / (length * length);
+    };
+
+    //K は x ↔ -x，y ↔ -y，x ↔ y で対称なので 0 ≤ dy ≤ dx ≤ L/2 だけ計算する
+    std::vector<double> kernel(L * L, 0.0);
+    for(size_t dx = 0; dx <= L / 2; ++dx)
+        for(size_t dy = 0; dy <= dx; ++dy)
+        {
+            if(dx == 0 && dy == 0) continue;
+
+            const double v = value(dx, dy);
+            for(const size_t a : { dx, (L - dx) % L })
+                for(const size_t b : { dy, (L - dy) % L })
+                {
+                    kernel[a * L + b] = v;
+                    kernel[b * L + a] = v;
+                }
+        }
+
+    return kernel;
+}
+
+
+class Engine
+{
+public:
+    /* 最近接の J と外場 h は ising から読む (J は setInteraction を呼んだときの値を使う) */
+    Engine(IsingModel *ising, const size_t& L, const uint64_t& seed = 0x9e3779b97f4a7c15ULL)
+        : ising(ising)
+        , L(L)
+        , N(L * L)
+        , _rng(seed)
+        , fft(L, L)
+        , spins(N, 1.0)
+        , field(N, 0.0)
+        , couplings(N, 0.0)
+        , kernelSpectrum(L * fft.halfCols())
+        , spectrum(L * fft.halfCols())
+    {
+        //再計算 O(N log N) と1回の判定の pending の和 O(batchSize) の釣り合うところ
+        batchSize = std::max<size_t>(64, static_cast<size_t>(std::sqrt(N * std::log2(static_cast<double>(N) + 1.0))));
+        setInteraction(0.0, 3.0);
+    }
+
+    /* 長距離の結合 amplitude / r^exponent を設定して結合の FFT を作り直す．
+     * amplitude ≠ 0 で exponent ≤ 2 (2次元で和が収束しない) なら false を返し何も変えない．
+     */
+    bool setInteraction(const double& amplitude, const double& exponent)
+    {
+        std::vector<double> kernel;
+        if(amplitude != 0.0)
+        {
+            kernel = powerLawKernel(L, exponent);
+            if(kernel.empty()) return false;
+        }
+
+        for(size_t i = 0; i < N; ++i) couplings[i] = (kernel.empty()) ? 0.0 : amplitude * kernel[i];
+
+        const double J = ising->param.J;
+        couplings[1 % L] += J;
+        couplings[L - 1] += J;
+        couplings[(1 % L) * L] += J;
+        couplings[(L - 1) * L] += J;
+
+        fft.forward(couplings.data(), kernelSpectrum.data());
+        recompute();
+        return true;
+    }
+
+    /* 局所場を FFT で作り直す間隔 (受け入れた反転の数) */
+    void setBatchSize(const size_t& size) { batchSize = std::max<size_t>(1, size); }
+    size_t getBatchSize() const noexcept { return batchSize; }
+
+    void setSeed(const uint64_t& seed) { _rng.seed(seed); }
+    MonteCarlo::Xoshiro256& rng() noexcept { return _rng; }
+
+    void init(const bool& up = true)
+    {
+        std::fill(spins.begin(), spins.end(), (up) ? 1.0 : -1.0);
+        recompute();
+    }
+
+    void initRand()
+    {
+        for(auto& s : spins) s = (_rng() >> 63) ? 1.0 : -1.0;
+        recompute();
+    }
+
+    /* ランダムに選んだサイトの Metropolis 法を N 回行う */
+    void sweep()
+    {
+        const double beta = 1.0 / ising->kbT();
+        const double h = ising->param.h;
+
+        for(size_t n = 0; n < N; ++n)
+        {
+            const size_t i = static_cast<size_t>(((_rng() >> 32) * N) >> 32);
+            const double s = spins[i];
+            const double dE = 2.0 * s * (localField(i) + h);
+
+            if(dE <= 0.0 || uniform01() < std::exp(-beta * dE))
+            {
+                spins[i] = -s;
+                pending.push_back({ static_cast<uint32_t>(i / L), static_cast<uint32_t>(i % L), -2.0 * s });
+                if(pending.size() >= batchSize) recompute();
+            }
+        }
+    }
+
+    /* 局所場 f = C * s を FFT の畳み込みで作り直し，pending を空にする */
+    void recompute()
+    {
+        fft.forward(spins.data(), spectrum.data());
+        for(size_t k = 0; k < spectrum.size(); ++k) spectrum[k] *= kernelSpectrum[k];
+        fft.inverse(spectrum.data(), field.data());
+
+        const double scale = 1.0 / N;
+        for(auto& f : field) f *= scale;
+        pending.clear();
+    }
+
+    /* サイト i の局所場 (外場を除く) */
+    double localField(const size_t& i) const noexcept
+    {
+        const uint32_t r = static_cast<uint32_t>(i / L), c = static_cast<uint32_t>(i % L);
+        const uint32_t size = static_cast<uint32_t>(L);
+
+        double f = field[i];
+        for(const auto& flip : pending)
+        {
+            const uint32_t dr = (r >= flip.r) ? r - flip.r : r + size - flip.r;
+            const uint32_t dc = (c >= flip.c) ? c - flip.c : c + size - flip.c;
+            f += flip.delta * couplings[dr * size + dc];
+        }
+        return f;
+    }
+
+    /* 全エネルギー (-1/2 Σ s_i f_i - h Σ s_i) */
+    double energy()
+    {
+        recompute();
+
+        double pair = 0.0, sum = 0.0;
+        for(size_t i = 0; i < N; ++i)
+        {
+            pair += spins[i] * field[i];
+            sum += spins[i];
+        }
+        return -0.5 * pair - ising->param.h * sum;
+    }
+
+    double magnetization() const noexcept
+    {
+        double sum = 0.0;
+        for(const auto& s : spins) sum += s;
+        return sum / N;
+    }
+
+    bool spin(const size_t& r, const size_t& c) const noexcept { return spins[r * L + c] > 0.0; }
+
+    /* 結合 C(dr, dc) (最近接の J を含む) */
+    double coupling(const size_t& dr, const size_t& dc) const noexcept { return couplings[dr * L + dc]; }
+
+    size_t size() const noexcept { return L; }
+
+private:
+    struct Flip
+    {
+        uint32_t r;
+        uint32_t c;
+        double delta;  //反転による s の変化 (±2)
+    };
+
+    double uniform01() noexcept { return static_cast<double>(_rng() >> 11) * (1.0 / 9007199254740992.0); }
+
+    IsingModel *ising; //this has no ownership
+    size_t L;
+    size_t N;
+    size_t batchSize;
+    MonteCarlo::Xoshiro256 _rng;
+
+    Correlation::RealFFT2D fft;
+    std::vector<double> spins;      //±1
+    std::vector<double> field;      //前回の再計算のときの局所場
+    std::vector<double> couplings;  //C(dr, dc)
+    std::vector<Correlation::complex> kernelSpectrum;
+    std::vector<Correlation::complex> spectrum;
+    std::vector<Flip> pending;      //前回の再計算からの反転
+};
+
+} //namespace LongRange
+
+#endif // LONGRANGE_H
@@ -23,9 +23,44 @@ int main()
 
     //magnetizationOfSpinConfigurationHeatBathFixedSeed();
 
+    //recordSpinConfigurationTrajectory();
+
+    //magnetizationOfSpinConfigurationEngine<LatticeType::Square>();
+
+    //magnetizationOfSpinConfigurationCreutz();
+
+    //magnetizationOfSpinConfigurationCFTP<LatticeType::Square>();
+
+    //magnetizationOfSpinConfigurationPopulationAnnealing();
+
+    //magnetizationOfSpinConfigurationSelfLearning();
+
+    //magnetizationOfSpinConfigurationAdaptive<LatticeType::Square>();
+
+    //magnetizationOfSpinConfigurationCached<LatticeType::Square>();
+
+    //correlationOfSpinConfiguration();
+    //clusterOfSpinConfiguration();
+    //renormalizationOfSpinConfiguration();
+    //tensorRenormalizationOfSpinConfiguration();
+    //meanFieldOfSpinConfiguration();
+    //avalancheOfRandomFieldIsing();
+    //hysteresisOfSpinConfiguration();
+    //vectorSpinOfSpinConfiguration();
+    //pottsOfSpinConfiguration();
+    //longRangeOfSpinConfiguration();
+    //kawasakiOfSpinConfiguration();
+
+    //finiteSizeScalingCampaign();
+
     //createIsingModelDataSet();
+    //createMultiScaleDataSet();
+    //principalComponentOfSpinConfiguration();
+    //rbmSamplerOfSpinConfiguration();
 
     predictMagnetization();
 
+    //predictTransitionTemperature();
+
     return 0;
 }
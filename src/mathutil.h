@@ -1,9 +1,16 @@
 #ifndef MATHUTIL_H
 #define MATHUTIL_H
 
+#include <algorithm>
 #include <iostream>
 #include <random>
 #include <cmath>
+#include <cstdint>
+#include <new>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #ifdef MDEBUGMODE
 #define MDEBUG(statement) do { statement } while(false);
@@ -143,6 +150,477 @@ using StateType =  State<N, M, T>;
 
 
 
+/* 64bitワードの立っているビット数 */
+inline int bitCount(const uint64_t& word) noexcept
+{
+#ifdef _MSC_VER
+    return static_cast<int>(__popcnt64(word));
+#else
+    return __builtin_popcountll(word);
+#endif
+}
+
+/* 64bitワードの最下位の立っているビットの位置 (word != 0) */
+inline int lowestBit(const uint64_t& word) noexcept
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+/* スピン配位を1サイト1bitで詰めて保持するクラス．
+ * 各行は64bitワードの列で，行の末尾の余りビットは常に0とする．
+ */
+template<size_t N, size_t M>
+class BitState
+{
+public:
+    static_assert(N != 0 && M != 0, "invalid size");
+
+    static constexpr size_t wordsPerRow = (M + 63) / 64;
+    static constexpr size_t wordCount = N * wordsPerRow;
+
+    BitState() : _words(wordCount, 0) {}
+    explicit BitState(const State<N, M, bool>& state) : _words(wordCount, 0) { pack(state); }
+
+    bool at(const size_t& row, const size_t& col) const noexcept
+    {
+        return (_words[row * wordsPerRow + col / 64] >> (col % 64)) & 1;
+    }
+
+    void set(const size_t& row, const size_t& col, const bool& value) noexcept
+    {
+        uint64_t& word = _words[row * wordsPerRow + col / 64];
+        const uint64_t mask = uint64_t(1) << (col % 64);
+        word = (value) ? (word | mask) : (word & ~mask);
+    }
+
+    void flip(const size_t& row, const size_t& col) noexcept
+    {
+        _words[row * wordsPerRow + col / 64] ^= uint64_t(1) << (col % 64);
+    }
+
+    uint64_t *row(const size_t& row) noexcept { return _words.data() + row * wordsPerRow; }
+    const uint64_t *row(const size_t& row) const noexcept { return _words.data() + row * wordsPerRow; }
+
+    uint64_t *data() noexcept { return _words.data(); }
+    const uint64_t *data() const noexcept { return _words.data(); }
+
+    /* 行末の有効ビットのマスク */
+    static constexpr uint64_t tailMask() noexcept
+    {
+        return (M % 64 == 0) ? ~uint64_t(0) : ((uint64_t(1) << (M % 64)) - 1);
+    }
+
+    void pack(const State<N, M, bool>& state) noexcept
+    {
+        for(size_t r = 0; r < N; ++r)
+        {
+            uint64_t *w = row(r);
+            for(size_t i = 0; i < wordsPerRow; ++i) w[i] = 0;
+            for(size_t c = 0; c < M; ++c)
+                if(state.at(r, c)) w[c / 64] |= uint64_t(1) << (c % 64);
+        }
+    }
+
+    void unpack(State<N, M, bool>& state) const noexcept
+    {
+        for(size_t r = 0; r < N; ++r)
+            for(size_t c = 0; c < M; ++c)
+                state[r][c] = at(r, c);
+    }
+
+    void init(const bool& value) noexcept
+    {
+        for(size_t r = 0; r < N; ++r)
+        {
+            uint64_t *w = row(r);
+            for(size_t i = 0; i < wordsPerRow; ++i) w[i] = (value) ? ~uint64_t(0) : 0;
+            w[wordsPerRow - 1] &= tailMask();
+        }
+    }
+
+    /* upスピンの数 */
+    size_t upCount() const noexcept
+    {
+        size_t count = 0;
+        for(const auto& w : _words) count += bitCount(w);
+        return count;
+    }
+
+    static constexpr size_t rows() noexcept { return N; }
+    static constexpr size_t cols() noexcept { return M; }
+
+private:
+    std::vector<uint64_t> _words;
+};
+
+
+/* Alignment バイト境界にそろえて確保する std::vector 用のアロケータ (SIMD で読む配列に使う) */
+template<typename T, size_t Alignment = 64>
+struct AlignedAllocator
+{
+    using value_type = T;
+
+    template<typename U>
+    struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+    AlignedAllocator() noexcept = default;
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+    T* allocate(const size_t n)
+    {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+    void deallocate(T *p, const size_t) noexcept
+    {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept { return false; }
+};
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+
+/* 平均と分散を逐次的に求める (Welford 法) */
+class RunningStat
+{
+public:
+    void push(const double& x) noexcept
+    {
+        ++n;
+        const double delta = x - _mean;
+        _mean += delta / n;
+        m2 += delta * (x - _mean);
+    }
+
+    void clear() noexcept { n = 0; _mean = 0.0; m2 = 0.0; }
+
+    size_t count() const noexcept { return n; }
+    double mean() const noexcept { return _mean; }
+    double variance() const noexcept { return (n < 2) ? 0.0 : m2 / (n - 1); }
+    double standardError() const noexcept { return (n < 2) ? 0.0 : std::sqrt(variance() / n); }
+
+    /* 平均の信頼区間の半幅 (z = 1.96 で95%) */
+    double confidence(const double& z = 1.96) const noexcept { return z * standardError(); }
+
+private:
+    size_t n = 0;
+    double _mean = 0.0;
+    double m2 = 0.0;
+};
+
+/* 時系列の積分自己相関時間 τ = 1/2 + Σ ρ(t)．
+ * 和は t >= window × τ になったところで打ち切る (Sokal の自動窓)．
+ */
+inline double integratedAutocorrelationTime(const std::vector<double>& series, const double& window = 6.0)
+{
+    const size_t n = series.size();
+    if(n < 2) return 0.5;
+
+    double mean = 0.0;
+    for(const auto& x : series) mean += x;
+    mean /= n;
+
+    double variance = 0.0;
+    for(const auto& x : series) variance += (x - mean) * (x - mean);
+    variance /= n;
+    if(variance == 0.0) return 0.5;
+
+    double tau = 0.5;
+    for(size_t t = 1; t < n; ++t)
+    {
+        double c = 0.0;
+        for(size_t i = 0; i + t < n; ++i) c += (series[i] - mean) * (series[i + t] - mean);
+        tau += c / ((n - t) * variance);
+
+        if(t >= window * tau) break;
+    }
+
+    return tau;
+}
+
+/* 対称行列 a (n×n，行優先) の固有値と固有ベクトルをヤコビ法で求める．
+ * 固有値は大きい順に values に，i 番目の固有値の固有ベクトルは vectors[i * n .. i * n + n) に入れる．
+ * 非対角成分の二乗和が対角成分の二乗和の eps^2 倍以下になれば収束とし，maxSweep 回で収束しなければ false．
+ */
+inline bool jacobiEigen(std::vector<double> a,
+                        const size_t& n,
+                        std::vector<double>& values,
+                        std::vector<double>& vectors,
+                        const double& eps = 1e-14,
+                        const size_t& maxSweep = 100)
+{
+    std::vector<double> v(n * n, 0.0);
+    for(size_t i = 0; i < n; ++i) v[i * n + i] = 1.0;
+
+    bool converged = false;
+    for(size_t sweep = 0; sweep < maxSweep && !converged; ++sweep)
+    {
+        double off = 0.0, diagonal = 0.0;
+        for(size_t i = 0; i < n; ++i)
+        {
+            diagonal += a[i * n + i] * a[i * n + i];
+            for(size_t j = i + 1; j < n; ++j) off += a[i * n + j] * a[i * n + j];
+        }
+        converged = off <= eps * eps * diagonal;
+        if(converged || off == 0.0) break;
+
+        for(size_t p = 0; p < n; ++p)
+            for(size_t q = p + 1; q < n; ++q)
+            {
+                const double apq = a[p * n + q];
+                if(apq == 0.0) continue;
+
+                //a_pq を0にする回転角
+                const double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+                const double t = ((theta >= 0.0) ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+                const double c = 1.0 / std::sqrt(t * t + 1.0);
+                const double s = t * c;
+
+                for(size_t k = 0; k < n; ++k)
+                {
+                    const double akp = a[k * n + p], akq = a[k * n + q];
+                    a[k * n + p] = c * akp - s * akq;
+                    a[k * n + q] = s * akp + c * akq;
+                }
+                for(size_t k = 0; k < n; ++k)
+                {
+                    const double apk = a[p * n + k], aqk = a[q * n + k];
+                    a[p * n + k] = c * apk - s * aqk;
+                    a[q * n + k] = s * apk + c * aqk;
+                }
+                for(size_t k = 0; k < n; ++k)
+                {
+                    const double vkp = v[k * n + p], vkq = v[k * n + q];
+                    v[k * n + p] = c * vkp - s * vkq;
+                    v[k * n + q] = s * vkp + c * vkq;
+                }
+            }
+    }
+
+    //固有値の大きい順に並べる
+    std::vector<size_t> order(n);
+    for(size_t i = 0; i < n; ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](const size_t& i, const size_t& j){ return a[i * n + i] > a[j * n + j]; });
+
+    values.resize(n);
+    vectors.resize(n * n);
+    for(size_t i = 0; i < n; ++i)
+    {
+        values[i] = a[order[i] * n + order[i]];
+        for(size_t k = 0; k < n; ++k) vectors[i * n + k] = v[k * n + order[i]];
+    }
+
+    return converged || n < 2;
+}
+
+/* 対称行列 a (n×n，行優先) の固有値と固有ベクトルをハウスホルダー法による三重対角化と陰的 QL 法で求める．
+ * 出力の形は jacobiEigen と同じ．計算量は O(n^3) で，n が大きいときはヤコビ法より速い．
+ */
+inline bool symmetricEigen(const std::vector<double>& a,
+                           const size_t& n,
+                           std::vector<double>& values,
+                           std::vector<double>& vectors,
+                           const size_t& maxIteration = 60)
+{
+    values.resize(n);
+    vectors.resize(n * n);
+    if(n == 0) return true;
+
+    std::vector<double> v(a.begin(), a.begin() + n * n), d(n), e(n, 0.0);
+    const auto V = [&](const size_t& i, const size_t& j) -> double& { return v[i * n + j]; };
+
+    //三重対角化 (d: 対角成分，e: 副対角成分)
+    for(size_t j = 0; j < n; ++j) d[j] = V(n - 1, j);
+    for(size_t i = n - 1; i > 0; --i)
+    {
+        double scale = 0.0, h = 0.0;
+        for(size_t k = 0; k < i; ++k) scale += std::abs(d[k]);
+
+        if(scale == 0.0)
+        {
+            e[i] = d[i - 1];
+            for(size_t j = 0; j < i; ++j)
+            {
+                d[j] = V(i - 1, j);
+                V(i, j) = 0.0;
+                V(j, i) = 0.0;
+            }
+        }
+        else
+        {
+            for(size_t k = 0; k < i; ++k)
+            {
+                d[k] /= scale;
+                h += d[k] * d[k];
+            }
+            double f = d[i - 1];
+            double g = (f > 0.0) ? -std::sqrt(h) : std::sqrt(h);
+            e[i] = scale * g;
+            h -= f * g;
+            d[i - 1] = f - g;
+            for(size_t j = 0; j < i; ++j) e[j] = 0.0;
+
+            for(size_t j = 0; j < i; ++j)
+            {
+                f = d[j];
+                V(j, i) = f;
+                g = e[j] + V(j, j) * f;
+                for(size_t k = j + 1; k < i; ++k)
+                {
+                    g += V(k, j) * d[k];
+                    e[k] += V(k, j) * f;
+                }
+                e[j] = g;
+            }
+
+            f = 0.0;
+            for(size_t j = 0; j < i; ++j)
+            {
+                e[j] /= h;
+                f += e[j] * d[j];
+            }
+            const double hh = f / (h + h);
+            for(size_t j = 0; j < i; ++j) e[j] -= hh * d[j];
+            for(size_t j = 0; j < i; ++j)
+            {
+                f = d[j];
+                g = e[j];
+                for(size_t k = j; k < i; ++k) V(k, j) -= (f * e[k] + g * d[k]);
+                d[j] = V(i - 1, j);
+                V(i, j) = 0.0;
+            }
+        }
+        d[i] = h;
+    }
+
+    //変換行列を作る
+    for(size_t i = 0; i + 1 < n; ++i)
+    {
+        V(n - 1, i) = V(i, i);
+        V(i, i) = 1.0;
+        const double h = d[i + 1];
+        if(h != 0.0)
+        {
+            for(size_t k = 0; k <= i; ++k) d[k] = V(k, i + 1) / h;
+            for(size_t j = 0; j <= i; ++j)
+            {
+                double g = 0.0;
+                for(size_t k = 0; k <= i; ++k) g += V(k, i + 1) * V(k, j);
+                for(size_t k = 0; k <= i; ++k) V(k, j) -= g * d[k];
+            }
+        }
+        for(size_t k = 0; k <= i; ++k) V(k, i + 1) = 0.0;
+    }
+    for(size_t j = 0; j < n; ++j)
+    {
+        d[j] = V(n - 1, j);
+        V(n - 1, j) = 0.0;
+    }
+    V(n - 1, n - 1) = 1.0;
+    e[0] = 0.0;
+
+    //QL 法の回転は固有ベクトルの組に掛かるので，転置して行ごとに連続にしておく
+    for(size_t i = 0; i < n; ++i)
+        for(size_t j = i + 1; j < n; ++j) std::swap(V(i, j), V(j, i));
+
+    //陰的 QL 法
+    for(size_t i = 1; i < n; ++i) e[i - 1] = e[i];
+    e[n - 1] = 0.0;
+
+    double f = 0.0, tst1 = 0.0;
+    const double eps = std::ldexp(1.0, -52);
+    bool converged = true;
+    for(size_t l = 0; l < n; ++l)
+    {
+        tst1 = std::max(tst1, std::abs(d[l]) + std::abs(e[l]));
+        size_t m = l;
+        while(m < n - 1 && std::abs(e[m]) > eps * tst1) ++m;
+
+        if(m > l)
+        {
+            size_t iteration = 0;
+            do
+            {
+                if(++iteration > maxIteration)
+                {
+                    converged = false;
+                    break;
+                }
+
+                double g = d[l];
+                double p = (d[l + 1] - g) / (2.0 * e[l]);
+                double r = std::hypot(p, 1.0);
+                if(p < 0.0) r = -r;
+                d[l] = e[l] / (p + r);
+                d[l + 1] = e[l] * (p + r);
+                const double dl1 = d[l + 1];
+                double h = g - d[l];
+                for(size_t i = l + 2; i < n; ++i) d[i] -= h;
+                f += h;
+
+                p = d[m];
+                double c = 1.0, c2 = 1.0, c3 = 1.0, s = 0.0, s2 = 0.0;
+                const double el1 = e[l + 1];
+                for(size_t i = m; i-- > l;)
+                {
+                    c3 = c2;
+                    c2 = c;
+                    s2 = s;
+                    g = c * e[i];
+                    h = c * p;
+                    r = std::hypot(p, e[i]);
+                    e[i + 1] = s * r;
+                    s = e[i] / r;
+                    c = p / r;
+                    p = c * d[i] - s * g;
+                    d[i + 1] = h + s * (c * g + s * d[i]);
+
+                    double *vi = &V(i, 0), *vi1 = &V(i + 1, 0);
+                    for(size_t k = 0; k < n; ++k)
+                    {
+                        h = vi1[k];
+                        vi1[k] = s * vi[k] + c * h;
+                        vi[k] = c * vi[k] - s * h;
+                    }
+                }
+                p = -s * s2 * c3 * el1 * e[l] / dl1;
+                e[l] = s * p;
+                d[l] = c * p;
+            }
+            while(std::abs(e[l]) > eps * tst1);
+        }
+        d[l] += f;
+        e[l] = 0.0;
+    }
+
+    //固有値の大きい順に並べる
+    std::vector<size_t> order(n);
+    for(size_t i = 0; i < n; ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](const size_t& i, const size_t& j){ return d[i] > d[j]; });
+
+    for(size_t i = 0; i < n; ++i)
+    {
+        values[i] = d[order[i]];
+        std::copy(&V(order[i], 0), &V(order[i], 0) + n, vectors.begin() + i * n);
+    }
+
+    return converged;
+}
+
+
+
 
 
 
@@ -302,6 +780,17 @@ public:
             update(state);
     }
 
+    /* interval ステップごとにスピン配位を recorder.record(state, step) に渡す */
+    template<size_t stepCount = 50000, typename Recorder>
+    void optimize(StateType& state, Recorder& recorder, const size_t& interval = 1)
+    {
+        for(size_t i = 1; i <= stepCount; ++i)
+        {
+            update(state);
+            if(i % interval == 0) recorder.record(state, i);
+        }
+    }
+
 private:
     ObjType *obj;
 };
@@ -325,6 +814,215 @@ private:
 enum class LatticeType { Square, Triangle, Rhombus, Hexagonal };
 
 
+/* 各格子の最近接サイトの相対位置 {行, 列}．
+ * 行によって並びが変わる格子は period 行ごとに同じ並びを繰り返す．
+ */
+template<LatticeType> struct LatticeGeometry;
+
+template<>
+struct LatticeGeometry<LatticeType::Square>
+{
+    static constexpr int z = 4;
+    static constexpr int period = 1;
+    static constexpr int offsets[period][z][2] = {
+        { {-1, 0}, {1, 0}, {0, -1}, {0, 1} }
+    };
+};
+
+template<>
+struct LatticeGeometry<LatticeType::Triangle>
+{
+    static constexpr int z = 6;
+    static constexpr int period = 2;
+    static constexpr int offsets[period][z][2] = {
+        { {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, 0}, {1, 1} },
+        { {-1, -1}, {-1, 0}, {0, -1}, {0, 1}, {1, -1}, {1, 0} }
+    };
+};
+
+template<>
+struct LatticeGeometry<LatticeType::Rhombus>
+{
+    static constexpr int z = 4;
+    static constexpr int period = 2;
+    static constexpr int offsets[period][z][2] = {
+        { {-1, 0}, {-1, 1}, {1, 0}, {1, 1} },
+        { {-1, -1}, {-1, 0}, {1, -1}, {1, 0} }
+    };
+};
+
+/* 4行周期のレンガ状の蜂の巣格子．行数は4の倍数とする． */
+template<>
+struct LatticeGeometry<LatticeType::Hexagonal>
+{
+    static constexpr int z = 3;
+    static constexpr int period = 4;
+    static constexpr int offsets[period][z][2] = {
+        { {-1, 0}, {1, 0}, {1, 1} },
+        { {-1, -1}, {-1, 0}, {1, 0} },
+        { {-1, 0}, {1, -1}, {1, 0} },
+        { {-1, 0}, {-1, 1}, {1, 0} }
+    };
+};
+
+/* 次近接サイトの相対位置．正方格子 (対角の4サイト) だけ定義する． */
+template<LatticeType> struct NextNearestGeometry;
+
+template<>
+struct NextNearestGeometry<LatticeType::Square>
+{
+    static constexpr int z = 4;
+    static constexpr int offsets[z][2] = { {-1, -1}, {-1, 1}, {1, -1}, {1, 1} };
+};
+
+
+/* 格子の近傍の計算をまとめたもの．
+ * forEachNeighbor は周期境界の rows×cols の格子(トーラス)上で近傍を列挙する．
+ * State<N, M, bool> を受け取る関数は，最終行・最終列を先頭行・先頭列の複製とする
+ * これまでの周期境界条件に従い，実際の格子を (N - 1)×(M - 1) とみなす．
+ */
+template<LatticeType Lattice>
+struct LatticeStencil : public LatticeGeometry<Lattice>
+{
+    using Geometry = LatticeGeometry<Lattice>;
+    using Geometry::z;
+    using Geometry::period;
+    using Geometry::offsets;
+
+    template<typename Func>
+    static void forEachNeighbor(const size_t& row, const size_t& col,
+                                const size_t& rows, const size_t& cols, Func&& f)
+    {
+        const int (&offset)[z][2] = offsets[row % period];
+
+        for(int k = 0; k < z; ++k)
+        {
+            long long r = static_cast<long long>(row) + offset[k][0];
+            long long c = static_cast<long long>(col) + offset[k][1];
+
+            if(r < 0) r += rows; else if(r >= static_cast<long long>(rows)) r -= rows;
+            if(c < 0) c += cols; else if(c >= static_cast<long long>(cols)) c -= cols;
+
+            f(static_cast<size_t>(r), static_cast<size_t>(c));
+        }
+    }
+
+    /* 最近接のイジングスピンの和 */
+    template<size_t N, size_t M>
+    static int neighborSpin(const State<N, M, bool>& state, const size_t& row, const size_t& col) noexcept
+    {
+        int spin = 0;
+        if constexpr(N > 2 && M > 2)
+        {
+            forEachNeighbor(row % (N - 1), col % (M - 1), N - 1, M - 1, [&](const size_t& r, const size_t& c)
+            {
+                spin += (state.at(r, c)) ? 1 : -1;
+            });
+        }
+        else
+        {
+            if constexpr(N > 2)
+            {
+                const size_t up = (row == 0) ? N - 2 : row - 1;
+                const size_t down = (row == N - 1) ? 1 : row + 1;
+
+                spin += ((state.at(up, col)) ? 1 : -1) + ((state.at(down, col)) ? 1 : -1);
+            }
+            if constexpr(M > 2)
+            {
+                const size_t left = (col == 0) ? M - 2 : col - 1;
+                const size_t right = (col == M - 1) ? 1 : col + 1;
+
+                spin += ((state.at(row, left)) ? 1 : -1) + ((state.at(row, right)) ? 1 : -1);
+            }
+        }
+
+        return spin;
+    }
+
+    /* 横 (行のずれが 0) のボンドの数．周期の中で最も多い行の値 */
+    static constexpr int horizontalCount() noexcept
+    {
+        int count = 0;
+        for(int p = 0; p < period; ++p)
+        {
+            int n = 0;
+            for(int k = 0; k < z; ++k) n += (offsets[p][k][0] == 0) ? 1 : 0;
+            count = std::max(count, n);
+        }
+        return count;
+    }
+
+    /* 最近接のイジングスピンの和を横のボンドと縦 (それ以外) のボンドに分けて求める */
+    template<size_t N, size_t M>
+    static void neighborSpin(const State<N, M, bool>& state, const size_t& row, const size_t& col,
+                             int& horizontal, int& vertical) noexcept
+    {
+        static_assert(N > 2 && M > 2, "lattice is too small");
+
+        const int (&offset)[z][2] = offsets[row % period];
+        horizontal = 0;
+        vertical = 0;
+
+        int k = 0;
+        forEachNeighbor(row, col, N - 1, M - 1, [&](const size_t& r, const size_t& c)
+        {
+            const int spin = (state.at(r, c)) ? 1 : -1;
+            if(offset[k++][0] == 0) horizontal += spin; else vertical += spin;
+        });
+    }
+
+    /* 次近接のイジングスピンの和 (NextNearestGeometry のある格子だけ) */
+    template<size_t N, size_t M>
+    static int nextNearestSpin(const State<N, M, bool>& state, const size_t& row, const size_t& col) noexcept
+    {
+        static_assert(N > 2 && M > 2, "lattice is too small");
+        using NextNearest = NextNearestGeometry<Lattice>;
+
+        int spin = 0;
+        for(int k = 0; k < NextNearest::z; ++k)
+        {
+            long long r = static_cast<long long>(row) + NextNearest::offsets[k][0];
+            long long c = static_cast<long long>(col) + NextNearest::offsets[k][1];
+
+            if(r < 0) r += N - 1; else if(r >= static_cast<long long>(N - 1)) r -= N - 1;
+            if(c < 0) c += M - 1; else if(c >= static_cast<long long>(M - 1)) c -= M - 1;
+
+            spin += (state.at(static_cast<size_t>(r), static_cast<size_t>(c))) ? 1 : -1;
+        }
+        return spin;
+    }
+
+    /* (row, col) のスピンを value にし，複製している最終行・最終列にも反映する */
+    template<size_t N, size_t M>
+    static void setSpin(State<N, M, bool>& state, const size_t& row, const size_t& col, const bool& value) noexcept
+    {
+        state[row][col] = value;
+
+        const size_t mirrorRow = (row == 0) ? N - 1 : (row == N - 1) ? 0 : row;
+        const size_t mirrorCol = (col == 0) ? M - 1 : (col == M - 1) ? 0 : col;
+
+        state[mirrorRow][col] = value;
+        state[row][mirrorCol] = value;
+        state[mirrorRow][mirrorCol] = value;
+    }
+
+    /* 結合定数 J でのエネルギー．各ボンドを1回ずつ数える． */
+    template<size_t N, size_t M>
+    static double energy(const State<N, M, bool>& state, const double& J) noexcept
+    {
+        static_assert(N > 2 && M > 2, "lattice is too small");
+
+        long long sum = 0;
+        for(size_t r = 0; r < N - 1; ++r)
+            for(size_t c = 0; c < M - 1; ++c)
+                sum += ((state.at(r, c)) ? 1 : -1) * neighborSpin(state, r, c);
+
+        return - 0.5 * J * static_cast<double>(sum);
+    }
+};
+
+
 /* 熱浴法 */
 
 template<LatticeType = LatticeType::Square>
@@ -366,6 +1064,17 @@ public:
         for(size_t i = 0; i < stepCount; ++i) update(state);
     }
 
+    /* interval ステップごとにスピン配位を recorder.record(state, step) に渡す */
+    template<size_t stepCount, size_t N, size_t M, typename Recorder>
+    void optimize(State<N, M, bool>& state, Recorder& recorder, const size_t& interval = 1)
+    {
+        for(size_t i = 1; i <= stepCount; ++i)
+        {
+            update(state);
+            if(i % interval == 0) recorder.record(state, i);
+        }
+    }
+
     template<size_t N, size_t M>
     double neighborSpin(const State<N, M, bool>& state, const size_t& row, const size_t& col);
 
@@ -379,216 +1088,13 @@ private:
 };
 
 
-template<>
+template<LatticeType Lattice>
 template<size_t N, size_t M>
-double IsingHeatBathMethod<LatticeType::Square>::neighborSpin(const State<N, M, bool>& state,
-                                                                 const size_t& row,
-                                                                 const size_t& col)
+double IsingHeatBathMethod<Lattice>::neighborSpin(const State<N, M, bool>& state,
+                                                 const size_t& row,
+                                                 const size_t& col)
 {
-    double spin = 0.0;
-    if constexpr(N > 2 && M > 2)
-    {
-        const int up = (row == 0) ? N - 2 : row - 1;
-        const int down = (row == N - 1) ? 1 : row + 1;
-        const int left = (col == 0) ? M - 2 : col - 1;
-        const int right = (col == M - 1) ? 1 : col + 1;
-
-        spin = IsingModel::isingSpin(state.at(up, col)) +
-               IsingModel::isingSpin(state.at(down, col)) +
-               IsingModel::isingSpin(state.at(row, left)) +
-               IsingModel::isingSpin(state.at(row, right));
-    }
-    else
-    {
-        if constexpr(N > 2)
-        {
-            const int up = (row == 0) ? N - 2: row - 1;
-            const int down = (row == N - 1) ? 1 : row + 1;
-
-            spin += IsingModel::isingSpin(state.at(up, col)) +
-                    IsingModel::isingSpin(state.at(down, col));
-        }
-        if constexpr(M > 2)
-        {
-            const int left = (col == 0) ? M - 2 : col - 1;
-            const int right = (col == M - 1) ? 1 : col + 1;
-
-            spin += IsingModel::isingSpin(state.at(row, left)) +
-                    IsingModel::isingSpin(state.at(row, right));
-        }
-    }
-
-    return spin;
-}
-
-template<>
-template<size_t N, size_t M>
-double IsingHeatBathMethod<LatticeType::Triangle>::neighborSpin(const State<N, M, bool>& state,
-                                                                const size_t& row,
-                                                                const size_t& col)
-{
-    double spin = 0.0;
-    if constexpr(N > 2 && M > 2)
-    {
-        const int up = (row == 0) ? N - 2 : row - 1;
-        const int down = (row == N - 1) ? 1 : row + 1;
-        const int left = (col == 0) ? M - 2 : col - 1;
-        const int right = (col == M - 1) ? 1 : col + 1;
-
-        if(row % 2 == 0)
-        {
-            spin = IsingModel::isingSpin(state.at(up, col)) +
-                   IsingModel::isingSpin(state.at(up, right)) +
-                   IsingModel::isingSpin(state.at(row, left)) +
-                   IsingModel::isingSpin(state.at(row, right)) +
-                   IsingModel::isingSpin(state.at(down, col)) +
-                   IsingModel::isingSpin(state.at(down, right));
-        }
-        else
-        {
-            spin = IsingModel::isingSpin(state.at(up, left)) +
-                   IsingModel::isingSpin(state.at(up, col)) +
-                   IsingModel::isingSpin(state.at(row, left)) +
-                   IsingModel::isingSpin(state.at(row, right)) +
-                   IsingModel::isingSpin(state.at(down, left)) +
-                   IsingModel::isingSpin(state.at(down, col));
-        }
-    }
-    else
-    {
-        if constexpr(N > 2)
-        {
-            const int up = (row == 0) ? N - 2: row - 1;
-            const int down = (row == N - 1) ? 1 : row + 1;
-
-            spin += IsingModel::isingSpin(state.at(up, col)) +
-                    IsingModel::isingSpin(state.at(down, col));
-        }
-        if constexpr(M > 2)
-        {
-            const int left = (col == 0) ? M - 2 : col - 1;
-            const int right = (col == M - 1) ? 1 : col + 1;
-
-            spin += IsingModel::isingSpin(state.at(row, left)) +
-                    IsingModel::isingSpin(state.at(row, right));
-        }
-    }
-
-    return spin;
-}
-
-template<>
-template<size_t N, size_t M>
-double IsingHeatBathMethod<LatticeType::Rhombus>::neighborSpin(const State<N, M, bool>& state,
-                                                               const size_t& row,
-                                                               const size_t& col)
-{
-    double spin = 0.0;
-    if constexpr(N > 2 && M > 2)
-    {
-        const int up = (row == 0) ? N - 2 : row - 1;
-        const int down = (row == N - 1) ? 1 : row + 1;
-        const int left = (col == 0) ? M - 2 : col - 1;
-        const int right = (col == M - 1) ? 1 : col + 1;
-
-        if(row % 2 == 0)
-        {
-            spin = IsingModel::isingSpin(state.at(up, col)) +
-                   IsingModel::isingSpin(state.at(up, right)) +
-                   IsingModel::isingSpin(state.at(down, col)) +
-                   IsingModel::isingSpin(state.at(down, right));
-        }
-        else
-        {
-            spin = IsingModel::isingSpin(state.at(up, left)) +
-                   IsingModel::isingSpin(state.at(up, col)) +
-                   IsingModel::isingSpin(state.at(down, left)) +
-                   IsingModel::isingSpin(state.at(down, col));
-        }
-    }
-    else
-    {
-        if constexpr(N > 2)
-        {
-            const int up = (row == 0) ? N - 2: row - 1;
-            const int down = (row == N - 1) ? 1 : row + 1;
-
-            spin += IsingModel::isingSpin(state.at(up, col)) +
-                    IsingModel::isingSpin(state.at(down, col));
-        }
-        if constexpr(M > 2)
-        {
-            const int left = (col == 0) ? M - 2 : col - 1;
-            const int right = (col == M - 1) ? 1 : col + 1;
-
-            spin += IsingModel::isingSpin(state.at(row, left)) +
-                    IsingModel::isingSpin(state.at(row, right));
-        }
-    }
-
-    return spin;
-}
-
-template<>
-template<size_t N, size_t M>
-double IsingHeatBathMethod<LatticeType::Hexagonal>::neighborSpin(const State<N, M, bool>& state,
-                                                               const size_t& row,
-                                                               const size_t& col)
-{
-    double spin = 0.0;
-    if constexpr(N > 2 && M > 2)
-    {
-        const int up = (row == 0) ? N - 2 : row - 1;
-        const int down = (row == N - 1) ? 1 : row + 1;
-        const int left = (col == 0) ? M - 2 : col - 1;
-        const int right = (col == M - 1) ? 1 : col + 1;
-
-        if(row % 4 == 0)
-        {
-            spin = IsingModel::isingSpin(state.at(up, col)) +
-                   IsingModel::isingSpin(state.at(down, col)) +
-                   IsingModel::isingSpin(state.at(down, right));
-        }
-        else if(row % 4 == 1)
-        {
-            spin = IsingModel::isingSpin(state.at(up, right)) +
-                   IsingModel::isingSpin(state.at(up, col)) +
-                   IsingModel::isingSpin(state.at(down, col));
-        }
-        else if(row % 4 == 2)
-        {
-            spin = IsingModel::isingSpin(state.at(up, col)) +
-                   IsingModel::isingSpin(state.at(down, left)) +
-                   IsingModel::isingSpin(state.at(down, col));
-        }
-        else
-        {
-            spin = IsingModel::isingSpin(state.at(up, col)) +
-                   IsingModel::isingSpin(state.at(up, right)) +
-                   IsingModel::isingSpin(state.at(down, col));
-        }
-    }
-    else
-    {
-        if constexpr(N > 2)
-        {
-            const int up = (row == 0) ? N - 2: row - 1;
-            const int down = (row == N - 1) ? 1 : row + 1;
-
-            spin += IsingModel::isingSpin(state.at(up, col)) +
-                    IsingModel::isingSpin(state.at(down, col));
-        }
-        if constexpr(M > 2)
-        {
-            const int left = (col == 0) ? M - 2 : col - 1;
-            const int right = (col == M - 1) ? 1 : col + 1;
-
-            spin += IsingModel::isingSpin(state.at(row, left)) +
-                    IsingModel::isingSpin(state.at(row, right));
-        }
-    }
-
-    return spin;
+    return LatticeStencil<Lattice>::neighborSpin(state, row, col);
 }
 
 
@@ -0,0 +1,481 @@
+#ifndef MEANFIELD_H
+#define MEANFIELD_H
+
+#include "mathutil.h"
+#include "isingmodel.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+
+/* 疎なグラフ上のイジング模型 H = - Σ_(ij) J_ij s_i s_j - Σ_i h_i s_i の平均場近似．
+ * IsingModel::freeEnergy は一様な Curie-Weiss 近似 (配位数 z) だけなので，
+ * ボンドごとに結合の違う任意のグラフに対して
+ *   BeliefPropagation: キャビティ法 (Bethe 近似)．木の上では厳密
+ *   TAP: 2次の Plefka 展開 (Onsager の反作用項つき) の自己無撞着方程式
+ * を解く．どちらも全サイト・全ボンドを同時に更新し (並列に分けられる)，減衰 damping で振動を抑える．
+ *
+ *   MeanField::SparseGraph graph = MeanField::SparseGraph::lattice<LatticeType::Square>(L, L, 1.0);
+ *   MeanField::BeliefPropagation bp(&graph, &ising);
+ *   bp.solve();
+ *   bp.magnetization(i); bp.freeEnergy();
+ */
+namespace MeanField
+{
+
+/* 隣接リストを CSR 形式で持つ無向グラフ．各ボンドは両向きの有向辺として2回現れる．
+ * サイト i の辺は [offsets[i], offsets[i + 1]) で，相手のサイト neighbors[e]，結合 couplings[e]，
+ * 逆向きの辺 reverse[e] を持つ．
+ */
+struct SparseGraph
+{
+    struct Bond
+    {
+        size_t i;
+        size_t j;
+        double J;
+    };
+
+    std::vector<size_t> offsets;
+    std::vector<size_t> neighbors;
+    std::vector<size_t> reverse;
+    std::vector<double> couplings;
+    std::vector<double> fields;
+
+    size_t siteCount() const noexcept { return fields.size(); }
+    size_t edgeCount() const noexcept { return neighbors.size(); }
+    size_t degree(const size_t& i) const noexcept { return offsets[i + 1] - offsets[i]; }
+
+    /* ボンドの一覧から作る．自己ループと範囲外のサイトを含むボンドは無視する */
+    static SparseGraph fromBonds(const size_t& siteCount, const std::vector<Bond>& bonds)
+    {
+        SparseGraph graph;
+        graph.fields.assign(siteCount, 0.0);
+        graph.offsets.assign(siteCount + 1, 0);
+
+        for(const auto& bond : bonds)
+        {
+            if(bond.i == bond.j || bond.i >= siteCount || bond.j >= siteCount) continue;
+            graph.offsets[bond.i + 1]++;
+            graph.offsets[bond.j + 1]++;
+        }
+        for(size_t i = 0; i < siteCount; ++i) graph.offsets[i + 1] += graph.offsets[i];
+
+        const size_t edges = graph.offsets[siteCount];
+        graph.neighbors.resize(edges);
+        graph.reverse.resize(edges);
+        graph.couplings.resize(edges);
+
+        std::vector<size_t> fill(graph.offsets.begin(), graph.offsets.end() - 1);
+        for(const auto& bond : bonds)
+        {
+            if(bond.i == bond.j || bond.i >= siteCount || bond.j >= siteCount) continue;
+
+            const size_t a = fill[bond.i]++;
+            const size_t b = fill[bond.j]++;
+            graph.neighbors[a] = bond.j;
+            graph.neighbors[b] = bond.i;
+            graph.couplings[a] = graph.couplings[b] = bond.J;
+            graph.reverse[a] = b;
+            graph.reverse[b] = a;
+        }
+
+        return graph;
+    }
+
+    /* rows×cols の周期境界の格子 (LatticeGeometry の近傍) で，すべてのボンドの結合を J にしたもの．
+     * サイト (r, c) の番号は r * cols + c．近傍が重ならないよう rows，cols は3以上とする．
+     */
+    template<LatticeType Lattice>
+    static SparseGraph lattice(const size_t& rows, const size_t& cols, const double& J)
+    {
+        std::vector<Bond> bonds;
+        for(size_t r = 0; r < rows; ++r)
+            for(size_t c = 0; c < cols; ++c)
+            {
+                const size_t i = r * cols + c;
+                LatticeStencil<Lattice>::forEachNeighbor(r, c, rows, cols, [&](const size_t& nr, const size_t& nc)
+                {
+                    const size_t j = nr * cols + nc;
+                    if(i < j) bonds.push_back({ i, j, J });
+                });
+            }
+
+        return fromBonds(rows * cols, bonds);
+    }
+};
+
+
+namespace detail
+{
+
+/* ln(2 cosh x) (大きな |x| でもあふれない) */
+inline double logTwoCosh(const double& x) noexcept
+{
+    const double a = std::abs(x);
+    return a + std::log1p(std::exp(-2.0 * a));
+}
+
+inline double logSumExp(const double& a, const double& b) noexcept
+{
+    const double m = std::max(a, b);
+    return m + std::log(std::exp(a - m) + std::exp(b - m));
+}
+
+/* [0, siteCount) を辺の数が揃うように threadCount 個の区間に分けて f(thread, begin, end) を並列に呼ぶ */
+template<typename Func>
+void parallelForSites(const SparseGraph& graph, const size_t& threadCount, Func&& f)
+{
+    const size_t sites = graph.siteCount();
+    const size_t work = graph.edgeCount() + sites;
+    if(threadCount <= 1 || sites < 2 * threadCount)
+    {
+        f(0, 0, sites);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    size_t begin = 0;
+    for(size_t t = 0; t < threadCount && begin < sites; ++t)
+    {
+        //offsets[i] + i (辺とサイトの数) が target を超える最初の i まで
+        const size_t target = work * (t + 1) / threadCount;
+        size_t lo = begin, hi = sites;
+        while(lo < hi)
+        {
+            const size_t mid = (lo + hi) / 2;
+            if(graph.offsets[mid] + mid < target) lo = mid + 1; else hi = mid;
+        }
+        const size_t end = (t + 1 == threadCount) ? sites : std::max(lo, begin + 1);
+
+        threads.emplace_back([&f, t, begin, end](){ f(t, begin, end); });
+        begin = end;
+    }
+    for(auto& thread : threads) thread.join();
+}
+
+} //namespace detail
+
+
+/* キャビティ法 (確率伝搬法)．有向辺 i → j ごとにキャビティ場 u_{i→j} を持ち，
+ *   h_{i→j} = βh_i + Σ_{k∈∂i\j} u_{k→i}
+ *   u_{i→j} = atanh( tanh(βJ_ij) tanh(h_{i→j}) )
+ * を全辺同時に反復する．新しいメッセージは (1 - damping) u_new + damping u_old とする．
+ * 磁化は m_i = tanh(βh_i + Σ_k u_{k→i})，Bethe 自由エネルギーは
+ *   -βF = Σ_i ln Σ_s e^{βh_i s} Π_k 2cosh(βJ_ik s + h_{k→i}) - Σ_(ij) ln Σ_{s,s'} e^{βJ_ij s s' + h_{i→j} s + h_{j→i} s'}．
+ * 場の単位は β を掛けたもの (無次元) で持つ．
+ */
+class BeliefPropagation
+{
+public:
+    BeliefPropagation(const SparseGraph *graph,
+                      IsingModel *ising,
+                      const size_t& threadCount = std::thread::hardware_concurrency())
+        : graph(graph)
+        , ising(ising)
+        , threadCount(std::max<size_t>(threadCount, 1))
+        , messages(graph->edgeCount(), 0.0)
+        , next(graph->edgeCount(), 0.0)
+        , cavity(graph->edgeCount(), 0.0) {}
+
+    void setDamping(const double& damping) { this->damping = std::min(std::max(damping, 0.0), 0.99); }
+
+    /* すべてのメッセージを u にする (u > 0 で正の磁化の解へ向かわせる) */
+    void init(const double& u = 0.0)
+    {
+        std::fill(messages.begin(), messages.end(), u);
+        sweeps = 0;
+        _residual = 0.0;
+    }
+
+    /* 最大 maxSweep 回，メッセージの変化の最大値が tolerance 未満になるまで反復する．収束したら true */
+    bool solve(const size_t& maxSweep = 100, const double& tolerance = 1e-8)
+    {
+        for(size_t s = 0; s < maxSweep; ++s)
+        {
+            if(sweep() < tolerance) return true;
+        }
+        return false;
+    }
+
+    /* 全メッセージを1回更新し，変化の最大値を返す */
+    double sweep()
+    {
+        const double beta = 1.0 / ising->kbT();
+        std::vector<double> residuals(threadCount, 0.0);
+
+        //tanh(βJ_ij) は温度が変わったときだけ作り直す
+        if(beta != tanhBeta)
+        {
+            bondTanh.resize(graph->edgeCount());
+            detail::parallelForSites(*graph, threadCount, [&](const size_t&, const size_t& begin, const size_t& end)
+            {
+                for(size_t e = graph->offsets[begin]; e < graph->offsets[end]; ++e)
+                    bondTanh[e] = std::tanh(beta * graph->couplings[e]);
+            });
+            tanhBeta = beta;
+        }
+
+        detail::parallelForSites(*graph, threadCount, [&](const size_t& t, const size_t& begin, const size_t& end)
+        {
+            double residual = 0.0;
+            for(size_t i = begin; i < end; ++i)
+            {
+                const size_t eBegin = graph->offsets[i], eEnd = graph->offsets[i + 1];
+
+                double field = beta * graph->fields[i];
+                for(size_t e = eBegin; e < eEnd; ++e) field += messages[graph->reverse[e]];
+
+                for(size_t e = eBegin; e < eEnd; ++e)
+                {
+                    //atanh(t tanh h) = sign(h) ln[((1 + t) + (1 - t) x) / ((1 - t) + (1 + t) x)] / 2，x = exp(-2|h|)．
+                    //tanh と atanh を呼ぶより速く，|h| や |t| が大きくてもあふれない
+                    const double h = field - messages[graph->reverse[e]];
+                    const double a = 1.0 + bondTanh[e], b = 1.0 - bondTanh[e];
+                    const double x = std::exp(-2.0 * std::abs(h));
+                    const double ratio = (a + b * x) / std::max(b + a * x, 1e-300);
+                    const double u = ((h < 0.0) ? -0.5 : 0.5) * std::log(std::max(ratio, 1e-300));
+                    const double value = (1.0 - damping) * u + damping * messages[e];
+                    residual = std::max(residual, std::abs(value - messages[e]));
+                    next[e] = value;
+                }
+            }
+            residuals[t] = residual;
+        });
+
+        messages.swap(next);
+        sweeps++;
+        _residual = *std::max_element(residuals.begin(), residuals.end());
+        return _residual;
+    }
+
+    double magnetization(const size_t& i) const noexcept { return std::tanh(localField(i)); }
+
+    std::vector<double> magnetizations() const
+    {
+        std::vector<double> m(graph->siteCount());
+        detail::parallelForSites(*graph, threadCount, [&](const size_t&, const size_t& begin, const size_t& end)
+        {
+            for(size_t i = begin; i < end; ++i) m[i] = magnetization(i);
+        });
+        return m;
+    }
+
+    /* 隣接サイトの相関 <s_i s_j> (有向辺 e = i → j) */
+    double correlation(const size_t& e) const noexcept
+    {
+        const double a = std::tanh(graph->couplings[e] / ising->kbT());
+        const double b = std::tanh(cavityField(e)) * std::tanh(cavityField(graph->reverse[e]));
+        return (a + b) / (1.0 + a * b);
+    }
+
+    /* Bethe 自由エネルギー (系全体) */
+    double freeEnergy()
+    {
+        const double beta = 1.0 / ising->kbT();
+
+        //キャビティ場 h_{i→j} を辺 e = i → j に置く
+        detail::parallelForSites(*graph, threadCount, [&](const size_t&, const size_t& begin, const size_t& end)
+        {
+            for(size_t i = begin; i < end; ++i)
+            {
+                const double field = localField(i);
+                for(size_t e = graph->offsets[i]; e < graph->offsets[i + 1]; ++e)
+                    cavity[e] = field - messages[graph->reverse[e]];
+            }
+        });
+
+        std::vector<double> sums(threadCount, 0.0);
+        detail::parallelForSites(*graph, threadCount, [&](const size_t& t, const size_t& begin, const size_t& end)
+        {
+            double sum = 0.0;
+            for(size_t i = begin; i < end; ++i)
+            {
+                const double h = beta * graph->fields[i];
+                double up = h, down = -h;
+                for(size_t e = graph->offsets[i]; e < graph->offsets[i + 1]; ++e)
+                {
+                    const double K = beta * graph->couplings[e];
+                    const double hk = cavity[graph->reverse[e]];
+                    up += detail::logTwoCosh(K + hk);
+                    down += detail::logTwoCosh(-K + hk);
+
+                    //ボンドは i < j の向きで1回だけ引く
+                    const size_t j = graph->neighbors[e];
+                    if(i < j)
+                    {
+                        const double hi = cavity[e];
+                        sum -= detail::logSumExp(detail::logSumExp(K + hi + hk, K - hi - hk),
+                                                 detail::logSumExp(-K + hi - hk, -K - hi + hk));
+                    }
+                }
+                sum += detail::logSumExp(up, down);
+            }
+            sums[t] = sum;
+        });
+
+        double lnZ = 0.0;
+        for(const auto& sum : sums) lnZ += sum;
+        return -lnZ / beta;
+    }
+
+    size_t sweepCount() const noexcept { return sweeps; }
+    double residual() const noexcept { return _residual; }
+    const std::vector<double>& cavityMessages() const noexcept { return messages; }
+
+private:
+    double localField(const size_t& i) const noexcept
+    {
+        double field = graph->fields[i] / ising->kbT();
+        for(size_t e = graph->offsets[i]; e < graph->offsets[i + 1]; ++e) field += messages[graph->reverse[e]];
+        return field;
+    }
+
+    /* h_{i→j} (辺 e = i → j) */
+    double cavityField(const size_t& e) const noexcept
+    {
+        const size_t i = std::upper_bound(graph->offsets.begin(), graph->offsets.end(), e) - graph->offsets.begin() - 1;
+        return localField(i) - messages[graph->reverse[e]];
+    }
+
+    const SparseGraph *graph; //this has no ownership
+    IsingModel *ising;        //this has no ownership
+    size_t threadCount;
+    double damping = 0.2;
+
+    std::vector<double> messages;  //u_{i→j} を辺 i → j に置く
+    std::vector<double> next;
+    std::vector<double> cavity;    //h_{i→j} (freeEnergy の作業領域)
+    std::vector<double> bondTanh;  //tanh(βJ) を辺ごとに
+    double tanhBeta = 0.0;
+
+    size_t sweeps = 0;
+    double _residual = 0.0;
+};
+
+
+/* TAP 方程式
+ *   m_i = tanh( βh_i + Σ_j βJ_ij m_j - m_i Σ_j (βJ_ij)^2 (1 - m_j^2) )
+ * を全サイト同時に反復する (右辺の m はすべて前の反復の値)．自由エネルギーは
+ *   -βF = Σ_i S(m_i) + Σ_i βh_i m_i + Σ_(ij) βJ_ij m_i m_j + (1/2) Σ_(ij) (βJ_ij)^2 (1 - m_i^2)(1 - m_j^2)
+ * (S は2状態のエントロピー)．
+ */
+class TAP
+{
+public:
+    TAP(const SparseGraph *graph,
+        IsingModel *ising,
+        const size_t& threadCount = std::thread::hardware_concurrency())
+        : graph(graph)
+        , ising(ising)
+        , threadCount(std::max<size_t>(threadCount, 1))
+        , m(graph->siteCount(), 0.0)
+        , next(graph->siteCount(), 0.0) {}
+
+    void setDamping(const double& damping) { this->damping = std::min(std::max(damping, 0.0), 0.99); }
+
+    void init(const double& m0 = 0.0)
+    {
+        std::fill(m.begin(), m.end(), m0);
+        sweeps = 0;
+        _residual = 0.0;
+    }
+
+    bool solve(const size_t& maxSweep = 100, const double& tolerance = 1e-8)
+    {
+        for(size_t s = 0; s < maxSweep; ++s)
+        {
+            if(sweep() < tolerance) return true;
+        }
+        return false;
+    }
+
+    double sweep()
+    {
+        const double beta = 1.0 / ising->kbT();
+        std::vector<double> residuals(threadCount, 0.0);
+
+        detail::parallelForSites(*graph, threadCount, [&](const size_t& t, const size_t& begin, const size_t& end)
+        {
+            double residual = 0.0;
+            for(size_t i = begin; i < end; ++i)
+            {
+                double field = beta * graph->fields[i];
+                double reaction = 0.0;
+                for(size_t e = graph->offsets[i]; e < graph->offsets[i + 1]; ++e)
+                {
+                    const double K = beta * graph->couplings[e];
+                    const double mj = m[graph->neighbors[e]];
+                    field += K * mj;
+                    reaction += K * K * (1.0 - mj * mj);
+                }
+
+                const double value = (1.0 - damping) * std::tanh(field - m[i] * reaction) + damping * m[i];
+                residual = std::max(residual, std::abs(value - m[i]));
+                next[i] = value;
+            }
+            residuals[t] = residual;
+        });
+
+        m.swap(next);
+        sweeps++;
+        _residual = *std::max_element(residuals.begin(), residuals.end());
+        return _residual;
+    }
+
+    double magnetization(const size_t& i) const noexcept { return m[i]; }
+    const std::vector<double>& magnetizations() const noexcept { return m; }
+
+    /* TAP 自由エネルギー (系全体) */
+    double freeEnergy() const
+    {
+        const double beta = 1.0 / ising->kbT();
+        std::vector<double> sums(threadCount, 0.0);
+
+        detail::parallelForSites(*graph, threadCount, [&](const size_t& t, const size_t& begin, const size_t& end)
+        {
+            double sum = 0.0;
+            for(size_t i = begin; i < end; ++i)
+            {
+                const double p = 0.5 * (1.0 + m[i]), q = 0.5 * (1.0 - m[i]);
+                if(p > 0.0) sum -= p * std::log(p);
+                if(q > 0.0) sum -= q * std::log(q);
+                sum += beta * graph->fields[i] * m[i];
+
+                for(size_t e = graph->offsets[i]; e < graph->offsets[i + 1]; ++e)
+                {
+                    const size_t j = graph->neighbors[e];
+                    if(i > j) continue;
+
+                    const double K = beta * graph->couplings[e];
+                    sum += K * m[i] * m[j] + 0.5 * K * K * (1.0 - m[i] * m[i]) * (1.0 - m[j] * m[j]);
+                }
+            }
+            sums[t] = sum;
+        });
+
+        double lnZ = 0.0;
+        for(const auto& sum : sums) lnZ += sum;
+        return -lnZ / beta;
+    }
+
+    size_t sweepCount() const noexcept { return sweeps; }
+    double residual() const noexcept { return _residual; }
+
+private:
+    const SparseGraph *graph; //this has no ownership
+    IsingModel *ising;        //this has no ownership
+    size_t threadCount;
+    double damping = 0.2;
+
+    std::vector<double> m;
+    std::vector<double> next;
+
+    size_t sweeps = 0;
+    double _residual = 0.0;
+};
+
+} //namespace MeanField
+
+#endif // MEANFIELD_H
@@ -0,0 +1,378 @@
+#ifndef MONTECARLO_H
+#define MONTECARLO_H
+
+#include "mathutil.h"
+#include "isingmodel.h"
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <tuple>
+
+
+/* 更新規則・格子・サイトの走査順・乱数・観測を組み合わせるモンテカルロ法．
+ *
+ *   MonteCarlo::Engine<LatticeType::Triangle, MonteCarlo::HeatBath, MonteCarlo::CheckerboardScan> engine(&ising);
+ *   engine.optimize<1000000>(state);
+ *
+ * 方策はすべてテンプレート引数で与えるので，1ステップの更新に関数ポインタや仮想関数の呼び出しは無い．
+ * 遷移確率は局所場 h (最近接スピンの和) と現在のスピンで引ける表にし，温度と J が変わったときだけ作り直す．
+ * 外場・異方的な結合・次近接の結合は Interaction で選んだときだけ局所場の計算と表に加わる．
+ */
+namespace MonteCarlo
+{
+
+/* 更新規則: 現在のスピン spin (±1) と x = J h / kT から，更新後に up になる確率を返す */
+struct Metropolis
+{
+    static double upProbability(const int& spin, const double& x) noexcept
+    {
+        const double flip = std::min(1.0, std::exp(-2.0 * spin * x));
+        return (spin > 0) ? 1.0 - flip : flip;
+    }
+};
+
+struct HeatBath
+{
+    static double upProbability(const int&, const double& x) noexcept
+    {
+        return 0.5 * (std::tanh(x) + 1.0);
+    }
+};
+
+/* イジングスピンでは Glauber 動力学の遷移確率は熱浴法と同じ */
+using Glauber = HeatBath;
+
+
+
+
+/* ハミルトニアンの項 H = - J Σ s_i s_j - h Σ s_i - J2 Σ_nnn s_i s_j をコンパイル時に選ぶ．
+ *   Field: 外場 h (IsingModel::Parameter::h)
+ *   Anisotropic: 横のボンド (行のずれが 0) を Jx，それ以外を Jy にする (J は使わない)
+ *   NextNearest: 次近接の結合 J2 (NextNearestGeometry のある格子だけ)
+ * 使わない項は局所場の計算にも遷移確率の表にも現れないので，NearestNeighbor は項を足す前と同じ速さで動く．
+ */
+template<bool Field = false, bool Anisotropic = false, bool NextNearest = false>
+struct Interaction
+{
+    static constexpr bool field = Field;
+    static constexpr bool anisotropic = Anisotropic;
+    static constexpr bool nextNearest = NextNearest;
+};
+
+using NearestNeighbor = Interaction<>;
+using ExternalField = Interaction<true>;
+
+
+
+
+/* 走査順: 次に更新するサイトを (N - 1)×(M - 1) の格子から選ぶ */
+struct RandomScan
+{
+    template<typename Rng>
+    void next(const size_t& rows, const size_t& cols, Rng& rng, size_t& row, size_t& col) noexcept
+    {
+        std::uniform_int_distribution<size_t> randRow(0, rows - 1);
+        std::uniform_int_distribution<size_t> randCol(0, cols - 1);
+        row = randRow(rng);
+        col = randCol(rng);
+    }
+};
+
+struct SequentialScan
+{
+    template<typename Rng>
+    void next(const size_t& rows, const size_t& cols, Rng&, size_t& row, size_t& col) noexcept
+    {
+        row = r;
+        col = c;
+        if(++c >= cols)
+        {
+            c = 0;
+            if(++r >= rows) r = 0;
+        }
+    }
+
+private:
+    size_t r = 0;
+    size_t c = 0;
+};
+
+/* (row + col) の偶奇で2つの副格子に分け，偶数側をすべて更新してから奇数側を更新する．
+ * 正方格子では同じ副格子のサイトは互いに独立になる．
+ */
+struct CheckerboardScan
+{
+    template<typename Rng>
+    void next(const size_t& rows, const size_t& cols, Rng&, size_t& row, size_t& col) noexcept
+    {
+        row = r;
+        col = c;
+        c += 2;
+        if(c >= cols)
+        {
+            if(++r >= rows)
+            {
+                r = 0;
+                parity ^= 1;
+            }
+            c = (r + parity) % 2;
+        }
+    }
+
+private:
+    size_t r = 0;
+    size_t c = 0;
+    size_t parity = 0;
+};
+
+
+
+
+/* 乱数: std::mt19937 の代わりに使える軽い64bit乱数 (xoshiro256**) */
+class Xoshiro256
+{
+public:
+    using result_type = uint64_t;
+
+    explicit Xoshiro256(const uint64_t& seed = 0x9e3779b97f4a7c15ULL) { this->seed(seed); }
+
+    static constexpr result_type min() noexcept { return 0; }
+    static constexpr result_type max() noexcept { return ~uint64_t(0); }
+
+    void seed(uint64_t value) noexcept
+    {
+        //splitmix64 で状態を埋める
+        for(auto& word : s)
+        {
+            value += 0x9e3779b97f4a7c15ULL;
+            uint64_t z = value;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    result_type operator()() noexcept
+    {
+        const uint64_t result = rotl(s[1] * 5, 7) * 9;
+        const uint64_t t = s[1] << 17;
+
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+
+        return result;
+    }
+
+private:
+    static uint64_t rotl(const uint64_t& x, const int& k) noexcept { return (x << k) | (x >> (64 - k)); }
+
+    uint64_t s[4];
+};
+
+
+
+
+/* 観測: 1ステップの更新ごとに observer(state, step) が呼ばれる */
+struct NullObserver
+{
+    template<typename StateType>
+    void operator()(const StateType&, const size_t&) noexcept {}
+};
+
+/* interval ステップごとに recorder.record(state, step) を呼ぶ (Trajectory::TrajectoryWriter など) */
+template<typename Recorder>
+struct RecordEvery
+{
+    RecordEvery(Recorder *recorder, const size_t& interval) : recorder(recorder), interval(interval) {}
+
+    template<typename StateType>
+    void operator()(const StateType& state, const size_t& step)
+    {
+        if(step % interval == 0) recorder->record(state, step);
+    }
+
+    Recorder *recorder; //this has no ownership
+    size_t interval;
+};
+
+
+
+
+template<LatticeType Lattice = LatticeType::Square,
+         typename UpdateRule = HeatBath,
+         typename ScanOrder = RandomScan,
+         typename Rng = std::mt19937,
+         typename Terms = NearestNeighbor,
+         typename... Observers>
+class Engine
+{
+public:
+    using Stencil = LatticeStencil<Lattice>;
+
+    /* 表の添字: 最近接の和 (Anisotropic なら横と縦の組) と次近接の和 */
+    static constexpr int zx = Stencil::horizontalCount();
+    static constexpr int zy = Stencil::z;
+    static constexpr int nearestSize = (Terms::anisotropic) ? (2 * zx + 1) * (2 * zy + 1) : 2 * Stencil::z + 1;
+    static constexpr int z2 = [](){ if constexpr(Terms::nextNearest) return NextNearestGeometry<Lattice>::z; else return 0; }();
+    static constexpr int tableSize = nearestSize * (2 * z2 + 1);
+
+    explicit Engine(IsingModel *ising, Observers... observers)
+        : ising(ising)
+        , _rng(std::random_device()())
+        , observers(observers...) {}
+
+    template<size_t N, size_t M>
+    void update(State<N, M, bool>& state) noexcept
+    {
+        static_assert(N > 2 && M > 2, "lattice is too small");
+
+        prepare();
+
+        size_t row, col;
+        scan.next(N - 1, M - 1, _rng, row, col);
+
+        const bool value = rand01(_rng) < table[state.at(row, col)][localIndex(state, row, col)];
+
+        Stencil::setSpin(state, row, col, value);
+
+        ++_step;
+        std::apply([&](auto&... observer){ (observer(state, _step), ...); }, observers);
+    }
+
+    template<size_t stepCount, size_t N, size_t M>
+    void optimize(State<N, M, bool>& state) noexcept
+    {
+        for(size_t i = 0; i < stepCount; ++i) update(state);
+    }
+
+    /* 格子のサイト数だけ更新する */
+    template<size_t N, size_t M>
+    void sweep(State<N, M, bool>& state) noexcept
+    {
+        for(size_t i = 0; i < (N - 1) * (M - 1); ++i) update(state);
+    }
+
+    template<size_t N, size_t M>
+    double energy(const State<N, M, bool>& state) const noexcept
+    {
+        if constexpr(!Terms::field && !Terms::anisotropic && !Terms::nextNearest)
+        {
+            return Stencil::energy(state, ising->param.J);
+        }
+        else
+        {
+            //ボンドは両端から2回数えるので半分にする
+            double energy = 0.0;
+            for(size_t r = 0; r < N - 1; ++r)
+                for(size_t c = 0; c < M - 1; ++c)
+                {
+                    const double spin = (state.at(r, c)) ? 1.0 : -1.0;
+                    energy -= spin * (0.5 * nearestField(state, r, c) + ((Terms::field) ? ising->param.h : 0.0));
+                    if constexpr(Terms::nextNearest) energy -= 0.5 * ising->param.J2 * spin * Stencil::nextNearestSpin(state, r, c);
+                }
+            return energy;
+        }
+    }
+
+    size_t step() const noexcept { return _step; }
+    Rng& rng() noexcept { return _rng; }
+    void setSeed(const unsigned int& seed) { _rng.seed(seed); }
+
+    template<size_t I>
+    auto& observer() noexcept { return std::get<I>(observers); }
+
+private:
+    /* 最近接の結合からの局所場 (energy 用) */
+    template<size_t N, size_t M>
+    double nearestField(const State<N, M, bool>& state, const size_t& row, const size_t& col) const noexcept
+    {
+        if constexpr(Terms::anisotropic)
+        {
+            int horizontal, vertical;
+            Stencil::neighborSpin(state, row, col, horizontal, vertical);
+            return ising->param.Jx * horizontal + ising->param.Jy * vertical;
+        }
+        else
+        {
+            return ising->param.J * Stencil::neighborSpin(state, row, col);
+        }
+    }
+
+    /* 遷移確率の表の添字．NearestNeighbor では最近接の和 + z だけ */
+    template<size_t N, size_t M>
+    int localIndex(const State<N, M, bool>& state, const size_t& row, const size_t& col) const noexcept
+    {
+        int index;
+        if constexpr(Terms::anisotropic)
+        {
+            int horizontal, vertical;
+            Stencil::neighborSpin(state, row, col, horizontal, vertical);
+            index = (horizontal + zx) * (2 * zy + 1) + vertical + zy;
+        }
+        else
+        {
+            index = Stencil::neighborSpin(state, row, col) + Stencil::z;
+        }
+
+        if constexpr(Terms::nextNearest) index = index * (2 * z2 + 1) + Stencil::nextNearestSpin(state, row, col) + z2;
+        return index;
+    }
+
+    /* 温度と結合・外場が変わっていれば遷移確率の表を作り直す */
+    void prepare() noexcept
+    {
+        const IsingModel::Parameter& p = ising->param;
+        const double kbT = ising->kbT();
+        const double J = p.J;
+        const double Jx = (Terms::anisotropic) ? p.Jx : 0.0;
+        const double Jy = (Terms::anisotropic) ? p.Jy : 0.0;
+        const double J2 = (Terms::nextNearest) ? p.J2 : 0.0;
+        const double h = (Terms::field) ? p.h : 0.0;
+        if(J == tableJ && kbT == tableKbT && Jx == tableJx && Jy == tableJy && J2 == tableJ2 && h == tableH) return;
+
+        for(int index = 0; index < tableSize; ++index)
+        {
+            const int nearest = index / (2 * z2 + 1);
+            const int next = index % (2 * z2 + 1) - z2;
+
+            double energy = J2 * next + h;
+            if constexpr(Terms::anisotropic) energy += Jx * (nearest / (2 * zy + 1) - zx) + Jy * (nearest % (2 * zy + 1) - zy);
+            else energy += J * (nearest - Stencil::z);
+
+            //T = 0 でも局所場が 0 なら 0 / 0 にならないようにする
+            const double x = (energy == 0.0) ? 0.0 : energy / kbT;
+            table[0][index] = UpdateRule::upProbability(-1, x);
+            table[1][index] = UpdateRule::upProbability(1, x);
+        }
+
+        tableJ = J;
+        tableKbT = kbT;
+        tableJx = Jx;
+        tableJy = Jy;
+        tableJ2 = J2;
+        tableH = h;
+    }
+
+    IsingModel *ising; //this has no ownership
+    Rng _rng;
+    ScanOrder scan;
+    std::tuple<Observers...> observers;
+    std::uniform_real_distribution<> rand01 = std::uniform_real_distribution<>(0.0, 1.0);
+
+    double table[2][tableSize];
+    double tableJ = std::numeric_limits<double>::quiet_NaN();
+    double tableKbT = std::numeric_limits<double>::quiet_NaN();
+    double tableJx = 0.0;
+    double tableJy = 0.0;
+    double tableJ2 = 0.0;
+    double tableH = 0.0;
+    size_t _step = 0;
+};
+
+} //namespace MonteCarlo
+
+#endif // MONTECARLO_H
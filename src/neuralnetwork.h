@@ -1,6 +1,7 @@
 #ifndef NEURALNETWORK_H
 #define NEURALNETWORK_H
 
+#include "mathutil.h"
 #include <vector>
 #include <random>
 #include <cassert>
@@ -10,6 +11,8 @@
 #include <fstream>
 #include <iostream>
 #include <numeric>
+#include <cmath>
+#include <cstdint>
 
 
 namespace nn
@@ -150,6 +153,11 @@ public:
     virtual void init() = 0;
     virtual void update() = 0;
     virtual void reset() = 0;
+    virtual LayerType layerType() const = 0;
+
+    /* 学習済みパラメータの保存と読み込み */
+    virtual void save(std::ostream&) const {}
+    virtual bool load(std::istream&) { return true; }
 
     virtual void setDataCount(const size_t& dataCount)
     {
@@ -279,6 +287,21 @@ public:
                 backwardOut[i][j] = 0.0;
         }
     }
+    LayerType layerType() const override { return LayerType::AffineLayer; }
+    void save(std::ostream& out) const override
+    {
+        for(const auto& row : W)
+            for(const auto& w : row) out << w << ' ';
+        for(const auto& v : b) out << v << ' ';
+        out << '\n';
+    }
+    bool load(std::istream& in) override
+    {
+        for(auto& row : W)
+            for(auto& w : row) in >> w;
+        for(auto& v : b) in >> v;
+        return !in.fail();
+    }
 
 public:
     const vec2d* x;
@@ -330,6 +353,7 @@ public:
     void init() override {}
     void update() override {}
     void reset() override {}
+    LayerType layerType() const override { return LayerType::ReLULayer; }
 
 private:
     const vec2d* x;
@@ -368,6 +392,7 @@ public:
     void init() override {}
     void update() override {}
     void reset() override {}
+    LayerType layerType() const override { return LayerType::SigmoidLayer; }
 };
 
 class TanhExpLayer : public Layer
@@ -419,6 +444,7 @@ public:
     void init() override {}
     void update() override {}
     void reset() override {}
+    LayerType layerType() const override { return LayerType::TanhExpLayer; }
 
 private:
     const vec2d *mask;
@@ -487,6 +513,9 @@ public:
     void init() override {}
     void update() override {}
     void reset() override {}
+    LayerType layerType() const override { return LayerType::DropOutLayer; }
+    void save(std::ostream& out) const override { out << ratio << '\n'; }
+    bool load(std::istream& in) override { in >> ratio; return !in.fail(); }
     void setDataCount(const size_t& dataCount) override
     {
         mask.resize(dataCount, vec1d(_backwardOutSize));
@@ -641,6 +670,19 @@ public:
         std::fill(dgamma.begin(), dgamma.end(), 0);
         std::fill(dbeta.begin(), dbeta.end(), 0);
     }
+    LayerType layerType() const override { return LayerType::BatchNormLayer; }
+    void save(std::ostream& out) const override
+    {
+        for(const vec1d *v : { &gamma, &beta, &meanMemory, &varianceMemory })
+            for(const auto& value : *v) out << value << ' ';
+        out << '\n';
+    }
+    bool load(std::istream& in) override
+    {
+        for(vec1d *v : { &gamma, &beta, &meanMemory, &varianceMemory })
+            for(auto& value : *v) in >> value;
+        return !in.fail();
+    }
     void setDataCount(const size_t& dataCount) override
     {
         xc.resize(dataCount, vec1d(_backwardOutSize));
@@ -719,6 +761,7 @@ public:
     void init() override {}
     void update() override {}
     void reset() override {}
+    LayerType layerType() const override { return LayerType::SoftmaxLayer; }
 
 };
 
@@ -770,6 +813,62 @@ public:
     size_t labelSize() const { return _labelSize; }
     const std::vector<Layer*>& layers() const { return _layers; }
 
+    /* レイヤの構成と学習済みパラメータを保存する．
+     * 1行目: elemSize,labelSize,レイヤ数 / 以降: レイヤごとに "種類 出力数" の行とパラメータの行
+     */
+    bool save(const std::string& path) const
+    {
+        std::ofstream fout;
+        fout.open(path, std::ios::out);
+        if(!fout) return false;
+
+        fout.precision(17);
+        fout << _elemSize << ',' << _labelSize << ',' << _layers.size() << '\n';
+
+        for(const auto& layer : _layers)
+        {
+            fout << static_cast<int>(layer->layerType()) << ' ' << layer->forwardOutSize() << '\n';
+            layer->save(fout);
+        }
+
+        return fout.good();
+    }
+
+    /* save() で保存したネットワークを作成する．読み込めなかった場合は nullptr (所有権は呼び出し側) */
+    static NetworkModel *load(const std::string& path)
+    {
+        std::ifstream fin;
+        fin.open(path, std::ios::in);
+        if(!fin) return nullptr;
+
+        size_t elemSize = 0, labelSize = 0, layerCount = 0;
+        char comma;
+        fin >> elemSize >> comma >> labelSize >> comma >> layerCount;
+        if(!fin || elemSize == 0) return nullptr;
+
+        NetworkModel *model = new NetworkModel(elemSize, labelSize);
+
+        for(size_t i = 0; i < layerCount; ++i)
+        {
+            int type = 0;
+            size_t numNodes = 0;
+            fin >> type >> numNodes;
+
+            const size_t prevCount = model->_layers.size();
+            if(fin) model->addLayer(static_cast<Layer::LayerType>(type), numNodes);
+
+            if(!fin || model->_layers.size() == prevCount ||
+               model->_layers.back()->forwardOutSize() != numNodes ||
+               !model->_layers.back()->load(fin))
+            {
+                delete model;
+                return nullptr;
+            }
+        }
+
+        return model;
+    }
+
 private:
     const size_t _elemSize;
     const size_t _labelSize;
@@ -1057,6 +1156,316 @@ private:
 
 
 
+/* 制限ボルツマンマシン (可視層 v ∈ {0,1}^V，隠れ層 h ∈ {0,1}^H)．
+ *   E(v, h) = - a・v - b・h - v^T W h
+ * 学習はコントラスティブ・ダイバージェンス (CD-k) か，鎖を学習の間保持する persistent CD で行う．
+ *
+ * 可視層と隠れ層はビットに詰めて持つ．ユニットが 0/1 なので W v は立っているビットの行の和になり，
+ * 行 (連続した領域) の足し算だけでブロックギブスサンプリングができる．そのために W を2つの並び
+ * (可視ユニットごとの行 W と隠れユニットごとの行 Wt) で持ち，更新のたびに転置をそろえる．
+ * 学習したあとは sample() で近似的な平衡配位を作る生成モデルとして使う．
+ */
+class RBM
+{
+public:
+    RBM(const size_t& visibleCount, const size_t& hiddenCount)
+        : V(visibleCount)
+        , H(hiddenCount)
+        , W(V * H, 0.0)
+        , Wt(H * V, 0.0)
+        , a(V, 0.0)
+        , b(H, 0.0)
+        , hiddenPre(H)
+        , visiblePre(V) {}
+
+    size_t visibleCount() const { return V; }
+    size_t hiddenCount() const { return H; }
+    size_t visibleWords() const { return (V + 63) / 64; }
+    size_t hiddenWords() const { return (H + 63) / 64; }
+
+    void setLearningRate(const double& lr) { this->lr = lr; }
+    void setWeightDecay(const double& decay) { weightDecay = decay; }
+    void setGibbsStepCount(const size_t& k) { gibbsStepCount = std::max<size_t>(k, 1); }
+    void setPersistent(const bool& persistent) { this->persistent = persistent; }
+    void setSeed(const uint64_t& seed) { mt.seed(seed); }
+
+    void init()
+    {
+        std::normal_distribution<> dist(0.0, 0.01);
+        for(auto& w : W) w = dist(mt);
+        std::fill(a.begin(), a.end(), 0.0);
+        std::fill(b.begin(), b.end(), 0.0);
+        transpose();
+        chains.clear();
+    }
+
+    /* 0/1 のベクトル (0.5 より大きければ1) をビットに詰める */
+    void pack(const vec1d& x, uint64_t *out) const
+    {
+        std::fill(out, out + visibleWords(), 0);
+        for(size_t j = 0; j < V; ++j)
+            if(x[j] > 0.5) out[j / 64] |= uint64_t(1) << (j % 64);
+    }
+
+    void unpack(const uint64_t *v, vec1d& x) const
+    {
+        x.resize(V);
+        for(size_t j = 0; j < V; ++j) x[j] = static_cast<double>((v[j / 64] >> (j % 64)) & 1);
+    }
+
+    /* data (1サンプル visibleWords() ワード) を batchSize ずつ epochCount 周学習する．
+     * 最後の周の再構成誤差 (1ステップのギブスサンプリングで変わったユニットの割合) を返す．
+     */
+    double train(const std::vector<uint64_t>& data, const size_t& epochCount, const size_t& batchSize = 20)
+    {
+        const size_t words = visibleWords();
+        const size_t count = data.size() / words;
+        if(count == 0) return 0.0;
+
+        const size_t batch = std::min(std::max<size_t>(batchSize, 1), count);
+        if(persistent && chains.size() != batch * words) initChains(batch);
+
+        std::vector<size_t> indexes(count);
+        std::iota(indexes.begin(), indexes.end(), 0);
+
+        vec1d dW(V * H), da(V), db(H), ph(H);
+        std::vector<uint64_t> v(words), h(hiddenWords());
+        double error = 0.0;
+
+        for(size_t epoch = 0; epoch < epochCount; ++epoch)
+        {
+            std::shuffle(indexes.begin(), indexes.end(), mt);
+            size_t flipped = 0;
+
+            for(size_t start = 0; start + batch <= count; start += batch)
+            {
+                std::fill(dW.begin(), dW.end(), 0.0);
+                std::fill(da.begin(), da.end(), 0.0);
+                std::fill(db.begin(), db.end(), 0.0);
+
+                for(size_t i = 0; i < batch; ++i)
+                {
+                    const uint64_t *x = data.data() + indexes[start + i] * words;
+
+                    //正の相: データ
+                    hiddenProbability(x, ph);
+                    accumulate(x, ph, dW, da, db, 1.0);
+
+                    //負の相: データ (CD) か保持している鎖 (PCD) から k ステップ
+                    uint64_t *chain = (persistent) ? chains.data() + i * words : v.data();
+                    if(!persistent) std::copy(x, x + words, chain);
+
+                    for(size_t step = 0; step < gibbsStepCount; ++step)
+                    {
+                        sampleHidden(chain, h.data());
+                        sampleVisible(h.data(), chain);
+                    }
+                    if(epoch + 1 == epochCount && !persistent)
+                        for(size_t w = 0; w < words; ++w) flipped += bitCount(chain[w] ^ x[w]);
+
+                    hiddenProbability(chain, ph);
+                    accumulate(chain, ph, dW, da, db, -1.0);
+                }
+
+                const double scale = lr / batch;
+                for(size_t k = 0; k < V * H; ++k) W[k] += scale * dW[k] - lr * weightDecay * W[k];
+                for(size_t j = 0; j < V; ++j) a[j] += scale * da[j];
+                for(size_t i = 0; i < H; ++i) b[i] += scale * db[i];
+                transpose();
+            }
+
+            if(epoch + 1 == epochCount)
+            {
+                if(persistent)
+                {
+                    //PCD では鎖はデータと関係ないので，データから1ステップで測る
+                    for(size_t i = 0; i < count; ++i)
+                    {
+                        const uint64_t *x = data.data() + i * words;
+                        sampleHidden(x, h.data());
+                        sampleVisible(h.data(), v.data());
+                        for(size_t w = 0; w < words; ++w) flipped += bitCount(v[w] ^ x[w]);
+                    }
+                    error = static_cast<double>(flipped) / (count * V);
+                }
+                else
+                    error = static_cast<double>(flipped) / ((count / batch) * batch * V);
+            }
+        }
+
+        return error;
+    }
+
+    double train(const vec2d& data, const size_t& epochCount, const size_t& batchSize = 20)
+    {
+        std::vector<uint64_t> packed(data.size() * visibleWords());
+        for(size_t i = 0; i < data.size(); ++i) pack(data[i], packed.data() + i * visibleWords());
+        return train(packed, epochCount, batchSize);
+    }
+
+    /* ランダムな可視層から stepCount 回のブロックギブスサンプリングをした count 個の配位 (ビットに詰めたもの) */
+    std::vector<uint64_t> sample(const size_t& count, const size_t& stepCount)
+    {
+        const size_t words = visibleWords();
+        std::vector<uint64_t> out(count * words);
+        std::vector<uint64_t> h(hiddenWords());
+
+        for(size_t i = 0; i < count; ++i)
+        {
+            uint64_t *v = out.data() + i * words;
+            randomVisible(v);
+            for(size_t step = 0; step < stepCount; ++step)
+            {
+                sampleHidden(v, h.data());
+                sampleVisible(h.data(), v);
+            }
+        }
+
+        return out;
+    }
+
+    /* 自由エネルギー F(v) = - a・v - Σ log(1 + exp(b_i + (W^T v)_i)) */
+    double freeEnergy(const uint64_t *v)
+    {
+        preHidden(v);
+
+        double f = 0.0;
+        forEachBit(v, V, [&](const size_t& j){ f -= a[j]; });
+        for(size_t i = 0; i < H; ++i)
+            f -= (hiddenPre[i] > 0.0) ? hiddenPre[i] + std::log1p(std::exp(-hiddenPre[i])) : std::log1p(std::exp(hiddenPre[i]));
+        return f;
+    }
+
+    void save(std::ostream& out) const
+    {
+        out << V << ' ' << H << '\n';
+        for(const auto& w : W) out << w << ' ';
+        for(const auto& v : a) out << v << ' ';
+        for(const auto& v : b) out << v << ' ';
+        out << '\n';
+    }
+    bool load(std::istream& in)
+    {
+        size_t visible = 0, hidden = 0;
+        in >> visible >> hidden;
+        if(!in || visible != V || hidden != H) return false;
+
+        for(auto& w : W) in >> w;
+        for(auto& v : a) in >> v;
+        for(auto& v : b) in >> v;
+        transpose();
+        return !in.fail();
+    }
+
+private:
+    /* 立っているビットの番号ごとに f(番号) を呼ぶ */
+    template<typename Func>
+    static void forEachBit(const uint64_t *words, const size_t& count, Func&& f)
+    {
+        for(size_t w = 0; w * 64 < count; ++w)
+            for(uint64_t bits = words[w]; bits != 0; bits &= bits - 1) f(w * 64 + lowestBit(bits));
+    }
+
+    static double sigmoid(const double& x) { return 1.0 / (1.0 + std::exp(-x)); }
+
+    /* [0, 1) の一様乱数 (53ビット) */
+    double random01() { return static_cast<double>(mt() >> 11) * (1.0 / 9007199254740992.0); }
+
+    void transpose()
+    {
+        for(size_t j = 0; j < V; ++j)
+            for(size_t i = 0; i < H; ++i) Wt[i * V + j] = W[j * H + i];
+    }
+
+    /* hiddenPre = b + W^T v (立っている可視ユニットの行の和) */
+    void preHidden(const uint64_t *v)
+    {
+        std::copy(b.begin(), b.end(), hiddenPre.begin());
+        forEachBit(v, V, [&](const size_t& j)
+        {
+            const double *w = W.data() + j * H;
+            for(size_t i = 0; i < H; ++i) hiddenPre[i] += w[i];
+        });
+    }
+
+    void hiddenProbability(const uint64_t *v, vec1d& ph)
+    {
+        preHidden(v);
+        for(size_t i = 0; i < H; ++i) ph[i] = sigmoid(hiddenPre[i]);
+    }
+
+    void sampleHidden(const uint64_t *v, uint64_t *h)
+    {
+        preHidden(v);
+        std::fill(h, h + hiddenWords(), 0);
+        for(size_t i = 0; i < H; ++i)
+            if(random01() < sigmoid(hiddenPre[i])) h[i / 64] |= uint64_t(1) << (i % 64);
+    }
+
+    /* visiblePre = a + W h (立っている隠れユニットの行の和) から v をサンプリングする */
+    void sampleVisible(const uint64_t *h, uint64_t *v)
+    {
+        std::copy(a.begin(), a.end(), visiblePre.begin());
+        forEachBit(h, H, [&](const size_t& i)
+        {
+            const double *w = Wt.data() + i * V;
+            for(size_t j = 0; j < V; ++j) visiblePre[j] += w[j];
+        });
+
+        std::fill(v, v + visibleWords(), 0);
+        for(size_t j = 0; j < V; ++j)
+            if(random01() < sigmoid(visiblePre[j])) v[j / 64] |= uint64_t(1) << (j % 64);
+    }
+
+    /* 勾配 <v h^T> などに sign × (v, ph) を加える */
+    void accumulate(const uint64_t *v, const vec1d& ph, vec1d& dW, vec1d& da, vec1d& db, const double& sign) const
+    {
+        forEachBit(v, V, [&](const size_t& j)
+        {
+            double *d = dW.data() + j * H;
+            for(size_t i = 0; i < H; ++i) d[i] += sign * ph[i];
+            da[j] += sign;
+        });
+        for(size_t i = 0; i < H; ++i) db[i] += sign * ph[i];
+    }
+
+    void randomVisible(uint64_t *v)
+    {
+        for(size_t w = 0; w < visibleWords(); ++w) v[w] = mt();
+        if(V % 64 != 0) v[visibleWords() - 1] &= (uint64_t(1) << (V % 64)) - 1;
+    }
+
+    void initChains(const size_t& count)
+    {
+        chains.assign(count * visibleWords(), 0);
+        for(size_t i = 0; i < count; ++i) randomVisible(chains.data() + i * visibleWords());
+    }
+
+    const size_t V;
+    const size_t H;
+
+    vec1d W;   //[可視][隠れ]
+    vec1d Wt;  //[隠れ][可視]
+    vec1d a;
+    vec1d b;
+
+    vec1d hiddenPre;
+    vec1d visiblePre;
+    std::vector<uint64_t> chains;  //persistent CD の鎖
+
+    double lr = 0.01;
+    double weightDecay = 1e-4;
+    size_t gibbsStepCount = 1;
+    bool persistent = true;
+
+    std::mt19937_64 mt = std::mt19937_64(std::random_device()());
+};
+
+
+
+
+
+
 } //namespace nn
 
 
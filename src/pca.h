@@ -0,0 +1,385 @@
+#ifndef PCA_H
+#define PCA_H
+
+#include "mathutil.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/* IOVector::writeVec2d の形式 (1行目に "rows,cols"，2行目にすべての値をカンマ区切り) のファイルを
+ * 1行 (1サンプル) ずつ読む．vec2d を作らないので，大きなデータセットでも使うメモリは1行分．
+ */
+class DatasetReader
+{
+public:
+    explicit DatasetReader(const std::string& path)
+        : fin(path, std::ios::in | std::ios::binary)
+        , buffer(1 << 20)
+    {
+        std::string header;
+        if(!std::getline(fin, header)) return;
+
+        const size_t comma = header.find(',');
+        if(comma == std::string::npos) return;
+        _rows = std::strtoull(header.c_str(), nullptr, 10);
+        _cols = std::strtoull(header.c_str() + comma + 1, nullptr, 10);
+    }
+
+    bool isOpen() const noexcept { return _cols > 0; }
+    size_t rows() const noexcept { return _rows; }
+    size_t cols() const noexcept { return _cols; }
+
+    /* 次の1行 (cols 個の値) を row に読む．もう行がなければ false */
+    bool next(double *row)
+    {
+        if(read >= _rows || !isOpen()) return false;
+
+        for(size_t j = 0; j < _cols; ++j)
+        {
+            token.clear();
+            while(true)
+            {
+                if(position == filled && !fill()) break;
+
+                const char c = buffer[position++];
+                if(c == ',') break;
+                if(c == '\n' || c == '\r') continue;
+                token.push_back(c);
+            }
+            if(token.empty()) return false;
+
+            token.push_back('\0');
+            row[j] = std::strtod(token.data(), nullptr);
+        }
+
+        ++read;
+        return true;
+    }
+
+private:
+    bool fill()
+    {
+        fin.read(buffer.data(), buffer.size());
+        filled = static_cast<size_t>(fin.gcount());
+        position = 0;
+        return filled > 0;
+    }
+
+    std::ifstream fin;
+    std::vector<char> buffer;
+    std::vector<char> token;
+    size_t position = 0;
+    size_t filled = 0;
+    size_t _rows = 0;
+    size_t _cols = 0;
+    size_t read = 0;
+};
+
+
+/* スピン配位のデータセットの主成分分析 (ニューラルネットワークの分類器と比べるための教師なしの方法)．
+ * 共分散行列 C (次元 d×d) は作らず，乱択の部分空間反復で上位の主成分を求める:
+ *
+ *   1. d×l (l = 成分数 + oversampling) の乱数行列 Z を正規直交化する
+ *   2. データを1回読むごとに W = C Z = Σ (x - μ)(x - μ)^T Z / n を計算し，W を正規直交化して Z とする
+ *   3. 最後の回では H = Z^T C Z (l×l) をヤコビ法で対角化し，Z の張る空間での固有ベクトルを主成分とする
+ *
+ * 1回の読み込みではサンプルを batchSize 行ずつまとめ，行をスレッドに分けて x (x^T Z) を積算する．
+ * 平均 μ は最初の読み込みで同時に求め，Σ x x^T Z - n μ (μ^T Z) として中心化する．
+ * データは1行ずつ読むだけなので，使うメモリは O(d l) で，データの大きさによらない．
+ * イジング模型では第1主成分はほぼ一様なベクトルになり，その射影が磁化に比例する秩序変数になる．
+ */
+class RandomizedPCA
+{
+public:
+    RandomizedPCA(const size_t& componentCount = 4,
+                  const size_t& oversampling = 8,
+                  const size_t& powerIterations = 2,
+                  const size_t& threadCount = std::thread::hardware_concurrency(),
+                  const uint64_t& seed = 0x853c49e6748fea9bULL)
+        : k(std::max<size_t>(componentCount, 1))
+        , l(k + oversampling)
+        , iterations(powerIterations)
+        , threadCount(std::max<size_t>(threadCount, 1))
+        , seed(seed) {}
+
+    /* shards のファイルをまとめて1つのデータセットとして主成分を求める．次元が揃っていなければ false */
+    bool fit(const std::vector<std::string>& shards)
+    {
+        d = 0;
+        for(const auto& path : shards)
+        {
+            const DatasetReader reader(path);
+            if(!reader.isOpen()) return false;
+            if(d != 0 && reader.cols() != d) return false;
+            d = reader.cols();
+        }
+        if(d == 0) return false;
+
+        const size_t width = std::min(l, d);
+
+        std::mt19937_64 mt(seed);
+        std::normal_distribution<> gauss;
+        std::vector<double> z(d * width);
+        for(auto& value : z) value = gauss(mt);
+        orthonormalize(z, width);
+
+        std::vector<double> w;
+        for(size_t iteration = 0; iteration <= iterations; ++iteration)
+        {
+            if(!multiply(shards, z, width, w, iteration == 0)) return false;
+            if(iteration < iterations)
+            {
+                z = w;
+                orthonormalize(z, width);
+            }
+        }
+
+        //H = Z^T C Z
+        std::vector<double> h(width * width, 0.0);
+        for(size_t i = 0; i < d; ++i)
+            for(size_t a = 0; a < width; ++a)
+                for(size_t b = 0; b < width; ++b) h[a * width + b] += z[i * width + a] * w[i * width + b];
+        for(size_t a = 0; a < width; ++a)
+            for(size_t b = a + 1; b < width; ++b) h[a * width + b] = h[b * width + a] = 0.5 * (h[a * width + b] + h[b * width + a]);
+
+        std::vector<double> values, vectors;
+        jacobiEigen(h, width, values, vectors);
+
+        const size_t count = std::min(k, width);
+        _variances.assign(values.begin(), values.begin() + count);
+        _components.assign(count * d, 0.0);
+        for(size_t c = 0; c < count; ++c)
+            for(size_t i = 0; i < d; ++i)
+            {
+                double value = 0.0;
+                for(size_t a = 0; a < width; ++a) value += z[i * width + a] * vectors[c * width + a];
+                _components[c * d + i] = value;
+            }
+
+        //符号は平均的な成分が正になる向きにそろえる
+        for(size_t c = 0; c < count; ++c)
+        {
+            double sum = 0.0;
+            for(size_t i = 0; i < d; ++i) sum += _components[c * d + i];
+            if(sum < 0.0)
+                for(size_t i = 0; i < d; ++i) _components[c * d + i] = -_components[c * d + i];
+        }
+
+        return true;
+    }
+
+    size_t dimension() const noexcept { return d; }
+    size_t componentCount() const noexcept { return _variances.size(); }
+    size_t sampleCount() const noexcept { return n; }
+
+    const std::vector<double>& mean() const noexcept { return _mean; }
+
+    /* c 番目の主成分 (長さ1，次元 d) */
+    const double *component(const size_t& c) const noexcept { return _components.data() + c * d; }
+
+    /* c 番目の主成分の分散 (共分散行列の固有値) と，全分散に対する割合 */
+    double explainedVariance(const size_t& c) const noexcept { return _variances[c]; }
+    double explainedVarianceRatio(const size_t& c) const noexcept
+    {
+        return (totalVariance > 0.0) ? _variances[c] / totalVariance : 0.0;
+    }
+
+    /* (x - μ) の各主成分への射影を out[0..componentCount) に入れる */
+    void project(const double *x, double *out) const noexcept
+    {
+        for(size_t c = 0; c < componentCount(); ++c)
+        {
+            double value = 0.0;
+            for(size_t i = 0; i < d; ++i) value += (x[i] - _mean[i]) * _components[c * d + i];
+            out[c] = value;
+        }
+    }
+
+    std::vector<double> project(const std::vector<double>& x) const
+    {
+        std::vector<double> out(componentCount());
+        if(x.size() == d) project(x.data(), out.data());
+        return out;
+    }
+
+private:
+    static constexpr size_t batchSize = 512;
+
+    /* データを1回読んで w = C z を求める．first なら平均と全分散も求める */
+    bool multiply(const std::vector<std::string>& shards,
+                  const std::vector<double>& z,
+                  const size_t& width,
+                  std::vector<double>& w,
+                  const bool& first)
+    {
+        struct Accumulator
+        {
+            std::vector<double> w;
+            std::vector<double> sum;
+            std::vector<double> square;
+            std::vector<double> t;
+        };
+
+        std::vector<Accumulator> accumulators(threadCount);
+        for(auto& a : accumulators)
+        {
+            a.w.assign(d * width, 0.0);
+            a.t.assign(width, 0.0);
+            if(first)
+            {
+                a.sum.assign(d, 0.0);
+                a.square.assign(d, 0.0);
+            }
+        }
+
+        std::vector<double> batch(batchSize * d);
+        size_t count = 0;
+
+        for(const auto& path : shards)
+        {
+            DatasetReader reader(path);
+            while(true)
+            {
+                size_t rows = 0;
+                while(rows < batchSize && reader.next(batch.data() + rows * d)) ++rows;
+                if(rows == 0) break;
+                count += rows;
+
+                parallelFor(rows, [&](const size_t& thread, const size_t& begin, const size_t& end)
+                {
+                    Accumulator& a = accumulators[thread];
+                    for(size_t r = begin; r < end; ++r)
+                    {
+                        const double *x = batch.data() + r * d;
+
+                        //t = z^T x，w += x t^T．0/1 のスピンでは 0 の成分を飛ばせる
+                        std::fill(a.t.begin(), a.t.end(), 0.0);
+                        for(size_t i = 0; i < d; ++i)
+                        {
+                            if(x[i] == 0.0) continue;
+                            const double *zi = z.data() + i * width;
+                            for(size_t j = 0; j < width; ++j) a.t[j] += x[i] * zi[j];
+                        }
+                        for(size_t i = 0; i < d; ++i)
+                        {
+                            if(x[i] == 0.0) continue;
+                            double *wi = a.w.data() + i * width;
+                            for(size_t j = 0; j < width; ++j) wi[j] += x[i] * a.t[j];
+                        }
+
+                        if(first)
+                            for(size_t i = 0; i < d; ++i)
+                            {
+                                a.sum[i] += x[i];
+                                a.square[i] += x[i] * x[i];
+                            }
+                    }
+                });
+
+                if(rows < batchSize) break;
+            }
+        }
+        if(count == 0) return false;
+
+        w.assign(d * width, 0.0);
+        for(const auto& a : accumulators)
+            for(size_t i = 0; i < d * width; ++i) w[i] += a.w[i];
+
+        if(first)
+        {
+            n = count;
+            _mean.assign(d, 0.0);
+            totalVariance = 0.0;
+            for(size_t i = 0; i < d; ++i)
+            {
+                double sum = 0.0, square = 0.0;
+                for(const auto& a : accumulators)
+                {
+                    sum += a.sum[i];
+                    square += a.square[i];
+                }
+                _mean[i] = sum / n;
+                totalVariance += square / n - _mean[i] * _mean[i];
+            }
+        }
+
+        //中心化: C z = (Σ x x^T z - n μ (μ^T z)) / n
+        std::vector<double> muZ(width, 0.0);
+        for(size_t i = 0; i < d; ++i)
+            for(size_t j = 0; j < width; ++j) muZ[j] += _mean[i] * z[i * width + j];
+
+        for(size_t i = 0; i < d; ++i)
+            for(size_t j = 0; j < width; ++j) w[i * width + j] = w[i * width + j] / n - _mean[i] * muZ[j];
+
+        return true;
+    }
+
+    /* d×width の行列の列を修正グラム・シュミット法で正規直交化する (精度のために2回行う) */
+    void orthonormalize(std::vector<double>& a, const size_t& width) const
+    {
+        for(size_t repeat = 0; repeat < 2; ++repeat)
+            for(size_t j = 0; j < width; ++j)
+            {
+                for(size_t p = 0; p < j; ++p)
+                {
+                    double dot = 0.0;
+                    for(size_t i = 0; i < d; ++i) dot += a[i * width + p] * a[i * width + j];
+                    for(size_t i = 0; i < d; ++i) a[i * width + j] -= dot * a[i * width + p];
+                }
+
+                double norm = 0.0;
+                for(size_t i = 0; i < d; ++i) norm += a[i * width + j] * a[i * width + j];
+                norm = std::sqrt(norm);
+
+                //退化した列は単位ベクトルで置き換える
+                if(norm < 1e-300)
+                {
+                    for(size_t i = 0; i < d; ++i) a[i * width + j] = (i == j % d) ? 1.0 : 0.0;
+                    continue;
+                }
+                for(size_t i = 0; i < d; ++i) a[i * width + j] /= norm;
+            }
+    }
+
+    /* [0, count) を threadCount 個の連続した区間に分けて f(thread, begin, end) を並列に呼ぶ */
+    template<typename Func>
+    void parallelFor(const size_t& count, Func&& f)
+    {
+        const size_t threads = std::min(threadCount, count);
+        if(threads <= 1)
+        {
+            f(0, 0, count);
+            return;
+        }
+
+        std::vector<std::thread> workers;
+        for(size_t t = 0; t < threads; ++t)
+        {
+            const size_t begin = count * t / threads;
+            const size_t end = count * (t + 1) / threads;
+            workers.emplace_back([&f, t, begin, end](){ f(t, begin, end); });
+        }
+        for(auto& worker : workers) worker.join();
+    }
+
+    size_t k;
+    size_t l;
+    size_t iterations;
+    size_t threadCount;
+    uint64_t seed;
+
+    size_t d = 0;
+    size_t n = 0;
+    double totalVariance = 0.0;
+    std::vector<double> _mean;
+    std::vector<double> _components;  //[成分][次元]
+    std::vector<double> _variances;
+};
+
+#endif // PCA_H
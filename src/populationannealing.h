@@ -0,0 +1,287 @@
+#ifndef POPULATIONANNEALING_H
+#define POPULATIONANNEALING_H
+
+#include "mathutil.h"
+#include "isingmodel.h"
+#include "montecarlo.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+
+/* ポピュレーション・アニーリング．
+ * 多数のレプリカを温度のスケジュールに沿って冷やしていく．温度を下げるたびに
+ * 各レプリカを Boltzmann 因子 exp(-(β' - β) E) で重み付けして複製・削除し (リサンプリング)，
+ * そのあと Engine で sweepCount 回ずつ走査する．
+ * 重みの平均から分配関数の比が求まるので，β = 0 (ln Z = サイト数 × ln 2) から積算して自由エネルギーも得られる．
+ *
+ * Engine は IsingModel* から作れて，sweep(state)・energy(state)・rng() を持つもの
+ * (MonteCarlo::Engine など)．ワーカースレッドごとに IsingModel と Engine を1つずつ持つ．
+ */
+template<size_t N, size_t M,
+         typename Engine = MonteCarlo::Engine<LatticeType::Square,
+                                              MonteCarlo::Metropolis,
+                                              MonteCarlo::CheckerboardScan,
+                                              MonteCarlo::Xoshiro256>>
+class PopulationAnnealing
+{
+public:
+    static_assert(N > 2 && M > 2, "lattice is too small");
+
+    using StateType = State<N, M, bool>;
+    static constexpr size_t siteCount = (N - 1) * (M - 1);
+
+    /* 各温度での観測値．値はすべて1サイトあたり */
+    struct Result
+    {
+        double T = 0.0;
+        double energy = 0.0;
+        double specificHeat = 0.0;
+        double magnetization = 0.0;   //<|m|>
+        double freeEnergy = 0.0;
+        size_t population = 0;
+        double familyCount = 0.0;     //同じ祖先を持つレプリカの集まりの実効的な数 exp(家系のエントロピー)
+    };
+
+    PopulationAnnealing(const IsingModel::Parameter& param,
+                        const size_t& population,
+                        const size_t& sweepCount = 10,
+                        const size_t& threadCount = std::thread::hardware_concurrency(),
+                        const uint64_t& seed = 0)
+        : targetPopulation(std::max<size_t>(population, 1))
+        , sweepCount(sweepCount)
+        , threadCount(std::max<size_t>(threadCount, 1))
+        , models(this->threadCount, IsingModel(param))
+    {
+        engines.reserve(this->threadCount);
+        for(size_t t = 0; t < this->threadCount; ++t)
+        {
+            engines.emplace_back(&models[t]);
+            engines[t].rng().seed(seed + 0x9e3779b97f4a7c15ULL * (t + 1));
+            resampleRngs.emplace_back(seed ^ (0xd1b54a32d192ed03ULL * (t + 1)));
+        }
+    }
+
+    //engines は models のアドレスを持つので，コピーもムーブもしない
+    PopulationAnnealing(const PopulationAnnealing&) = delete;
+    PopulationAnnealing& operator=(const PopulationAnnealing&) = delete;
+
+    /* temperatures の順に冷やし，各温度での観測値を返す．
+     * 初期配位はランダム (β = 0 の平衡状態) とし，最初の温度への重み付けも β = 0 から行う．
+     */
+    std::vector<Result> run(const std::vector<double>& temperatures)
+    {
+        //State の既定のコンストラクタはスピンを初期化しないので，初期化した配位を写す
+        StateType initial;
+        initial.init(false);
+        replicas.assign(targetPopulation, initial);
+        energies.assign(targetPopulation, 0.0);
+        families.resize(targetPopulation);
+
+        parallelFor(targetPopulation, [&](const size_t& t, const size_t& begin, const size_t& end)
+        {
+            std::uniform_int_distribution<int> randSpin(0, 1);
+            for(size_t i = begin; i < end; ++i)
+            {
+                for(size_t r = 0; r < N - 1; ++r)
+                    for(size_t c = 0; c < M - 1; ++c)
+                        LatticeStencil<LatticeType::Square>::setSpin(replicas[i], r, c, randSpin(resampleRngs[t]) == 1);
+                energies[i] = engines[t].energy(replicas[i]);
+                families[i] = i;
+            }
+        });
+
+        std::vector<Result> results;
+        double beta = 0.0;
+        double lnZ = siteCount * std::log(2.0);
+
+        for(const auto& T : temperatures)
+        {
+            const double nextBeta = 1.0 / (models[0].param.kb * T);
+
+            lnZ += resample(nextBeta - beta);
+            beta = nextBeta;
+
+            for(auto& model : models) model.param.T = T;
+            parallelFor(replicas.size(), [&](const size_t& t, const size_t& begin, const size_t& end)
+            {
+                for(size_t i = begin; i < end; ++i)
+                {
+                    for(size_t s = 0; s < sweepCount; ++s) engines[t].sweep(replicas[i]);
+                    energies[i] = engines[t].energy(replicas[i]);
+                }
+            });
+
+            results.push_back(measure(T, beta, lnZ));
+        }
+
+        return results;
+    }
+
+    const std::vector<StateType>& population() const noexcept { return replicas; }
+
+private:
+    /* [0, count) を threadCount 個の連続した区間に分けて f(thread, begin, end) を並列に呼ぶ */
+    template<typename Func>
+    void parallelFor(const size_t& count, Func&& f)
+    {
+        std::vector<std::thread> threads;
+        const size_t chunk = (count + threadCount - 1) / threadCount;
+
+        for(size_t t = 0; t < threadCount; ++t)
+        {
+            const size_t begin = std::min(count, t * chunk);
+            const size_t end = std::min(count, begin + chunk);
+            if(begin == end) break;
+
+            threads.emplace_back([&f, t, begin, end](){ f(t, begin, end); });
+        }
+        for(auto& thread : threads) thread.join();
+    }
+
+    /* Δβ だけ冷やすときの重みで複製数を決め，新しいポピュレーションを作る．ln(Z(β + Δβ) / Z(β)) を返す．
+     * 複製数は期待値 R0 w / Σw の整数部に，小数部の確率で1を足したもの．
+     * コピーは複製後の添字を均等に分けて並列に行うので，複製数に偏りがあっても各スレッドの仕事量は揃う．
+     */
+    double resample(const double& deltaBeta)
+    {
+        const size_t count = replicas.size();
+        const double minEnergy = *std::min_element(energies.begin(), energies.end());
+
+        std::vector<double> weights(count);
+        std::vector<double> partialSums(threadCount, 0.0);
+
+        //オーバーフローしないように最小のエネルギーからの差で重みを計算する
+        parallelFor(count, [&](const size_t& t, const size_t& begin, const size_t& end)
+        {
+            double sum = 0.0;
+            for(size_t i = begin; i < end; ++i)
+            {
+                weights[i] = std::exp(- deltaBeta * (energies[i] - minEnergy));
+                sum += weights[i];
+            }
+            partialSums[t] = sum;
+        });
+
+        double weightSum = 0.0;
+        for(const auto& sum : partialSums) weightSum += sum;
+
+        //各レプリカの複製数と，スレッドごとの複製数の合計
+        std::vector<size_t> copies(count);
+        std::vector<size_t> partialCounts(threadCount, 0);
+        const double scale = targetPopulation / weightSum;
+
+        parallelFor(count, [&](const size_t& t, const size_t& begin, const size_t& end)
+        {
+            std::uniform_real_distribution<> rand01(0.0, 1.0);
+            size_t sum = 0;
+            for(size_t i = begin; i < end; ++i)
+            {
+                const double expected = scale * weights[i];
+                const double base = std::floor(expected);
+                copies[i] = static_cast<size_t>(base) + ((rand01(resampleRngs[t]) < expected - base) ? 1 : 0);
+                sum += copies[i];
+            }
+            partialCounts[t] = sum;
+        });
+
+        //複製後の先頭位置 (累積和)
+        std::vector<size_t> offsets(count + 1, 0);
+        {
+            std::vector<size_t> chunkOffsets(threadCount + 1, 0);
+            for(size_t t = 0; t < threadCount; ++t) chunkOffsets[t + 1] = chunkOffsets[t] + partialCounts[t];
+
+            parallelFor(count, [&](const size_t& t, const size_t& begin, const size_t& end)
+            {
+                size_t offset = chunkOffsets[t];
+                for(size_t i = begin; i < end; ++i)
+                {
+                    offsets[i] = offset;
+                    offset += copies[i];
+                }
+            });
+            offsets[count] = chunkOffsets[threadCount];
+        }
+
+        const size_t nextCount = offsets[count];
+        if(nextCount == 0) return std::log(weightSum / count) - deltaBeta * minEnergy;
+
+        std::vector<StateType> nextReplicas(nextCount);
+        std::vector<double> nextEnergies(nextCount);
+        std::vector<size_t> nextFamilies(nextCount);
+
+        parallelFor(nextCount, [&](const size_t&, const size_t& begin, const size_t& end)
+        {
+            //begin を含むレプリカを二分探索で探し，そこから順にコピーする
+            size_t i = std::upper_bound(offsets.begin(), offsets.end(), begin) - offsets.begin() - 1;
+            for(size_t k = begin; k < end; ++k)
+            {
+                while(offsets[i + 1] <= k) ++i;
+                nextReplicas[k] = replicas[i];
+                nextEnergies[k] = energies[i];
+                nextFamilies[k] = families[i];
+            }
+        });
+
+        replicas.swap(nextReplicas);
+        energies.swap(nextEnergies);
+        families.swap(nextFamilies);
+
+        return std::log(weightSum / count) - deltaBeta * minEnergy;
+    }
+
+    Result measure(const double& T, const double& beta, const double& lnZ) const
+    {
+        Result result;
+        result.T = T;
+        result.population = replicas.size();
+        result.freeEnergy = - lnZ / (beta * siteCount);
+
+        if(replicas.empty()) return result;
+
+        double e = 0.0, e2 = 0.0, m = 0.0;
+        for(size_t i = 0; i < replicas.size(); ++i)
+        {
+            e += energies[i];
+            e2 += energies[i] * energies[i];
+            m += std::abs(IsingModel::averageSpin(replicas[i]));
+        }
+        e /= replicas.size();
+        e2 /= replicas.size();
+
+        result.energy = e / siteCount;
+        result.specificHeat = beta * beta * (e2 - e * e) / siteCount;
+        result.magnetization = m / replicas.size();
+
+        //家系ごとのレプリカ数の割合 ν から exp(-Σ ν ln ν)
+        std::vector<size_t> sorted(families);
+        std::sort(sorted.begin(), sorted.end());
+        double entropy = 0.0;
+        for(size_t i = 0; i < sorted.size();)
+        {
+            size_t j = i;
+            while(j < sorted.size() && sorted[j] == sorted[i]) ++j;
+            const double nu = static_cast<double>(j - i) / sorted.size();
+            entropy -= nu * std::log(nu);
+            i = j;
+        }
+        result.familyCount = std::exp(entropy);
+
+        return result;
+    }
+
+    size_t targetPopulation;
+    size_t sweepCount;
+    size_t threadCount;
+
+    std::vector<IsingModel> models;
+    std::vector<Engine> engines;
+    std::vector<MonteCarlo::Xoshiro256> resampleRngs;
+
+    std::vector<StateType> replicas;
+    std::vector<double> energies;
+    std::vector<size_t> families; //初期ポピュレーションでの祖先の番号
+};
+
+#endif // POPULATIONANNEALING_H
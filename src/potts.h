@@ -0,0 +1,332 @@
+#ifndef POTTS_H
+#define POTTS_H
+
+#include "mathutil.h"
+#include "montecarlo.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+
+/* q 状態 Potts 模型 H = - J Σ_(ij) δ(σ_i, σ_j)．σ_i = 0, ..., q - 1．
+ * q = 2 はイジング模型 (J_Ising = J / 2) で，正方格子では q ≤ 4 が2次転移，q ≥ 5 が1次転移．
+ */
+class PottsModel
+{
+public:
+    struct Parameter
+    {
+        int q = 3;
+        double J = 1.0;
+        double T = 1.0;
+        double kb = 1.0;
+    } param;
+
+    PottsModel() = default;
+    explicit PottsModel(const Parameter& param)
+        : param(param) {}
+
+    /* 正方格子の転移温度 kb Tc = J / ln(1 + √q) */
+    double Tc() const noexcept { return param.J / (param.kb * std::log(1.0 + std::sqrt(static_cast<double>(param.q)))); }
+    double kbT() const noexcept { return param.kb * param.T; }
+};
+
+
+/* 正方格子 L×L (L は偶数，周期境界) の Potts 模型のモンテカルロ法．
+ *
+ * スピンは uint8_t で持ち，VectorSpin と同じようにチェッカーボードの2つの副格子に分けて並べる．
+ * 色 a のサイト (r, c) は (a, r, c / 2) にあり，1行の同じ色のサイトの4つの隣は
+ * 上下の行の同じ k と，同じ行の k と k ∓ 1 になる．
+ *
+ * 熱浴法の条件付き確率 p(σ) ∝ exp(K n_σ) (n_σ は色 σ の隣の数，K = J / kb T) は
+ * サイトごとの n_σ の最大 n_max (K < 0 なら最小) で割った exp(K (n - n_max)) の 5×5 の表から引くので，
+ * 指数関数は温度を変えたときだけ計算する．各サイトの最大の重みが 1 になるので，低温でも重みの和は 0 にならない．
+ * 1行分のサイトについて色ごとに n_σ と累積の重みを求め，累積が u W 以下の色の数を数えて新しい色にする．
+ * どのループも分岐がなく uint8_t の比較なので，コンパイラが SIMD 化できる．
+ *
+ *   PottsModel potts({ 5, 1.0, 0.8 });
+ *   Potts::Lattice lattice(128);
+ *   Potts::Engine engine(&potts);
+ *   engine.heatBathSweep(lattice);
+ *   engine.swendsenWang(lattice);
+ */
+namespace Potts
+{
+
+class Lattice
+{
+public:
+    explicit Lattice(const size_t& L)
+        : L(L)
+        , half(L / 2)
+        , spins(L * L, 0) {}
+
+    /* すべてのスピンを色 color にそろえる */
+    void init(const uint8_t& color = 0) { std::fill(spins.begin(), spins.end(), color); }
+
+    /* 各スピンを q 色から一様に選ぶ */
+    template<typename Rng>
+    void initRand(Rng& rng, const int& q)
+    {
+        std::uniform_int_distribution<int> dist(0, q - 1);
+        for(auto& s : spins) s = static_cast<uint8_t>(dist(rng));
+    }
+
+    size_t size() const noexcept { return L; }
+    size_t siteCount() const noexcept { return L * L; }
+
+    /* サイト (r, c) の位置 */
+    size_t index(const size_t& r, const size_t& c) const noexcept
+    {
+        return (((r + c) & 1) * L + r) * half + c / 2;
+    }
+
+    uint8_t& at(const size_t& r, const size_t& c) noexcept { return spins[index(r, c)]; }
+    uint8_t at(const size_t& r, const size_t& c) const noexcept { return spins[index(r, c)]; }
+
+    /* 色 color の行 r (half 個) */
+    uint8_t* row(const size_t& color, const size_t& r) noexcept { return &spins[(color * L + r) * half]; }
+    const uint8_t* row(const size_t& color, const size_t& r) const noexcept { return &spins[(color * L + r) * half]; }
+
+    /* 色ごとのスピンの数 */
+    std::vector<size_t> histogram(const int& q) const
+    {
+        std::vector<size_t> counts(q, 0);
+        for(const auto& s : spins) counts[s]++;
+        return counts;
+    }
+
+private:
+    size_t L;
+    size_t half;
+    AlignedVector<uint8_t> spins;
+};
+
+
+class Engine
+{
+public:
+    explicit Engine(PottsModel *potts, const uint64_t& seed = 0x9e3779b97f4a7c15ULL)
+        : potts(potts)
+        , _rng(seed) {}
+
+    void setSeed(const uint64_t& seed) { _rng.seed(seed); }
+    MonteCarlo::Xoshiro256& rng() noexcept { return _rng; }
+
+    /* 両方の副格子を熱浴法で1回ずつ更新する */
+    void heatBathSweep(Lattice& lattice)
+    {
+        const int q = potts->param.q;
+        const size_t L = lattice.size(), half = L / 2;
+        prepare(q, half);
+        const bool largest = tableK >= 0.0;
+
+        for(size_t color = 0; color < 2; ++color)
+            for(size_t r = 0; r < L; ++r)
+            {
+                gatherNeighbors(lattice, color, r);
+                for(size_t k = 0; k < half; ++k) uniforms[k] = uniform01();
+
+                //色ごとの隣の数の最大 (K < 0 なら最小)．重みの基準にする
+                std::fill(references.begin(), references.end(), (largest) ? uint8_t(0) : uint8_t(4));
+                for(int s = 0; s < q; ++s)
+                {
+                    const uint8_t color8 = static_cast<uint8_t>(s);
+                    for(size_t k = 0; k < half; ++k)
+                    {
+                        const uint8_t n = (neighbors[0][k] == color8) + (neighbors[1][k] == color8) +
+                                          (neighbors[2][k] == color8) + (neighbors[3][k] == color8);
+                        references[k] = (largest) ? std::max(references[k], n) : std::min(references[k], n);
+                    }
+                }
+
+                //色 σ までの累積の重み
+                std::fill(totals.begin(), totals.end(), 0.0f);
+                for(int s = 0; s < q; ++s)
+                {
+                    const uint8_t color8 = static_cast<uint8_t>(s);
+                    float *cumulative = &cumulatives[s * half];
+                    for(size_t k = 0; k < half; ++k)
+                    {
+                        const int n = (neighbors[0][k] == color8) + (neighbors[1][k] == color8) +
+                                      (neighbors[2][k] == color8) + (neighbors[3][k] == color8);
+                        totals[k] += weights[references[k]][n];
+                        cumulative[k] = totals[k];
+                    }
+                }
+
+                //累積の重みが u W 以下の色の数が新しい色
+                for(size_t k = 0; k < half; ++k) targets[k] = static_cast<float>(uniforms[k]) * totals[k];
+                std::fill(choices.begin(), choices.end(), uint8_t(0));
+                for(int s = 0; s + 1 < q; ++s)
+                {
+                    const float *cumulative = &cumulatives[s * half];
+                    for(size_t k = 0; k < half; ++k) choices[k] += (cumulative[k] <= targets[k]) ? 1 : 0;
+                }
+
+                std::copy(choices.begin(), choices.end(), lattice.row(color, r));
+            }
+    }
+
+    /* Swendsen-Wang 法．同じ色の隣どうしを確率 1 - exp(-K) でつなぎ，各クラスターの色を一様に選び直す．
+     * クラスターの数を返す．
+     */
+    size_t swendsenWang(Lattice& lattice)
+    {
+        const int q = potts->param.q;
+        const size_t L = lattice.size(), N = L * L;
+        const double K = potts->param.J / potts->kbT();
+
+        //乱数の上位53bitと比べる
+        const double p = (K > 0.0) ? 1.0 - std::exp(-K) : 0.0;
+        const uint64_t threshold = (p >= 1.0) ? (uint64_t(1) << 53) : static_cast<uint64_t>(p * 9007199254740992.0);
+
+        parents.resize(N);
+        for(size_t i = 0; i < N; ++i) parents[i] = static_cast<uint32_t>(i);
+
+        for(size_t r = 0; r < L; ++r)
+            for(size_t c = 0; c < L; ++c)
+            {
+                const size_t i = lattice.index(r, c);
+                const size_t right = lattice.index(r, (c + 1) % L);
+                const size_t down = lattice.index((r + 1) % L, c);
+                const uint8_t s = lattice.at(r, c);
+
+                if(lattice.at(r, (c + 1) % L) == s && (_rng() >> 11) < threshold) unite(i, right);
+                if(lattice.at((r + 1) % L, c) == s && (_rng() >> 11) < threshold) unite(i, down);
+            }
+
+        //根ごとに新しい色を選ぶ (根の色を先に決めてから各サイトへ配る)
+        size_t clusterCount = 0;
+        uint8_t *spins = lattice.row(0, 0);
+        for(size_t i = 0; i < N; ++i)
+        {
+            if(parents[i] != i) continue;
+            spins[i] = static_cast<uint8_t>(uniform01() * q);
+            clusterCount++;
+        }
+        for(size_t i = 0; i < N; ++i) spins[i] = spins[find(i)];
+
+        return clusterCount;
+    }
+
+    /* 全エネルギー (各ボンドを1回ずつ数える) */
+    double energy(const Lattice& lattice)
+    {
+        const size_t L = lattice.size(), half = L / 2;
+        prepare(potts->param.q, half);
+
+        size_t equal = 0;
+        for(size_t r = 0; r < L; ++r)
+        {
+            gatherNeighbors(lattice, 0, r);
+            const uint8_t *s = lattice.row(0, r);
+            for(size_t k = 0; k < half; ++k)
+                equal += (neighbors[0][k] == s[k]) + (neighbors[1][k] == s[k]) +
+                         (neighbors[2][k] == s[k]) + (neighbors[3][k] == s[k]);
+        }
+
+        return - potts->param.J * static_cast<double>(equal);
+    }
+
+    /* 秩序変数 m = (q max_σ ρ_σ - 1) / (q - 1) (ρ_σ は色 σ の密度) */
+    double orderParameter(const Lattice& lattice) const
+    {
+        const int q = potts->param.q;
+        const auto counts = lattice.histogram(q);
+        const double largest = static_cast<double>(*std::max_element(counts.begin(), counts.end())) / lattice.siteCount();
+        return (q * largest - 1.0) / (q - 1);
+    }
+
+private:
+    /* q，行の長さ，温度が変わったときだけ作業領域と重みの表を作り直す */
+    void prepare(const int& q, const size_t& half)
+    {
+        if(cumulatives.size() != q * half)
+        {
+            for(auto& neighbor : neighbors) neighbor.assign(half, 0);
+            cumulatives.assign(q * half, 0.0f);
+            totals.assign(half, 0.0f);
+            references.assign(half, 0);
+            targets.assign(half, 0.0f);
+            uniforms.assign(half, 0.0);
+            choices.assign(half, 0);
+        }
+
+        const double K = potts->param.J / potts->kbT();
+        if(K != tableK)
+        {
+            //weights[n_max][n] = exp(K (n - n_max))．サイトの最大の重みが 1 なので，和が float であふれることも 0 になることもない
+            for(int reference = 0; reference <= 4; ++reference)
+                for(int n = 0; n <= 4; ++n) weights[reference][n] = static_cast<float>(std::exp(K * (n - reference)));
+            tableK = K;
+        }
+    }
+
+    /* 色 color の行 r の各サイトの4つの隣 (上，下，同じ行の k，同じ行の k ∓ 1) を neighbors に並べる */
+    void gatherNeighbors(const Lattice& lattice, const size_t& color, const size_t& r)
+    {
+        const size_t L = lattice.size(), half = L / 2;
+        const size_t other = 1 - color;
+        const uint8_t *U = lattice.row(other, (r + L - 1) % L);
+        const uint8_t *D = lattice.row(other, (r + 1) % L);
+        const uint8_t *S = lattice.row(other, r);
+
+        std::copy(U, U + half, neighbors[0].begin());
+        std::copy(D, D + half, neighbors[1].begin());
+        std::copy(S, S + half, neighbors[2].begin());
+        if((r + color) & 1)
+        {
+            std::copy(S + 1, S + half, neighbors[3].begin());
+            neighbors[3][half - 1] = S[0];
+        }
+        else
+        {
+            neighbors[3][0] = S[half - 1];
+            std::copy(S, S + half - 1, neighbors[3].begin() + 1);
+        }
+    }
+
+    size_t find(size_t i) noexcept
+    {
+        while(parents[i] != i)
+        {
+            parents[i] = parents[parents[i]];
+            i = parents[i];
+        }
+        return i;
+    }
+
+    void unite(const size_t& a, const size_t& b) noexcept
+    {
+        const size_t ra = find(a), rb = find(b);
+        if(ra == rb) return;
+        //小さい番号を根にする
+        if(ra < rb) parents[rb] = static_cast<uint32_t>(ra);
+        else parents[ra] = static_cast<uint32_t>(rb);
+    }
+
+    double uniform01() noexcept { return static_cast<double>(_rng() >> 11) * (1.0 / 9007199254740992.0); }
+
+    PottsModel *potts; //this has no ownership
+    MonteCarlo::Xoshiro256 _rng;
+
+    float weights[5][5] = {};
+    double tableK = std::numeric_limits<double>::quiet_NaN();
+
+    AlignedVector<uint8_t> neighbors[4];
+    AlignedVector<float> cumulatives;  //[色][k]
+    AlignedVector<float> totals;
+    AlignedVector<uint8_t> references;  //サイトの n_max
+    AlignedVector<float> targets;
+    AlignedVector<double> uniforms;
+    AlignedVector<uint8_t> choices;
+    std::vector<uint32_t> parents;
+};
+
+} //namespace Potts
+
+#endif // POTTS_H
@@ -0,0 +1,270 @@
+#ifndef SELFLEARNINGMC_H
+#define SELFLEARNINGMC_H
+
+#include "mathutil.h"
+#include "isingmodel.h"
+#include "montecarlo.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+
+/* 自己学習モンテカルロ法 (self-learning Monte Carlo)．
+ * シミュレーションで得たスピン配位とその厳密なエネルギーから，有効ハミルトニアン
+ *   H_eff = E0 - Σ_k J_k C_k   (C_k は第 k 近接のスピン対 s_i s_j の和，k = 1〜3)
+ * を最小二乗で求める．有効ハミルトニアンの強磁性的な結合 J_k > 0 でウォルフのクラスターを作って提案し，
+ *   min(1, exp(-β [(E_b - E_a) - (E_eff_b - E_eff_a)]))
+ * の確率で採択する．E は Hamiltonian::energy(state) で求める厳密なエネルギーなので，
+ * 有効ハミルトニアンが近似であっても平衡分布は厳密に保たれ，近似が良いほど採択率が上がる．
+ *
+ * 格子は正方格子で，State の最終行・最終列は複製 (周期境界条件) とする．
+ */
+template<size_t N, size_t M, typename Hamiltonian = IsingModel>
+class SelfLearningMonteCarlo
+{
+public:
+    static_assert(N > 3 && M > 3, "lattice is too small");
+
+    using StateType = State<N, M, bool>;
+    static constexpr size_t rows = N - 1;
+    static constexpr size_t cols = M - 1;
+    static constexpr size_t couplingCount = 3;
+
+    SelfLearningMonteCarlo(IsingModel *ising, const Hamiltonian *hamiltonian)
+        : ising(ising)
+        , hamiltonian(hamiltonian)
+        , mt(std::random_device()())
+        , visited(rows * cols, 0) {}
+
+    /* 学習データにスピン配位と厳密なエネルギーを加える */
+    void addSample(const StateType& state)
+    {
+        addSample(state, hamiltonian->energy(state));
+    }
+    void addSample(const StateType& state, const double& energy)
+    {
+        std::vector<double> feature(couplingCount + 1);
+        correlations(state, feature.data());
+        samples.push_back(feature);
+        energies.push_back(energy);
+    }
+
+    void clearSamples()
+    {
+        samples.clear();
+        energies.clear();
+    }
+
+    /* 学習データに有効ハミルトニアンを最小二乗で当てはめる．正規方程式が解けなければ false を返す． */
+    bool fit()
+    {
+        static constexpr size_t n = couplingCount + 1;
+        if(samples.size() < n) return false;
+
+        //特徴量は (1, -C_1, -C_2, -C_3)，係数は (E0, J_1, J_2, J_3)
+        double a[n][n + 1] = {};
+        for(size_t s = 0; s < samples.size(); ++s)
+        {
+            const double x[n] = { 1.0, - samples[s][1], - samples[s][2], - samples[s][3] };
+            for(size_t i = 0; i < n; ++i)
+            {
+                for(size_t j = 0; j < n; ++j) a[i][j] += x[i] * x[j];
+                a[i][n] += x[i] * energies[s];
+            }
+        }
+
+        //部分ピボット選択つきのガウスの消去法
+        for(size_t k = 0; k < n; ++k)
+        {
+            size_t pivot = k;
+            for(size_t i = k + 1; i < n; ++i)
+                if(std::abs(a[i][k]) > std::abs(a[pivot][k])) pivot = i;
+            if(std::abs(a[pivot][k]) < 1e-12) return false;
+
+            for(size_t j = 0; j <= n; ++j) std::swap(a[k][j], a[pivot][j]);
+            for(size_t i = 0; i < n; ++i)
+            {
+                if(i == k) continue;
+                const double f = a[i][k] / a[k][k];
+                for(size_t j = k; j <= n; ++j) a[i][j] -= f * a[k][j];
+            }
+        }
+
+        _offset = a[0][n] / a[0][0];
+        for(size_t k = 0; k < couplingCount; ++k) _couplings[k] = a[k + 1][n] / a[k + 1][k + 1];
+
+        return true;
+    }
+
+    /* クラスターを1つ提案して採択・棄却する．採択したら true を返す． */
+    bool update(StateType& state)
+    {
+        const double beta = 1.0 / ising->kbT();
+        if(!cached)
+        {
+            currentEnergy = hamiltonian->energy(state);
+            cached = true;
+        }
+
+        //強磁性的な結合だけをクラスターに使う
+        double addProbability[couplingCount];
+        for(size_t k = 0; k < couplingCount; ++k)
+            addProbability[k] = (_couplings[k] > 0.0) ? 1.0 - std::exp(-2.0 * beta * _couplings[k]) : 0.0;
+
+        double before[couplingCount + 1];
+        correlations(state, before);
+
+        buildCluster(state, addProbability);
+        for(const auto& site : cluster) flip(state, site);
+
+        double after[couplingCount + 1];
+        correlations(state, after);
+
+        double deltaEffective = 0.0;
+        for(size_t k = 0; k < couplingCount; ++k)
+            if(_couplings[k] > 0.0) deltaEffective -= _couplings[k] * (after[k + 1] - before[k + 1]);
+
+        const double nextEnergy = hamiltonian->energy(state);
+        const double x = - beta * ((nextEnergy - currentEnergy) - deltaEffective);
+
+        ++proposed;
+        if(x >= 0.0 || rand01(mt) < std::exp(x))
+        {
+            currentEnergy = nextEnergy;
+            ++accepted;
+            return true;
+        }
+
+        //棄却したので元に戻す
+        for(const auto& site : cluster) flip(state, site);
+        return false;
+    }
+
+    /* 外部で state を書き換えたときに呼ぶ */
+    void invalidate() noexcept { cached = false; }
+
+    double effectiveEnergy(const StateType& state) const noexcept
+    {
+        double c[couplingCount + 1];
+        correlations(state, c);
+
+        double energy = _offset;
+        for(size_t k = 0; k < couplingCount; ++k) energy -= _couplings[k] * c[k + 1];
+        return energy;
+    }
+
+    const double *couplings() const noexcept { return _couplings; }
+    double offset() const noexcept { return _offset; }
+    size_t sampleCount() const noexcept { return samples.size(); }
+    size_t lastClusterSize() const noexcept { return cluster.size(); }
+    double acceptanceRatio() const noexcept { return (proposed == 0) ? 0.0 : static_cast<double>(accepted) / proposed; }
+    void resetStatistics() noexcept { proposed = accepted = 0; }
+    void setSeed(const unsigned int& seed) { mt.seed(seed); }
+
+private:
+    /* 第 k 近接の変位 (片側のみ)．1: 最近接，2: 対角，3: 2つ先 */
+    static constexpr int shellOffsets[couplingCount][2][2] = {
+        { { 0, 1 }, { 1,  0 } },
+        { { 1, 1 }, { 1, -1 } },
+        { { 0, 2 }, { 2,  0 } },
+    };
+
+    static size_t wrap(const long long& value, const size_t& size) noexcept
+    {
+        const long long s = static_cast<long long>(size);
+        return static_cast<size_t>(((value % s) + s) % s);
+    }
+
+    /* c[0] = 1，c[k] = 第 k 近接のスピン対の和 */
+    static void correlations(const StateType& state, double *c) noexcept
+    {
+        long long sum[couplingCount] = {};
+        for(size_t r = 0; r < rows; ++r)
+            for(size_t col = 0; col < cols; ++col)
+            {
+                const int s = (state.at(r, col)) ? 1 : -1;
+                for(size_t k = 0; k < couplingCount; ++k)
+                    for(const auto& offset : shellOffsets[k])
+                    {
+                        const bool other = state.at(wrap(static_cast<long long>(r) + offset[0], rows),
+                                                      wrap(static_cast<long long>(col) + offset[1], cols));
+                        sum[k] += (other) ? s : -s;
+                    }
+            }
+
+        c[0] = 1.0;
+        for(size_t k = 0; k < couplingCount; ++k) c[k + 1] = static_cast<double>(sum[k]);
+    }
+
+    void buildCluster(const StateType& state, const double *addProbability)
+    {
+        cluster.clear();
+        if(++stamp == 0)
+        {
+            std::fill(visited.begin(), visited.end(), 0);
+            stamp = 1;
+        }
+
+        std::uniform_int_distribution<size_t> randSite(0, rows * cols - 1);
+        const size_t seed = randSite(mt);
+        const bool spin = state.at(seed / cols, seed % cols);
+
+        visited[seed] = stamp;
+        cluster.push_back(seed);
+
+        for(size_t i = 0; i < cluster.size(); ++i)
+        {
+            const long long r = cluster[i] / cols;
+            const long long c = cluster[i] % cols;
+
+            for(size_t k = 0; k < couplingCount; ++k)
+            {
+                if(addProbability[k] <= 0.0) continue;
+
+                for(const auto& offset : shellOffsets[k])
+                    for(const int sign : { 1, -1 })
+                    {
+                        const size_t nr = wrap(r + sign * offset[0], rows);
+                        const size_t nc = wrap(c + sign * offset[1], cols);
+                        const size_t site = nr * cols + nc;
+
+                        if(visited[site] == stamp || state.at(nr, nc) != spin) continue;
+                        if(rand01(mt) < addProbability[k])
+                        {
+                            visited[site] = stamp;
+                            cluster.push_back(site);
+                        }
+                    }
+            }
+        }
+    }
+
+    static void flip(StateType& state, const size_t& site) noexcept
+    {
+        const size_t r = site / cols;
+        const size_t c = site % cols;
+        LatticeStencil<LatticeType::Square>::setSpin(state, r, c, !state.at(r, c));
+    }
+
+    IsingModel *ising;              //this has no ownership
+    const Hamiltonian *hamiltonian; //this has no ownership
+    MonteCarlo::Xoshiro256 mt;
+    std::uniform_real_distribution<> rand01 = std::uniform_real_distribution<>(0.0, 1.0);
+
+    std::vector<std::vector<double>> samples; //学習データの (1, C_1, C_2, C_3)
+    std::vector<double> energies;             //学習データの厳密なエネルギー
+    double _offset = 0.0;
+    double _couplings[couplingCount] = {};
+
+    std::vector<size_t> cluster;
+    std::vector<unsigned int> visited;
+    unsigned int stamp = 0;
+
+    double currentEnergy = 0.0;
+    bool cached = false;
+    size_t proposed = 0;
+    size_t accepted = 0;
+};
+
+#endif // SELFLEARNINGMC_H
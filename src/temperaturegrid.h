@@ -0,0 +1,124 @@
+#ifndef TEMPERATUREGRID_H
+#define TEMPERATUREGRID_H
+
+#include "mathutil.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+
+/* 観測量の変化や誤差が大きい温度に計算を集める温度グリッド．
+ * 粗い等間隔のグリッドから始め，隣り合う2点の区間ごとに
+ *   score = |Δ<O>| + z (σ_i + σ_{i+1})   (σ は平均の標準誤差)
+ * を求めて最も大きい区間を選ぶ．誤差の項が変化の項より大きければ誤差の大きい端点にサンプルを足し，
+ * そうでなければ区間の中点に新しい温度を加える．これを budget 回の測定に達するまで繰り返す．
+ * 磁化が ±1 や 0 で平らな温度では score が小さいので，ほとんど測定しない．
+ * 幅が minSpacing まで細かくなり，誤差が変化より小さくなった区間はもう選ばない (選べる区間がなくなれば budget の前に終わる)．
+ *
+ * 1回の測定は measure(T) で，観測量のサンプルを1つ返す (1回のシミュレーション)．
+ */
+class AdaptiveTemperatureGrid
+{
+public:
+    struct Point
+    {
+        double T;
+        RunningStat stat;
+    };
+
+    /* [lowT, highT] を initialCount 点で始め，各点で samplesPerPoint 回ずつ測定する．
+     * 区間の幅は minSpacing より細かくしない．
+     */
+    AdaptiveTemperatureGrid(const double& lowT,
+                            const double& highT,
+                            const size_t& initialCount = 9,
+                            const size_t& samplesPerPoint = 4,
+                            const double& minSpacing = 1e-3,
+                            const double& z = 1.96)
+        : samplesPerPoint(std::max<size_t>(samplesPerPoint, 2))
+        , minSpacing(minSpacing)
+        , z(z)
+    {
+        const size_t count = std::max<size_t>(initialCount, 2);
+        for(size_t i = 0; i < count; ++i)
+            _points.push_back({ lowT + (highT - lowT) * i / (count - 1), RunningStat() });
+    }
+
+    /* 測定の総数が budget に達するまでグリッドを細かくする */
+    template<typename Measure>
+    void run(Measure&& measure, const size_t& budget)
+    {
+        for(auto& point : _points)
+            while(point.stat.count() < samplesPerPoint && used < budget) sample(point, measure);
+
+        while(used < budget)
+        {
+            //最も score の大きい区間 (分けられず，誤差も十分小さい区間は除く)
+            size_t best = 0;
+            double bestScore = -1.0;
+            for(size_t i = 0; i + 1 < _points.size(); ++i)
+            {
+                if(narrow(i) && error(i) <= std::abs(delta(i))) continue;
+                const double score = std::abs(delta(i)) + error(i);
+                if(score > bestScore)
+                {
+                    bestScore = score;
+                    best = i;
+                }
+            }
+
+            if(bestScore < 0.0) break;
+
+            Point& left = _points[best];
+            Point& right = _points[best + 1];
+
+            if(narrow(best) || error(best) > std::abs(delta(best)))
+            {
+                //誤差が大きい方の端点にサンプルを足す
+                Point& point = (left.stat.standardError() >= right.stat.standardError()) ? left : right;
+                for(size_t i = 0; i < samplesPerPoint && used < budget; ++i) sample(point, measure);
+            }
+            else
+            {
+                Point middle{ 0.5 * (left.T + right.T), RunningStat() };
+                for(size_t i = 0; i < samplesPerPoint && used < budget; ++i) sample(middle, measure);
+                _points.insert(_points.begin() + best + 1, middle);
+            }
+        }
+    }
+
+    const std::vector<Point>& points() const noexcept { return _points; }
+    size_t measurementCount() const noexcept { return used; }
+
+private:
+    template<typename Measure>
+    void sample(Point& point, Measure& measure)
+    {
+        point.stat.push(measure(point.T));
+        ++used;
+    }
+
+    /* 区間 i をこれ以上分けない */
+    bool narrow(const size_t& i) const noexcept
+    {
+        return _points[i + 1].T - _points[i].T < 2.0 * minSpacing;
+    }
+
+    double delta(const size_t& i) const noexcept
+    {
+        return _points[i + 1].stat.mean() - _points[i].stat.mean();
+    }
+
+    double error(const size_t& i) const noexcept
+    {
+        return z * (_points[i].stat.standardError() + _points[i + 1].stat.standardError());
+    }
+
+    size_t samplesPerPoint;
+    double minSpacing;
+    double z;
+    size_t used = 0;
+    std::vector<Point> _points;
+};
+
+#endif // TEMPERATUREGRID_H
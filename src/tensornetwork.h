@@ -0,0 +1,568 @@
+#ifndef TENSORNETWORK_H
+#define TENSORNETWORK_H
+
+#include "mathutil.h"
+#include "isingmodel.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+
+/* 高次特異値分解による テンソル繰り込み群 (HOTRG) で2次元イジング模型の分配関数を求める．
+ *
+ * 格子の各サイト (蜂の巣格子は2サイト) を4本の足 (左 l，右 r，上 u，下 d) を持つテンソル T_{lrud} にし，
+ * 正方格子のテンソルネットワークの縮約として Z を表す．ボンドの重みを2つの行列の積に分けて両端のサイトに持たせるので，
+ * 左右・上下の足は同じ基底になる．Rhombus は正方格子と同じつながり方，Triangle は対角のボンドを右隣のサイト経由で渡す．
+ *
+ * 1回の繰り込みでは上下の2つのテンソルを縮約し，横の足 (次元 χ^2) を M M^T の上位 χ 個の固有ベクトルで切り詰め，
+ * 縦横を入れ替える．stepCount 回で 2^stepCount 個のテンソルをまとめるので，実質的に無限に大きな格子になる．
+ * 規格化の係数と観測量が変わらなくなったら (テンソルが固定点に達したら) 残りの段は打ち切る．
+ *
+ * 観測量は不純物テンソルを同じ射影で繰り込んで求める (射影にはボンドの不純物の環境も少し混ぜる)．
+ *   最近接の相関 <s_i s_j>: 右の足のボンドの重みに s_i s_j を掛けたテンソル (k = 0，1 の成分を tanh K，coth K 倍) の
+ *                          Tr(E) / Tr(T)．内部エネルギーは差分でなくこれから求める．
+ *   磁化: スピンを掛けたテンソル S を2つ縦に並べた Tr(S S) / Tr(T T) = <s_0 s_r> (r は格子の高さの半分) から
+ *         |m| = sqrt(<s_0 s_r>) とするので，対称性を破る磁場は要らない．
+ * 磁場 h は模型の外場として使える．h で対称性を破って Tr(S) / Tr(T) を見る場合は，有限の格子 (2^stepCount サイト) の
+ * Zeeman エネルギーが温度を十分越える h × 2^stepCount ≫ 1 が必要で，そうでなければ m は 0 に近づく．
+ */
+template<LatticeType Lattice = LatticeType::Square>
+class HOTRG
+{
+public:
+    struct Result
+    {
+        double T;
+        double freeEnergy;     //1サイトあたり
+        double energy;         //1サイトあたりの内部エネルギー (ボンドの不純物テンソルから)
+        double specificHeat;   //1サイトあたりの比熱 (内部エネルギーの β ± δβ の差分)
+        double magnetization;  //|m| (磁場があればその符号を付ける)
+    };
+
+    /* lnZ と一緒に不純物テンソルから求める量 */
+    struct Observables
+    {
+        double magnetization = 0.0;
+        double correlation = 0.0;   //最近接の <s_i s_j>
+    };
+
+    HOTRG(IsingModel *ising,
+          const size_t& chi = 12,
+          const size_t& stepCount = 24,
+          const size_t& threadCount = std::thread::hardware_concurrency())
+        : ising(ising)
+        , chi(std::max<size_t>(chi, 2))
+        , stepCount(stepCount)
+        , threadCount(std::max<size_t>(threadCount, 1)) {}
+
+    /* 外場 h (Hamiltonian の - h Σ s_i)．磁化を求めるのに対称性を破る磁場は要らない */
+    void setField(const double& h) { field = h; }
+    double truncationError() const noexcept { return _truncationError; }
+
+    /* 1サイトあたりの ln Z．observables が nullptr でなければ磁化と最近接の相関も求める */
+    double lnZ(const double& beta, Observables *observables = nullptr)
+    {
+        Observables values;
+        const double result = contract(beta, observables != nullptr, observables != nullptr, values);
+        if(observables) *observables = values;
+        return result;
+    }
+
+    /* 温度 ising->param.T での自由エネルギー，内部エネルギー，比熱，磁化．
+     * 比熱は β (1 ± relativeDelta) の内部エネルギーの差分 C = ∂E/∂T = -kb β^2 ∂E/∂β から求める．
+     * 内部エネルギーは不純物テンソルから直接求めるので差分は1階だけで済むが，切り詰めの誤差を δβ で割るので
+     * relativeDelta は小さくしすぎない．
+     * relativeDelta ≤ 0 なら比熱を求めず (NaN)，縮約は1回で済む．
+     */
+    Result run(const double& relativeDelta = 1e-2)
+    {
+        const double beta = 1.0 / ising->kbT();
+
+        Result result;
+        result.T = ising->param.T;
+
+        Observables values;
+        result.freeEnergy = -contract(beta, true, true, values) / beta;
+        result.magnetization = values.magnetization;
+        result.energy = energy(values);
+        result.specificHeat = std::nan("");
+
+        if(relativeDelta > 0.0)
+        {
+            const double delta = relativeDelta * beta;
+            Observables plus, minus;
+            contract(beta + delta, false, true, plus);
+            contract(beta - delta, false, true, minus);
+            result.specificHeat = -ising->param.kb * beta * beta * (energy(plus) - energy(minus)) / (2.0 * delta);
+        }
+        return result;
+    }
+
+    /* 最後の lnZ で縮約した段の数 (固定点で打ち切ると stepCount より少ない) */
+    size_t contractedSteps() const noexcept { return _contractedSteps; }
+
+private:
+    static constexpr double sitesPerTensor = (Lattice == LatticeType::Hexagonal) ? 2.0 : 1.0;
+
+    /* 1サイトあたりの内部エネルギー -J (z / 2) <s_i s_j> - h m (どのボンドも同等な格子) */
+    double energy(const Observables& values) const noexcept
+    {
+        return -ising->param.J * 0.5 * LatticeGeometry<Lattice>::z * values.correlation - field * values.magnetization;
+    }
+
+    /* 1サイトあたりの ln Z と，withSpin なら磁化，withBond なら最近接の相関 */
+    double contract(const double& beta, const bool& withSpin, const bool& withBond, Observables& values)
+    {
+        static constexpr double tolerance = 1e-10;
+
+        Tensor t, spin, bond;
+        initialTensor(beta, t, spin, bond);
+
+        double lnZ = 0.0;
+        double weight = 1.0;
+        bool converged = false;
+        _truncationError = 0.0;
+
+        //前の段の log c と観測量 (固定点の判定)
+        double previous[3] = { std::nan(""), std::nan(""), std::nan("") };
+        size_t stableCount = 0;
+
+        size_t step = 0;
+        for(; step < stepCount; ++step)
+        {
+            const Projector p = projector(t, (withBond) ? &bond : nullptr);
+            _truncationError = std::max(_truncationError, p.error);
+
+            //不純物は上のテンソルにだけ置く (並進対称なので Tr の比は変わらず，縮約は1回で済む)
+            Tensor next = merge(t, t, p);
+            Tensor nextSpin, nextBond;
+            if(withSpin) nextSpin = merge(spin, t, p);
+            if(withBond) nextBond = merge(bond, t, p);
+
+            //大きさをそろえ，ln Z に log(c) / (まとめたテンソルの数) を足す
+            double c = 0.0;
+            for(const auto& x : next.data) c = std::max(c, std::abs(x));
+            if(c == 0.0) return std::nan("");
+            for(auto& x : next.data) x /= c;
+            for(auto& x : nextSpin.data) x /= c;
+            for(auto& x : nextBond.data) x /= c;
+
+            weight *= 0.5;
+            lnZ += weight * std::log(c);
+            t = reflect(next);
+            if(withSpin) spin = reflect(nextSpin);
+            if(withBond) bond = reflect(nextBond);
+
+            //固定点では以降の段も同じ c になるので，残りの寄与 Σ weight / 2^k log c = weight log c をまとめて足す
+            const double current[3] = { std::log(c),
+                                        (withSpin) ? pairTrace(spin) / pairTrace(t) : 0.0,
+                                        (withBond) ? bond.trace() / t.trace() : 0.0 };
+            bool stable = true;
+            for(size_t i = 0; i < 3; ++i) stable = stable && std::abs(current[i] - previous[i]) < tolerance * (1.0 + std::abs(current[i]));
+            stableCount = (stable) ? stableCount + 1 : 0;
+            std::copy(current, current + 3, previous);
+
+            if(stableCount >= 2)
+            {
+                lnZ += weight * current[0];
+                converged = true;
+                ++step;
+                break;
+            }
+        }
+        _contractedSteps = step;
+
+        const double trace = t.trace();
+        if(!converged) lnZ += weight * std::log(std::abs(trace));
+
+        if(withSpin)
+        {
+            //<s_0 s_r> = m^2．磁場があれば Tr(S) / Tr(T) の符号を付ける
+            const double m = std::sqrt(std::max(0.0, pairTrace(spin) / pairTrace(t)));
+            values.magnetization = (field != 0.0 && spin.trace() / trace < 0.0) ? -m : m;
+        }
+        if(withBond) values.correlation = bond.trace() / trace;
+
+        return lnZ / sitesPerTensor;
+    }
+
+    /* T_{lrud} (l，r の次元 h，u，d の次元 v) */
+    struct Tensor
+    {
+        size_t h = 0;
+        size_t v = 0;
+        std::vector<double> data;
+
+        void resize(const size_t& h, const size_t& v)
+        {
+            this->h = h;
+            this->v = v;
+            data.assign(h * h * v * v, 0.0);
+        }
+
+        double& at(const size_t& l, const size_t& r, const size_t& u, const size_t& d) noexcept
+        {
+            return data[((l * h + r) * v + u) * v + d];
+        }
+        double at(const size_t& l, const size_t& r, const size_t& u, const size_t& d) const noexcept
+        {
+            return data[((l * h + r) * v + u) * v + d];
+        }
+
+        /* 左右・上下をつないだ 1×1 の周期境界のトレース */
+        double trace() const noexcept
+        {
+            double sum = 0.0;
+            for(size_t l = 0; l < h; ++l)
+                for(size_t u = 0; u < v; ++u) sum += at(l, l, u, u);
+            return sum;
+        }
+    };
+
+    /* 横の足の組 (l1, l2) → 新しい足 a の射影 P[(l1 h + l2) * c + a] */
+    struct Projector
+    {
+        size_t c = 0;
+        std::vector<double> p;
+        double error = 0.0;   //切り捨てた固有値の割合
+    };
+
+    /* ボンドの重み Q(s, s') = exp(K s s') を Σ_k W(s, k) Wr(s', k) に分け，各サイトにボンドの数だけ W を付ける．
+     * W(s, 0) = sqrt(cosh K)，W(s, 1) = s sqrt(|sinh K|)．反強磁性 (K < 0) では右・下の足 Wr の k = 1 の符号を反転する．
+     * s s' Q = sinh K + s s' cosh K なので，ボンドの不純物 bond は右の足の横のボンドの k = 0，1 を tanh K，coth K 倍したもの．
+     */
+    void initialTensor(const double& beta, Tensor& t, Tensor& impurity, Tensor& bond) const
+    {
+        const double K = beta * ising->param.J;
+        const double H = beta * field;
+        const auto spin = [](const size_t& i){ return (i == 0) ? -1.0 : 1.0; };
+
+        const double w0 = std::sqrt(std::cosh(K));
+        const double w1 = std::sqrt(std::abs(std::sinh(K)));
+        const double sign = (K < 0.0) ? -1.0 : 1.0;
+        const auto W = [&](const size_t& s, const size_t& k){ return (k == 0) ? w0 : spin(s) * w1; };
+        const auto Wr = [&](const size_t& s, const size_t& k){ return (k == 0) ? w0 : sign * spin(s) * w1; };
+
+        if constexpr(Lattice == LatticeType::Triangle)
+        {
+            //左上-右下の対角のボンドは右隣のサイトを経由させる．
+            //l = (横のボンド，左隣から受け取った対角の添字)，r = (横のボンド，自分の対角の添字)，
+            //u = (縦のボンド，左上から届いた対角の添字)，d = (縦のボンド，左隣から受け取った対角の添字をそのまま下へ)
+            t.resize(4, 4);
+            impurity.resize(4, 4);
+            for(size_t s = 0; s < 2; ++s)
+            {
+                const double zeeman = std::exp(H * spin(s));
+                for(size_t l = 0; l < 2; ++l)
+                    for(size_t r = 0; r < 2; ++r)
+                        for(size_t u = 0; u < 2; ++u)
+                            for(size_t d = 0; d < 2; ++d)
+                                for(size_t in = 0; in < 2; ++in)
+                                    for(size_t own = 0; own < 2; ++own)
+                                        for(size_t pass = 0; pass < 2; ++pass)
+                                        {
+                                            const double w = zeeman * W(s, l) * Wr(s, r) * W(s, u) * Wr(s, d) * W(s, in) * Wr(s, own);
+                                            t.at(l * 2 + pass, r * 2 + own, u * 2 + in, d * 2 + pass) += w;
+                                            impurity.at(l * 2 + pass, r * 2 + own, u * 2 + in, d * 2 + pass) += spin(s) * w;
+                                        }
+            }
+        }
+        else if constexpr(Lattice == LatticeType::Hexagonal)
+        {
+            //2サイト s1，s2 をまとめる．s1 は s2 と左・上，s2 は右・下のサイトとつながる
+            t.resize(2, 2);
+            impurity.resize(2, 2);
+            for(size_t s1 = 0; s1 < 2; ++s1)
+                for(size_t s2 = 0; s2 < 2; ++s2)
+                {
+                    const double bond = std::exp(K * spin(s1) * spin(s2) + H * (spin(s1) + spin(s2)));
+                    for(size_t l = 0; l < 2; ++l)
+                        for(size_t r = 0; r < 2; ++r)
+                            for(size_t u = 0; u < 2; ++u)
+                                for(size_t d = 0; d < 2; ++d)
+                                {
+                                    const double w = bond * W(s1, l) * W(s1, u) * Wr(s2, r) * Wr(s2, d);
+                                    t.at(l, r, u, d) += w;
+                                    impurity.at(l, r, u, d) += 0.5 * (spin(s1) + spin(s2)) * w;
+                                }
+                }
+        }
+        else
+        {
+            t.resize(2, 2);
+            impurity.resize(2, 2);
+            for(size_t s = 0; s < 2; ++s)
+            {
+                const double zeeman = std::exp(H * spin(s));
+                for(size_t l = 0; l < 2; ++l)
+                    for(size_t r = 0; r < 2; ++r)
+                        for(size_t u = 0; u < 2; ++u)
+                            for(size_t d = 0; d < 2; ++d)
+                            {
+                                const double w = zeeman * W(s, l) * Wr(s, r) * W(s, u) * Wr(s, d);
+                                t.at(l, r, u, d) += w;
+                                impurity.at(l, r, u, d) += spin(s) * w;
+                            }
+            }
+        }
+
+        //K = 0 では k = 1 の成分は 0 なので，coth K の代わりに 0 を掛ける
+        const double bondScale[2] = { std::tanh(K), (K == 0.0) ? 0.0 : 1.0 / std::tanh(K) };
+        const size_t legsPerBond = t.h / 2;   //右の足 r = (横のボンドの添字) × legsPerBond + ...
+        bond = t;
+        for(size_t l = 0; l < t.h; ++l)
+            for(size_t r = 0; r < t.h; ++r)
+                for(size_t u = 0; u < t.v; ++u)
+                    for(size_t d = 0; d < t.v; ++d) bond.at(l, r, u, d) *= bondScale[r / legsPerBond];
+    }
+
+    /* 2つの a を縦に並べた 1×2 の周期境界のトレース Σ a_{l l u k} a_{l' l' k u} */
+    static double pairTrace(const Tensor& a) noexcept
+    {
+        std::vector<double> vertical(a.v * a.v, 0.0);
+        for(size_t l = 0; l < a.h; ++l)
+            for(size_t u = 0; u < a.v; ++u)
+                for(size_t d = 0; d < a.v; ++d) vertical[u * a.v + d] += a.at(l, l, u, d);
+
+        double sum = 0.0;
+        for(size_t u = 0; u < a.v; ++u)
+            for(size_t k = 0; k < a.v; ++k) sum += vertical[u * a.v + k] * vertical[k * a.v + u];
+        return sum;
+    }
+
+    /* 上 a，下 b を縦に縮約した M_{(l1 l2)(r1 r2) u d} の横の足の射影．
+     * M M^T を左右それぞれ作って固有値分解し，切り捨てる重みの小さい方を使う．
+     * top があれば上に top を置いた M' の M' M'^T をトレースの 1/100 にして足す．T の射影はほとんど変えずに，
+     * 不純物にだけ効く成分 (Triangle の最初の縮約などで目立つ) を切り捨てないようにする．
+     */
+    Projector projector(const Tensor& t, const Tensor *top = nullptr) const
+    {
+        const size_t h = t.h, v = t.v;
+        const size_t n = h * h;
+
+        //X_left[l][l'][k][k'] = Σ_{r,u} T_{l r u k} T_{l' r u k'}，Y_left[l][l'][k][k'] = Σ_{r,d} T_{l r k d} T_{l' r k' d}
+        std::vector<double> xl(h * h * v * v, 0.0), yl(h * h * v * v, 0.0);
+        std::vector<double> xr(h * h * v * v, 0.0), yr(h * h * v * v, 0.0);
+        std::vector<double> xt(h * h * v * v, 0.0), xtR(h * h * v * v, 0.0);   //X の T を top にしたもの
+        parallelFor(h, [&](const size_t& l)
+        {
+            for(size_t l2 = 0; l2 < h; ++l2)
+                for(size_t k = 0; k < v; ++k)
+                    for(size_t k2 = 0; k2 < v; ++k2)
+                    {
+                        double x = 0.0, y = 0.0, xR = 0.0, yR = 0.0;
+                        for(size_t r = 0; r < h; ++r)
+                            for(size_t u = 0; u < v; ++u)
+                            {
+                                x += t.at(l, r, u, k) * t.at(l2, r, u, k2);
+                                y += t.at(l, r, k, u) * t.at(l2, r, k2, u);
+                                xR += t.at(r, l, u, k) * t.at(r, l2, u, k2);
+                                yR += t.at(r, l, k, u) * t.at(r, l2, k2, u);
+                            }
+                        const size_t index = ((l * h + l2) * v + k) * v + k2;
+                        xl[index] = x;
+                        yl[index] = y;
+                        xr[index] = xR;
+                        yr[index] = yR;
+
+                        if(!top) continue;
+                        double xTop = 0.0, xTopR = 0.0;
+                        for(size_t r = 0; r < h; ++r)
+                            for(size_t u = 0; u < v; ++u)
+                            {
+                                xTop += top->at(l, r, u, k) * top->at(l2, r, u, k2);
+                                xTopR += top->at(r, l, u, k) * top->at(r, l2, u, k2);
+                            }
+                        xt[index] = xTop;
+                        xtR[index] = xTopR;
+                    }
+        });
+
+        const auto environment = [&](const std::vector<double>& x, const std::vector<double>& y)
+        {
+            std::vector<double> m(n * n, 0.0);
+            parallelFor(h, [&](const size_t& l1)
+            {
+                for(size_t l2 = 0; l2 < h; ++l2)
+                    for(size_t m1 = 0; m1 < h; ++m1)
+                        for(size_t m2 = 0; m2 < h; ++m2)
+                        {
+                            const double *xp = x.data() + (l1 * h + m1) * v * v;
+                            const double *yp = y.data() + (l2 * h + m2) * v * v;
+                            double sum = 0.0;
+                            for(size_t k = 0; k < v * v; ++k) sum += xp[k] * yp[k];
+                            m[(l1 * h + l2) * n + m1 * h + m2] = sum;
+                        }
+            });
+            return m;
+        };
+
+        const size_t c = std::min(chi, n);
+        Projector best;
+        best.error = -1.0;
+
+        std::vector<double> sides[2] = { environment(xl, yl), environment(xr, yr) };
+        if(top)
+        {
+            static constexpr double topWeight = 0.01;
+            const std::vector<double> extras[2] = { environment(xt, yl), environment(xtR, yr) };
+            for(size_t s = 0; s < 2; ++s)
+            {
+                double a = 0.0, b = 0.0;
+                for(size_t i = 0; i < n; ++i)
+                {
+                    a += sides[s][i * n + i];
+                    b += extras[s][i * n + i];
+                }
+                if(b <= 0.0) continue;
+                for(size_t i = 0; i < n * n; ++i) sides[s][i] += topWeight * a / b * extras[s][i];
+            }
+        }
+
+        for(const auto& side : sides)
+        {
+            std::vector<double> values, vectors;
+            symmetricEigen(side, n, values, vectors);
+
+            double total = 0.0, kept = 0.0;
+            for(size_t i = 0; i < n; ++i)
+            {
+                total += std::max(values[i], 0.0);
+                if(i < c) kept += std::max(values[i], 0.0);
+            }
+            const double error = (total > 0.0) ? 1.0 - kept / total : 0.0;
+
+            if(best.error < 0.0 || error < best.error)
+            {
+                best.c = c;
+                best.error = error;
+                best.p.assign(n * c, 0.0);
+                for(size_t a = 0; a < c; ++a)
+                    for(size_t i = 0; i < n; ++i) best.p[i * c + a] = vectors[a * n + i];
+            }
+        }
+
+        return best;
+    }
+
+    /* 上 a と下 b を縦に縮約し，横の足を p で切り詰める．
+     *   Z[a'][r1][u][l2][k] = Σ_{l1} P[(l1 l2) a'] A[l1 r1 u k]
+     *   W[a'][r1][u][r2][d] = Σ_{l2,k} Z[a'][r1][u][l2][k] B[l2 r2 k d]
+     *   T'[a'][b'][u][d]    = Σ_{r1,r2} W[a'][r1][u][r2][d] P[(r1 r2) b']
+     * 計算量が最も大きい W は (a' r1 u) × (l2 k) と (l2 k) × (r2 d) の行列積になるように並べる．
+     */
+    Tensor merge(const Tensor& a, const Tensor& b, const Projector& p) const
+    {
+        const size_t h = a.h, v = a.v, c = p.c;
+        const size_t hv = h * v;
+
+        //B[l2][r2][k][d] → B'[l2][k][r2][d]
+        std::vector<double> bt(h * h * v * v);
+        for(size_t l2 = 0; l2 < h; ++l2)
+            for(size_t r2 = 0; r2 < h; ++r2)
+                for(size_t k = 0; k < v; ++k)
+                    for(size_t d = 0; d < v; ++d) bt[((l2 * v + k) * h + r2) * v + d] = b.at(l2, r2, k, d);
+
+        std::vector<double> z(c * hv * hv, 0.0);
+        parallelFor(c, [&](const size_t& i)
+        {
+            for(size_t l1 = 0; l1 < h; ++l1)
+                for(size_t l2 = 0; l2 < h; ++l2)
+                {
+                    const double w = p.p[(l1 * h + l2) * c + i];
+                    if(w == 0.0) continue;
+
+                    for(size_t ru = 0; ru < hv; ++ru)
+                    {
+                        const double *in = &a.data[(l1 * hv + ru) * v];
+                        double *out = &z[((i * hv + ru) * h + l2) * v];
+                        for(size_t k = 0; k < v; ++k) out[k] += w * in[k];
+                    }
+                }
+        });
+
+        std::vector<double> w(c * hv * hv, 0.0);
+        parallelFor(c, [&](const size_t& i)
+        {
+            for(size_t ru = 0; ru < hv; ++ru)
+            {
+                const double *zp = &z[(i * hv + ru) * hv];
+                double *out = &w[(i * hv + ru) * hv];
+                for(size_t lk = 0; lk < hv; ++lk)
+                {
+                    const double zv = zp[lk];
+                    if(zv == 0.0) continue;
+
+                    const double *in = &bt[lk * hv];
+                    for(size_t rd = 0; rd < hv; ++rd) out[rd] += zv * in[rd];
+                }
+            }
+        });
+
+        Tensor out;
+        out.resize(c, v);
+        parallelFor(c, [&](const size_t& i)
+        {
+            for(size_t r1 = 0; r1 < h; ++r1)
+                for(size_t u = 0; u < v; ++u)
+                    for(size_t r2 = 0; r2 < h; ++r2)
+                    {
+                        const double *in = &w[(((i * h + r1) * v + u) * h + r2) * v];
+                        for(size_t j = 0; j < c; ++j)
+                        {
+                            const double pv = p.p[(r1 * h + r2) * c + j];
+                            if(pv == 0.0) continue;
+
+                            double *o = &out.at(i, j, u, 0);
+                            for(size_t d = 0; d < v; ++d) o[d] += pv * in[d];
+                        }
+                    }
+        });
+
+        return out;
+    }
+
+    /* 縦横を入れ替える (対角線での鏡映): T'_{lrud} = T_{udlr} */
+    static Tensor reflect(const Tensor& t)
+    {
+        Tensor out;
+        out.resize(t.v, t.h);
+        for(size_t l = 0; l < t.h; ++l)
+            for(size_t r = 0; r < t.h; ++r)
+                for(size_t u = 0; u < t.v; ++u)
+                    for(size_t d = 0; d < t.v; ++d) out.at(u, d, l, r) = t.at(l, r, u, d);
+        return out;
+    }
+
+    /* [0, count) を threadCount 個の連続した区間に分けて f(i) を並列に呼ぶ */
+    template<typename Func>
+    void parallelFor(const size_t& count, Func&& f) const
+    {
+        const size_t threads = std::min(threadCount, count);
+        if(threads <= 1)
+        {
+            for(size_t i = 0; i < count; ++i) f(i);
+            return;
+        }
+
+        std::vector<std::thread> workers;
+        for(size_t t = 0; t < threads; ++t)
+        {
+            const size_t begin = count * t / threads;
+            const size_t end = count * (t + 1) / threads;
+            workers.emplace_back([&f, begin, end](){ for(size_t i = begin; i < end; ++i) f(i); });
+        }
+        for(auto& worker : workers) worker.join();
+    }
+
+    IsingModel *ising; //this has no ownership
+    size_t chi;
+    size_t stepCount;
+    size_t threadCount;
+    double field = 0.0;
+    double _truncationError = 0.0;
+    size_t _contractedSteps = 0;
+};
+
+#endif // TENSORNETWORK_H
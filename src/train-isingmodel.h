@@ -11,7 +11,11 @@
 //#endif
 
 #include "neuralnetwork.h"
+#include "blockspin.h"
 #include "isingmodel.h"
+#include "pca.h"
+#include <chrono>
+#include <limits>
 
 /* スピン配位の学習データを熱浴法で作成し，保存する．
  * 転移温度前後で異なるラベル付けをする．
@@ -100,6 +104,77 @@ void createIsingModelDataSet()
 
 
 
+/* 一辺 64 の格子のスピン配位を作り，多数決のブロックスピン変換で 32，16，8 に粗視化した
+ * 学習データも同時に作る (粗視化ごとに別の分類器を学習させて，大きさによる違いを見るため)．
+ * ラベル付けは createIsingModelDataSet と同じ．段 n のデータは folder の level<n>_train_x.txt などに保存する．
+ */
+void createMultiScaleDataSet()
+{
+    using namespace nn;
+
+    static constexpr size_t L = 64;
+    static constexpr size_t levelCount = 4;  //64，32，16，8
+    static constexpr size_t sweepCount = 2000;
+
+    vec2d train_x[levelCount], train_t[levelCount], test_x[levelCount], test_t[levelCount];
+
+    IsingModel ising;
+    State<L + 1, L + 1, bool> state;
+    MonteCarlo::Engine<LatticeType::Square,
+                       MonteCarlo::HeatBath,
+                       MonteCarlo::CheckerboardScan,
+                       MonteCarlo::Xoshiro256> engine(&ising);
+    const int halfDataCount = 500; //作成するデータ数の半分
+    const double t = 2 * ising.param.J / (ising.param.kb * std::log(std::sqrt(2) + 1)); //相転移温度
+
+    std::random_device rnd;
+    std::mt19937 mt(rnd());
+    std::uniform_real_distribution<> lt(0, t);     //[0,転移温度]の一様な乱数
+    std::uniform_real_distribution<> ht(t, 2 * t); //[転移温度,2*転移温度]の一様な乱数
+    engine.setSeed(rnd());
+
+    BlockSpin::Spins levels[levelCount];
+    for(int i = 0; i < halfDataCount * 4; ++i)
+    {
+        const bool low = i < halfDataCount * 2;
+        const bool train = i % (halfDataCount * 2) < halfDataCount;
+        ising.param.T = (low) ? lt(mt) : ht(mt);
+        std::cout << i << '\t' << ising.param.T << std::endl;
+
+        state.initRand();
+        for(size_t j = 0; j < sweepCount; ++j) engine.sweep(state);
+
+        levels[0] = BlockSpin::Spins(state);
+        for(size_t n = 1; n < levelCount; ++n) BlockSpin::coarsen(levels[n - 1], levels[n], 2, engine.rng());
+
+        for(size_t n = 0; n < levelCount; ++n)
+        {
+            vec1d data;
+            levels[n].createVector1d<double>(data);
+
+            const vec1d label = (low) ? vec1d{ 0, 1 } : vec1d{ 1, 0 };
+            (train ? train_x : test_x)[n].push_back(data);
+            (train ? train_t : test_t)[n].push_back(label);
+        }
+    }
+
+    /* 作成したスピン配位を保存 */
+    const std::string folder = "F:/repos/isingdata/8_multiscale/";
+    for(size_t n = 0; n < levelCount; ++n)
+    {
+        const std::string prefix = folder + "level" + std::to_string(n) + "_";
+        IOVector::writeVec2d(train_x[n], prefix + "train_x.txt");
+        IOVector::writeVec2d(train_t[n], prefix + "train_t.txt");
+        IOVector::writeVec2d(test_x[n], prefix + "test_x.txt");
+        IOVector::writeVec2d(test_t[n], prefix + "test_t.txt");
+    }
+}
+
+
+
+
+
+
 /* 保存されたスピン配位の学習データをよみとり，ニューラルネットワークで学習させる．
  * 学習はすぐに収束するので，そのまま学習済みのパラメータを用いて各温度のスピン配位の磁化を推論する．
  */
@@ -160,6 +235,9 @@ void predictMagnetization()
     /* 学習する */
     network.train();
 
+    /* 学習済みのネットワークを保存する(ビューアで読み込める) */
+    nModel.save(folder + "network.txt");
+
     vec2d x;
     State<20, 20, bool> state;
     IsingModel ising;
@@ -213,4 +291,295 @@ void predictMagnetization()
     }
 }
 
+
+
+
+
+
+
+/* 二分法で転移温度を探した結果 */
+struct TransitionSearchResult
+{
+    double Tc = std::numeric_limits<double>::quiet_NaN();
+    double lowT = 0.0;           //低温相と判定された最も高い温度
+    double highT = 0.0;          //高温相と判定された最も低い温度
+    size_t simulationCount = 0;  //作成したスピン配位の数
+    size_t bisectionCount = 0;
+    bool stoppedEarly = false;   //区間の幅が precision になる前に，中点で2つの出力が区別できなくなって止めた
+};
+
+/* 温度 T のスピン配位を batchSize 個ずつ熱浴法で作り，学習済みネットワークの出力の差
+ * (低温相 - 高温相) を集める．差の平均の信頼区間が0を含まなくなるか maxRepetition 個に達したら止め，
+ * 符号 (1: 低温相，-1: 高温相，0: 区別できない) を返す．
+ */
+template<LatticeType Lattice, size_t updateCount, size_t N, size_t M>
+int classifyTemperature(const nn::NetworkModel& model,
+                        IsingModel& ising,
+                        State<N, M, bool>& state,
+                        const double& T,
+                        const size_t& batchSize,
+                        const size_t& maxRepetition,
+                        size_t& simulationCount)
+{
+    using namespace nn;
+
+    IsingHeatBathMethod<Lattice> hbMethod(&ising);
+    RunningStat stat;
+    ising.param.T = T;
+
+    while(stat.count() < maxRepetition)
+    {
+        vec2d x;
+        for(size_t i = 0; i < batchSize && stat.count() + i < maxRepetition; ++i)
+        {
+            state.initRand();
+            hbMethod.template optimize<updateCount>(state);
+
+            vec1d vec;
+            state.template createVector1d<double>(vec);
+            x.push_back(vec);
+        }
+        simulationCount += x.size();
+
+        const vec2d out = Network::forward(model, x);
+        for(const auto& o : out) stat.push(o[1] - o[0]);
+
+        //最初のバッチだけで符号を決めない
+        if(stat.count() < 2 * batchSize) continue;
+        if(std::abs(stat.mean()) > stat.confidence()) break;
+    }
+
+    if(std::abs(stat.mean()) <= stat.confidence()) return 0;
+    return (stat.mean() > 0) ? 1 : -1;
+}
+
+/* 学習済みネットワークの2つの出力が交わる温度を [lowT, highT] の二分法で求める．
+ * 中点のスピン配位は必要な数だけ作り，区間の幅が precision 以下になるか，
+ * 中点で2つの出力が区別できなくなったら止める．後者でも区間は最後に判定できた [lowT, highT] のままにし，
+ * stoppedEarly を立てる (Tc はその中点)．両端が低温相・高温相と判定されなければ Tc は NaN．
+ */
+template<LatticeType Lattice, size_t N = 20, size_t M = 20, size_t updateCount = 1000000>
+TransitionSearchResult findTransitionTemperature(const nn::NetworkModel& model,
+                                                 double lowT,
+                                                 double highT,
+                                                 const double& precision = 0.01,
+                                                 const size_t& batchSize = 4,
+                                                 const size_t& maxRepetition = 20)
+{
+    TransitionSearchResult result;
+    IsingModel ising;
+    State<N, M, bool> state;
+
+    if(classifyTemperature<Lattice, updateCount>(model, ising, state, lowT, batchSize, maxRepetition, result.simulationCount) <= 0 ||
+       classifyTemperature<Lattice, updateCount>(model, ising, state, highT, batchSize, maxRepetition, result.simulationCount) >= 0)
+    {
+        result.lowT = lowT;
+        result.highT = highT;
+        return result;
+    }
+
+    while(highT - lowT > precision)
+    {
+        const double T = 0.5 * (lowT + highT);
+        const int phase = classifyTemperature<Lattice, updateCount>(model, ising, state, T, batchSize, maxRepetition, result.simulationCount);
+        ++result.bisectionCount;
+
+        std::cout << "T:" << T << '\t' << "phase:" << phase << '\t' << "simulations:" << result.simulationCount << std::endl;
+
+        if(phase > 0) lowT = T;
+        else if(phase < 0) highT = T;
+        else
+        {
+            //統計的に区別できない温度が交点．区間は判定できた両端のまま残す
+            result.stoppedEarly = true;
+            break;
+        }
+    }
+
+    result.lowT = lowT;
+    result.highT = highT;
+    result.Tc = 0.5 * (lowT + highT);
+    return result;
+}
+
+/* 保存した学習済みネットワークで，各格子の転移温度を二分法で推定する．
+ * predictMagnetization の等間隔の温度での推論 (1000温度 × 20回) の代わりに，交点の近くだけでスピン配位を作る．
+ */
+void predictTransitionTemperature()
+{
+    using namespace nn;
+
+    const std::string folder = "F:/repos/isingdata/6_rand/";
+    NetworkModel *model = NetworkModel::load(folder + "network.txt");
+    if(!model) return;
+
+    static constexpr double lowT = 0.1;
+    static constexpr double highT = 10.0;
+    static constexpr double precision = 0.01;
+
+    const TransitionSearchResult results[] = {
+        findTransitionTemperature<LatticeType::Square>(*model, lowT, highT, precision),
+        findTransitionTemperature<LatticeType::Triangle>(*model, lowT, highT, precision),
+        findTransitionTemperature<LatticeType::Rhombus>(*model, lowT, highT, precision),
+        findTransitionTemperature<LatticeType::Hexagonal>(*model, lowT, highT, precision),
+    };
+    const char *names[] = { "square", "triangle", "rhombus", "hexagonal" };
+
+    std::ofstream fout;
+    fout.open("F:/repos/CmpPhys2/03/geditor/train_log/tc_bisection.csv");
+    for(size_t i = 0; i < 4; ++i)
+    {
+        fout << names[i] << ',' << results[i].Tc << ',' << results[i].lowT << ',' << results[i].highT << ','
+             << results[i].simulationCount << ',' << results[i].bisectionCount << ',' << results[i].stoppedEarly << '\n';
+    }
+
+    delete model;
+}
+
+
+
+
+
+
+/* 保存されたスピン配位の学習データ (ラベルは使わない) の主成分を求め，
+ * 各温度のスピン配位を第1主成分に射影した値を秩序変数として保存する (ニューラルネットワークの分類器と比べるため)．
+ * データは1行ずつ読むので vec2d は作らない．スピンは 0/1 なので，2|射影| / sqrt(次元) が |磁化| に対応する．
+ */
+void principalComponentOfSpinConfiguration()
+{
+    const std::string folder = "F:/repos/isingdata/6_rand/";
+    RandomizedPCA pca(4);
+    if(!pca.fit({ folder + "train_x.txt", folder + "test_x.txt" })) return;
+
+    for(size_t c = 0; c < pca.componentCount(); ++c)
+        std::cout << "component " << c << ": " << pca.explainedVarianceRatio(c) << std::endl;
+
+    State<20, 20, bool> state;
+    IsingModel ising;
+    MonteCarlo::Engine<LatticeType::Square,
+                       MonteCarlo::HeatBath,
+                       MonteCarlo::CheckerboardScan,
+                       MonteCarlo::Xoshiro256> engine(&ising);
+    static constexpr size_t sweepCount = 2000;
+    static constexpr size_t sampleCount = 20;
+    const double scale = 2.0 / std::sqrt(static_cast<double>(pca.dimension()));
+
+    std::ofstream fout;
+    fout.open("F:/repos/CmpPhys2/03/geditor/train_log/pca.csv");
+
+    for(double T = 0.05; T < 5.0; T += 0.05)
+    {
+        ising.param.T = T;
+
+        RunningStat order, m;
+        for(size_t i = 0; i < sampleCount; ++i)
+        {
+            state.initRand();
+            for(size_t j = 0; j < sweepCount; ++j) engine.sweep(state);
+
+            nn::vec1d vec;
+            state.createVector1d<double>(vec);
+            order.push(std::abs(pca.project(vec)[0]) * scale);
+            m.push(std::abs(IsingModel::averageSpin(state)));
+        }
+
+        fout << T << ',' << order.mean() << ',' << m.mean() << '\n';
+        std::cout << T << std::endl;
+    }
+}
+
+
+
+
+
+
+/* 各温度でモンテカルロ法の配位を学習データにして RBM を学習させ，RBM のギブスサンプリングで作った配位の
+ * <|m|> と <e> (1サイトあたり) をモンテカルロ法の値と比べる．
+ * 1配位を作る時間も IsingHeatBathMethod::optimize<1000000> と比べる．
+ * 出力は T/Tc，モンテカルロ法の <|m|>，誤差，<e>，誤差，RBM の <|m|>，誤差，<e>，誤差，再構成誤差，1配位の時間 (熱浴法，RBM)．
+ */
+void rbmSamplerOfSpinConfiguration()
+{
+    static constexpr size_t L = 8;
+    static constexpr size_t V = L * L;
+    static constexpr size_t hiddenCount = 64;
+    static constexpr size_t sampleCount = 4000;
+    static constexpr size_t interval = 5;
+    static constexpr size_t epochCount = 200;
+    static constexpr size_t gibbsStepCount = 200;
+
+    using StateType = State<L + 1, L + 1, bool>;
+    StateType state;
+    IsingModel ising;
+    MonteCarlo::Engine<LatticeType::Square,
+                       MonteCarlo::Metropolis,
+                       MonteCarlo::CheckerboardScan,
+                       MonteCarlo::Xoshiro256> engine(&ising);
+    IsingHeatBathMethod<LatticeType::Square> hbMethod(&ising);
+
+    const double Tc = 2 * ising.param.J / (ising.param.kb * std::log(std::sqrt(2) + 1));
+
+    /* 可視ユニット r * L + c のビットから |m| と e を測る */
+    const auto measure = [](const uint64_t *v, RunningStat& m, RunningStat& e)
+    {
+        BlockSpin::Spins spins(L, L);
+        for(size_t j = 0; j < V; ++j)
+            if((v[j / 64] >> (j % 64)) & 1) spins.row(j / L)[(j % L) / 64] |= uint64_t(1) << (j % L % 64);
+
+        double values[BlockSpin::operatorCount];
+        BlockSpin::measureOperators(spins, values);
+        m.push(std::abs(values[BlockSpin::evenOperatorCount]) / V);
+        e.push(-values[0] / V);
+    };
+
+    std::ofstream fout;
+    fout.open("F:/repos/CmpPhys2/03/geditor/train_log/rbm.csv");
+
+    for(const double t : { 0.8, 0.9, 1.0, 1.1, 1.3 })
+    {
+        ising.param.T = t * Tc;
+
+        //学習データ
+        const size_t words = (V + 63) / 64;
+        std::vector<uint64_t> data(sampleCount * words, 0);
+        RunningStat mMC, eMC;
+
+        state.init(true);
+        for(size_t i = 0; i < 1000; ++i) engine.sweep(state);
+        for(size_t n = 0; n < sampleCount; ++n)
+        {
+            for(size_t i = 0; i < interval; ++i) engine.sweep(state);
+
+            uint64_t *v = data.data() + n * words;
+            for(size_t r = 0; r < L; ++r)
+                for(size_t c = 0; c < L; ++c)
+                    if(state.at(r, c)) v[(r * L + c) / 64] |= uint64_t(1) << ((r * L + c) % 64);
+            measure(v, mMC, eMC);
+        }
+
+        nn::RBM rbm(V, hiddenCount);
+        rbm.init();
+        rbm.setLearningRate(0.01);
+        rbm.setGibbsStepCount(5);
+        const double error = rbm.train(data, epochCount, 20);
+
+        auto start = std::chrono::steady_clock::now();
+        const std::vector<uint64_t> samples = rbm.sample(sampleCount, gibbsStepCount);
+        const double rbmSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / sampleCount;
+
+        RunningStat mRBM, eRBM;
+        for(size_t n = 0; n < sampleCount; ++n) measure(samples.data() + n * words, mRBM, eRBM);
+
+        start = std::chrono::steady_clock::now();
+        state.initRand();
+        hbMethod.optimize<1000000>(state);
+        const double hbSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        fout << t << ',' << mMC.mean() << ',' << mMC.standardError() << ',' << eMC.mean() << ',' << eMC.standardError()
+             << ',' << mRBM.mean() << ',' << mRBM.standardError() << ',' << eRBM.mean() << ',' << eRBM.standardError()
+             << ',' << error << ',' << hbSeconds << ',' << rbmSeconds << '\n';
+        std::cout << t << "\t|m| " << mMC.mean() << " / " << mRBM.mean() << "\te " << eMC.mean() << " / " << eRBM.mean() << std::endl;
+    }
+}
+
 #endif // TRAINISINGMODEL_H
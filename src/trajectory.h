@@ -0,0 +1,684 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include "mathutil.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+/* スピン配位の時系列(トラジェクトリ)の保存形式．
+ *
+ * ヘッダ : magic "ISTJ", version, rows, cols, keyframeInterval (各 uint32)
+ * フレーム: type(1byte), stepの差分, upスピン数, payloadのバイト数 (各 varint), payload
+ *   Keyframe : 1サイト1bitで詰めたスピン配位そのもの
+ *   FlipList : 直前のフレームから反転したサイト番号 (row * cols + col) の差分列 (varint)
+ *   XorRle   : 直前のフレームとのXORを 0ワードの連長, 非0ワードの数 (varint), 非0ワード列 の繰り返しで表したもの
+ * 索引   : キーフレームごとに frame, step, offset (各 uint64)
+ * フッタ : 索引のoffset, フレーム数 (各 uint64), magic "ISTI"
+ *
+ * フッタが無い(書き込み途中で終了した)ファイルは，読み込み時にフレームを走査して索引を作り直す．
+ */
+namespace Trajectory
+{
+
+enum class FrameType : uint8_t { Keyframe = 0, FlipList = 1, XorRle = 2 };
+
+constexpr uint32_t headerMagic = 0x4a545349; //"ISTJ"
+constexpr uint32_t footerMagic = 0x49545349; //"ISTI"
+constexpr uint32_t formatVersion = 1;
+constexpr size_t headerSize = 5 * sizeof(uint32_t);
+constexpr size_t footerSize = 2 * sizeof(uint64_t) + sizeof(uint32_t);
+
+struct IndexEntry
+{
+    uint64_t frame;
+    uint64_t step;
+    uint64_t offset;
+};
+
+inline void putVarint(std::vector<uint8_t>& buffer, uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        buffer.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<uint8_t>(value));
+}
+
+/* 読めなかった場合は p を end にして false を返す */
+inline bool getVarint(const uint8_t*& p, const uint8_t *const end, uint64_t& value)
+{
+    value = 0;
+    for(int shift = 0; shift < 64 && p < end; shift += 7)
+    {
+        const uint8_t byte = *p++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if((byte & 0x80) == 0) return true;
+    }
+    p = end;
+    return false;
+}
+
+template<typename T>
+void putRaw(std::vector<uint8_t>& buffer, const T& value)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t*>(&value);
+    buffer.insert(buffer.end(), p, p + sizeof(T));
+}
+
+template<typename T>
+T getRaw(const uint8_t *const p)
+{
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+
+/* 読み込み専用でファイルをメモリにマップする */
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(file == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER fileSize;
+        if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) { close(); return false; }
+        _size = static_cast<size_t>(fileSize.QuadPart);
+
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(mapping == nullptr) { close(); return false; }
+
+        _data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if(_data == nullptr) { close(); return false; }
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0) return false;
+
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size == 0) { close(); return false; }
+        _size = static_cast<size_t>(st.st_size);
+
+        void *p = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+        if(p == MAP_FAILED) { close(); return false; }
+        _data = static_cast<const uint8_t*>(p);
+#endif
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if(_data) UnmapViewOfFile(_data);
+        if(mapping) CloseHandle(mapping);
+        if(file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if(_data) munmap(const_cast<uint8_t*>(_data), _size);
+        if(fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        _data = nullptr;
+        _size = 0;
+    }
+
+    const uint8_t *data() const noexcept { return _data; }
+    size_t size() const noexcept { return _size; }
+    bool isOpen() const noexcept { return _data != nullptr; }
+
+private:
+    const uint8_t *_data = nullptr;
+    size_t _size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+
+
+
+/* スピン配位の時系列をファイルに書き込む．N×M は周期境界の格子の大きさで，
+ * 最後の行と列に最初の行と列の複製を持つ State<N + 1, M + 1, bool> はその内側だけを記録する．
+ * 更新メソッドの optimize(state, writer, interval) にそのまま渡せる．
+ * step が前回より小さい場合は optimize を続けて呼んだものとみなし，前回の step に足して記録する．
+ */
+template<size_t N, size_t M>
+class TrajectoryWriter
+{
+public:
+    TrajectoryWriter(const std::string& path, const size_t& keyframeInterval = 1024)
+        : keyframeInterval(std::max<size_t>(keyframeInterval, 1))
+    {
+        fout.open(path, std::ios::out | std::ios::binary);
+
+        std::vector<uint8_t> header;
+        putRaw<uint32_t>(header, headerMagic);
+        putRaw<uint32_t>(header, formatVersion);
+        putRaw<uint32_t>(header, static_cast<uint32_t>(N));
+        putRaw<uint32_t>(header, static_cast<uint32_t>(M));
+        putRaw<uint32_t>(header, static_cast<uint32_t>(this->keyframeInterval));
+        write(header);
+    }
+    ~TrajectoryWriter() { close(); }
+
+    bool isOpen() const { return fout.is_open() && fout.good(); }
+    size_t frameCount() const noexcept { return frames; }
+
+    void record(const State<N + 1, M + 1, bool>& state, const size_t& step)
+    {
+        for(size_t r = 0; r < N; ++r)
+        {
+            uint64_t *w = current.row(r);
+            std::fill(w, w + BitState<N, M>::wordsPerRow, uint64_t(0));
+            for(size_t c = 0; c < M; ++c)
+                if(state.at(r, c)) w[c / 64] |= uint64_t(1) << (c % 64);
+        }
+        writeFrame(step);
+    }
+
+    void record(const BitState<N, M>& state, const size_t& step)
+    {
+        current = state;
+        writeFrame(step);
+    }
+
+    /* 索引とフッタを書き込んでファイルを閉じる */
+    void close()
+    {
+        if(!fout.is_open()) return;
+
+        std::vector<uint8_t> footer;
+        for(const auto& entry : index)
+        {
+            putRaw<uint64_t>(footer, entry.frame);
+            putRaw<uint64_t>(footer, entry.step);
+            putRaw<uint64_t>(footer, entry.offset);
+        }
+        putRaw<uint64_t>(footer, offset);
+        putRaw<uint64_t>(footer, frames);
+        putRaw<uint32_t>(footer, footerMagic);
+        write(footer);
+
+        fout.close();
+    }
+
+private:
+    void writeFrame(const size_t& requestedStep)
+    {
+        if(!fout.is_open()) return;
+
+        uint64_t step = requestedStep + stepBase;
+        if(frames > 0 && step < lastStep)
+        {
+            stepBase = lastStep;
+            step = requestedStep + stepBase;
+        }
+
+        FrameType type = FrameType::Keyframe;
+        const std::vector<uint8_t> *payload = &keyPayload;
+
+        if(frames % keyframeInterval == 0)
+        {
+            keyPayload.clear();
+            for(size_t i = 0; i < BitState<N, M>::wordCount; ++i)
+                putRaw<uint64_t>(keyPayload, current.data()[i]);
+
+            index.push_back({ frames, step, offset });
+        }
+        else
+        {
+            encodeDelta();
+
+            if(listPayload.size() <= rlePayload.size())
+            {
+                type = FrameType::FlipList;
+                payload = &listPayload;
+            }
+            else
+            {
+                type = FrameType::XorRle;
+                payload = &rlePayload;
+            }
+        }
+
+        frameBuffer.clear();
+        frameBuffer.push_back(static_cast<uint8_t>(type));
+        putVarint(frameBuffer, step - lastStep);
+        putVarint(frameBuffer, current.upCount());
+        putVarint(frameBuffer, payload->size());
+        frameBuffer.insert(frameBuffer.end(), payload->begin(), payload->end());
+        write(frameBuffer);
+
+        previous = current;
+        lastStep = step;
+        frames++;
+    }
+
+    /* 直前のフレームとの差分を2通りで符号化する */
+    void encodeDelta()
+    {
+        static constexpr size_t wordsPerRow = BitState<N, M>::wordsPerRow;
+
+        listPayload.clear();
+        rlePayload.clear();
+
+        uint64_t prevSite = 0;
+        uint64_t zeroRun = 0;
+        size_t literalBegin = 0;
+        size_t literalCount = 0;
+
+        const auto flushLiterals = [&]()
+        {
+            putVarint(rlePayload, zeroRun);
+            putVarint(rlePayload, literalCount);
+            for(size_t k = 0; k < literalCount; ++k)
+                putRaw<uint64_t>(rlePayload, current.data()[literalBegin + k] ^ previous.data()[literalBegin + k]);
+            zeroRun = 0;
+            literalCount = 0;
+        };
+
+        for(size_t i = 0; i < BitState<N, M>::wordCount; ++i)
+        {
+            uint64_t diff = current.data()[i] ^ previous.data()[i];
+
+            if(diff == 0)
+            {
+                if(literalCount > 0) flushLiterals();
+                zeroRun++;
+                continue;
+            }
+
+            if(literalCount == 0) literalBegin = i;
+            literalCount++;
+
+            const uint64_t base = (i / wordsPerRow) * M + (i % wordsPerRow) * 64;
+            while(diff != 0)
+            {
+                const int bit = lowestBit(diff);
+                diff &= diff - 1;
+
+                const uint64_t site = base + bit;
+                putVarint(listPayload, site - prevSite);
+                prevSite = site;
+            }
+        }
+        if(literalCount > 0) flushLiterals();
+    }
+
+    void write(const std::vector<uint8_t>& buffer)
+    {
+        fout.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+        offset += buffer.size();
+    }
+
+    std::ofstream fout;
+    const size_t keyframeInterval;
+
+    BitState<N, M> current;
+    BitState<N, M> previous;
+    std::vector<uint8_t> frameBuffer;
+    std::vector<uint8_t> keyPayload;
+    std::vector<uint8_t> listPayload;
+    std::vector<uint8_t> rlePayload;
+    std::vector<IndexEntry> index;
+
+    uint64_t offset = 0;
+    uint64_t frames = 0;
+    uint64_t lastStep = 0;
+    uint64_t stepBase = 0;
+};
+
+
+
+
+/* メモリマップしたトラジェクトリファイルからフレームを復元する．
+ * 格子の大きさはファイルから読むので，表示側の State の大きさに依存しない．
+ * 連続したフレームを順に読む場合は直前の復元結果から差分だけを適用する．
+ */
+class TrajectoryReader
+{
+public:
+    struct FrameHeader
+    {
+        FrameType type;
+        uint64_t step;
+        uint64_t upCount;
+        const uint8_t *payload;
+        uint64_t payloadSize;
+    };
+
+    bool open(const std::string& path)
+    {
+        close();
+        if(!file.open(path)) return false;
+
+        const uint8_t *p = file.data();
+        if(file.size() < headerSize ||
+           getRaw<uint32_t>(p) != headerMagic ||
+           getRaw<uint32_t>(p + 4) != formatVersion)
+        {
+            close();
+            return false;
+        }
+
+        _rows = getRaw<uint32_t>(p + 8);
+        _cols = getRaw<uint32_t>(p + 12);
+        _keyframeInterval = getRaw<uint32_t>(p + 16);
+        wordsPerRow = (_cols + 63) / 64;
+        words.assign(_rows * wordsPerRow, 0);
+
+        if(!readIndex()) rebuildIndex();
+        if(index.empty())
+        {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void close()
+    {
+        file.close();
+        index.clear();
+        _frameCount = 0;
+        cursorFrame = npos;
+    }
+
+    bool isOpen() const noexcept { return file.isOpen(); }
+    size_t rows() const noexcept { return _rows; }
+    size_t cols() const noexcept { return _cols; }
+    size_t frameCount() const noexcept { return _frameCount; }
+    size_t keyframeInterval() const noexcept { return _keyframeInterval; }
+    const std::vector<IndexEntry>& keyframes() const noexcept { return index; }
+
+    /* frame 番目のフレームを復元する．最も近い手前のキーフレームから差分を適用する． */
+    bool seek(const size_t& frame)
+    {
+        if(frame >= _frameCount) return false;
+        if(cursorFrame != npos && cursorFrame == frame) return true;
+
+        const auto key = std::upper_bound(index.begin(), index.end(), frame,
+                                          [](const size_t& f, const IndexEntry& e){ return f < e.frame; }) - 1;
+
+        if(cursorFrame == npos || cursorFrame > frame || cursorFrame < key->frame)
+        {
+            cursorFrame = key->frame;
+            cursorStep = key->step;
+            cursorOffset = key->offset;
+            if(!applyNext(true)) return false;
+        }
+
+        while(cursorFrame < frame)
+        {
+            cursorFrame++;
+            if(!applyNext(false)) return false;
+        }
+
+        return true;
+    }
+
+    /* step 以下で最も新しいフレームの番号 */
+    size_t frameAtStep(const uint64_t& step) const
+    {
+        auto key = std::upper_bound(index.begin(), index.end(), step,
+                                    [](const uint64_t& s, const IndexEntry& e){ return s < e.step; });
+        if(key != index.begin()) --key;
+
+        size_t frame = key->frame;
+        uint64_t currentStep = key->step;
+        const uint8_t *p = file.data() + key->offset;
+        FrameHeader header;
+
+        while(frame + 1 < _frameCount)
+        {
+            p = skipFrame(p);
+            if(!readHeader(p, currentStep, header) || header.step > step) break;
+            currentStep = header.step;
+            frame++;
+        }
+
+        return frame;
+    }
+
+    /* 全フレームのヘッダを順に f(frame, header) へ渡す．payloadは復元しない． */
+    template<typename Func>
+    void forEachFrameHeader(Func&& f) const
+    {
+        const uint8_t *p = file.data() + headerSize;
+        uint64_t step = 0;
+        FrameHeader header;
+
+        for(size_t frame = 0; frame < _frameCount; ++frame)
+        {
+            if(!readHeader(p, step, header)) break;
+            f(frame, header);
+            step = header.step;
+            p = header.payload + header.payloadSize;
+        }
+    }
+
+    /* 現在のフレームの情報 */
+    size_t frame() const noexcept { return cursorFrame; }
+    uint64_t step() const noexcept { return cursorStep; }
+    size_t upCount() const noexcept { return cursorUpCount; }
+    bool at(const size_t& row, const size_t& col) const noexcept
+    {
+        return (words[row * wordsPerRow + col / 64] >> (col % 64)) & 1;
+    }
+
+    template<size_t N, size_t M>
+    bool copyTo(BitState<N, M>& state) const
+    {
+        if(N != _rows || M != _cols || cursorFrame == npos) return false;
+        std::copy(words.begin(), words.end(), state.data());
+        return true;
+    }
+
+    /* State は最後の行と列に最初の行と列の複製を持つので，rows() + 1 × cols() + 1 の State に写す */
+    template<size_t N, size_t M>
+    bool copyTo(State<N, M, bool>& state) const
+    {
+        if(N != _rows + 1 || M != _cols + 1 || cursorFrame == npos) return false;
+        for(size_t r = 0; r < N; ++r)
+            for(size_t c = 0; c < M; ++c)
+                state[r][c] = at(r % _rows, c % _cols);
+        return true;
+    }
+
+    static constexpr size_t npos = size_t(-1);
+
+private:
+    bool readHeader(const uint8_t* p, const uint64_t& prevStep, FrameHeader& header) const
+    {
+        const uint8_t *end = recordsEnd;
+        if(p >= end) return false;
+
+        header.type = static_cast<FrameType>(*p++);
+        uint64_t stepDelta;
+        if(!getVarint(p, end, stepDelta)) return false;
+        if(!getVarint(p, end, header.upCount)) return false;
+        if(!getVarint(p, end, header.payloadSize)) return false;
+        if(header.payloadSize > static_cast<uint64_t>(end - p)) return false;
+
+        header.step = prevStep + stepDelta;
+        header.payload = p;
+        return true;
+    }
+
+    const uint8_t *skipFrame(const uint8_t* p) const
+    {
+        FrameHeader header;
+        if(!readHeader(p, 0, header)) return recordsEnd;
+        return header.payload + header.payloadSize;
+    }
+
+    /* cursorOffset のフレームを words に適用して cursorOffset を進める */
+    bool applyNext(const bool& isKeyframe)
+    {
+        FrameHeader header;
+        const uint64_t prevStep = (isKeyframe) ? 0 : cursorStep;
+        if(!readHeader(file.data() + cursorOffset, prevStep, header)) return invalidate();
+
+        const uint8_t *p = header.payload;
+        const uint8_t *end = p + header.payloadSize;
+
+        if(isKeyframe)
+        {
+            if(header.type != FrameType::Keyframe ||
+               header.payloadSize != words.size() * sizeof(uint64_t)) return invalidate();
+            for(size_t i = 0; i < words.size(); ++i)
+                words[i] = getRaw<uint64_t>(p + i * sizeof(uint64_t));
+            header.step = cursorStep; //キーフレームの step は索引の値
+        }
+        else if(header.type == FrameType::Keyframe)
+        {
+            if(header.payloadSize != words.size() * sizeof(uint64_t)) return invalidate();
+            for(size_t i = 0; i < words.size(); ++i)
+                words[i] = getRaw<uint64_t>(p + i * sizeof(uint64_t));
+        }
+        else if(header.type == FrameType::FlipList)
+        {
+            uint64_t site = 0;
+            while(p < end)
+            {
+                uint64_t gap;
+                if(!getVarint(p, end, gap)) return invalidate();
+                site += gap;
+                const size_t row = site / _cols;
+                const size_t col = site % _cols;
+                if(row >= _rows) return invalidate();
+                words[row * wordsPerRow + col / 64] ^= uint64_t(1) << (col % 64);
+            }
+        }
+        else if(header.type == FrameType::XorRle)
+        {
+            size_t i = 0;
+            while(p < end)
+            {
+                uint64_t zeroRun, literalCount;
+                if(!getVarint(p, end, zeroRun) || !getVarint(p, end, literalCount)) return invalidate();
+                i += zeroRun;
+                if(i + literalCount > words.size() ||
+                   literalCount * sizeof(uint64_t) > static_cast<uint64_t>(end - p)) return invalidate();
+                for(uint64_t k = 0; k < literalCount; ++k, ++i, p += sizeof(uint64_t))
+                    words[i] ^= getRaw<uint64_t>(p);
+            }
+        }
+        else
+            return invalidate();
+
+        cursorStep = header.step;
+        cursorUpCount = header.upCount;
+        cursorOffset = static_cast<uint64_t>(end - file.data());
+        return true;
+    }
+
+    bool invalidate()
+    {
+        cursorFrame = npos;
+        return false;
+    }
+
+    bool readIndex()
+    {
+        const size_t size = file.size();
+        if(size < headerSize + footerSize) return false;
+
+        const uint8_t *footer = file.data() + size - footerSize;
+        if(getRaw<uint32_t>(footer + 16) != footerMagic) return false;
+
+        const uint64_t indexOffset = getRaw<uint64_t>(footer);
+        const uint64_t frameCount = getRaw<uint64_t>(footer + 8);
+        const uint64_t indexSize = size - footerSize - indexOffset;
+        if(indexOffset < headerSize || indexOffset > size - footerSize ||
+           indexSize % (3 * sizeof(uint64_t)) != 0) return false;
+
+        index.resize(indexSize / (3 * sizeof(uint64_t)));
+        for(size_t i = 0; i < index.size(); ++i)
+        {
+            const uint8_t *p = file.data() + indexOffset + i * 3 * sizeof(uint64_t);
+            index[i] = { getRaw<uint64_t>(p), getRaw<uint64_t>(p + 8), getRaw<uint64_t>(p + 16) };
+        }
+
+        recordsEnd = file.data() + indexOffset;
+        _frameCount = frameCount;
+        return true;
+    }
+
+    /* フッタが壊れている場合は，フレームを先頭から走査して索引を作る */
+    void rebuildIndex()
+    {
+        index.clear();
+        recordsEnd = file.data() + file.size();
+
+        const uint8_t *p = file.data() + headerSize;
+        uint64_t step = 0;
+        size_t frame = 0;
+        FrameHeader header;
+
+        while(readHeader(p, step, header) && header.type <= FrameType::XorRle)
+        {
+            if(header.type == FrameType::Keyframe && header.payloadSize != words.size() * sizeof(uint64_t)) break;
+            if(header.type == FrameType::Keyframe)
+                index.push_back({ frame, header.step, static_cast<uint64_t>(p - file.data()) });
+            step = header.step;
+            p = header.payload + header.payloadSize;
+            frame++;
+        }
+
+        _frameCount = frame;
+    }
+
+    MappedFile file;
+    std::vector<IndexEntry> index;
+    const uint8_t *recordsEnd = nullptr;
+
+    size_t _rows = 0;
+    size_t _cols = 0;
+    size_t _keyframeInterval = 0;
+    size_t _frameCount = 0;
+
+    size_t wordsPerRow = 0;
+    std::vector<uint64_t> words;
+
+    size_t cursorFrame = npos;
+    uint64_t cursorStep = 0;
+    uint64_t cursorOffset = 0;
+    size_t cursorUpCount = 0;
+};
+
+} //namespace Trajectory
+
+#endif // TRAJECTORY_H
@@ -0,0 +1,504 @@
+#ifndef VECTORSPIN_H
+#define VECTORSPIN_H
+
+#include "mathutil.h"
+#include "isingmodel.h"
+#include "montecarlo.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+
+/* O(n) ベクトルスピン模型 (n = 2: XY，n = 3: Heisenberg) H = - J Σ_(ij) s_i・s_j のモンテカルロ法．
+ * 正方格子 L×L (L は偶数) の周期境界のみ．
+ *
+ * スピンは成分ごとの面 (structure of arrays) に分けて持ち，さらに各面をチェッカーボードの2つの副格子に分ける．
+ * 色 a のサイト (r, c) は面の中の (a, r, c / 2) にあり，同じ色のサイトは1行の中で連続する．
+ * 隣 (色 1 - a) は上下の行の同じ k と，同じ行の k と k ∓ 1 なので，1行分の局所場と更新が
+ * 分岐のない連続したループになり，コンパイラが SIMD 化できる．
+ *
+ *   VectorSpin::Lattice<3> lattice(64);
+ *   VectorSpin::Engine<3> engine(&ising);
+ *   engine.heatBathSweep(lattice);
+ *   for(int i = 0; i < 4; ++i) engine.overRelaxationSweep(lattice);
+ *   engine.wolffUpdate(lattice);
+ *
+ * 温度と J は IsingModel から読む．
+ */
+namespace VectorSpin
+{
+
+template<size_t Components>
+class Lattice
+{
+public:
+    static_assert(Components >= 2, "vector spins need at least 2 components");
+
+    explicit Lattice(const size_t& L)
+        : L(L)
+        , half(L / 2)
+    {
+        for(auto& plane : planes) plane.assign(L * L, 0.0);
+        init();
+    }
+
+    /* すべてのスピンを第1成分の向きにそろえる */
+    void init()
+    {
+        for(size_t a = 0; a < Components; ++a) std::fill(planes[a].begin(), planes[a].end(), (a == 0) ? 1.0 : 0.0);
+    }
+
+    /* 球面上で一様なランダムな向きにする */
+    template<typename Rng>
+    void initRand(Rng& rng)
+    {
+        std::normal_distribution<double> gaussian(0.0, 1.0);
+        for(size_t i = 0; i < L * L; ++i)
+        {
+            double norm = 0.0;
+            for(auto& plane : planes)
+            {
+                plane[i] = gaussian(rng);
+                norm += plane[i] * plane[i];
+            }
+            norm = 1.0 / std::sqrt(norm);
+            for(auto& plane : planes) plane[i] *= norm;
+        }
+    }
+
+    size_t size() const noexcept { return L; }
+    size_t siteCount() const noexcept { return L * L; }
+
+    /* サイト (r, c) の面の中の位置 */
+    size_t index(const size_t& r, const size_t& c) const noexcept
+    {
+        return (((r + c) & 1) * L + r) * half + c / 2;
+    }
+
+    /* 面の中の位置 i のサイトの (r, c) */
+    void position(const size_t& i, size_t& r, size_t& c) const noexcept
+    {
+        const size_t color = i / (L * half);
+        r = (i / half) % L;
+        c = 2 * (i % half) + ((r + color) & 1);
+    }
+
+    /* 色 color の行 r (half 個) の成分 a */
+    double* row(const size_t& a, const size_t& color, const size_t& r) noexcept { return &planes[a][(color * L + r) * half]; }
+    const double* row(const size_t& a, const size_t& color, const size_t& r) const noexcept { return &planes[a][(color * L + r) * half]; }
+
+    double& at(const size_t& a, const size_t& i) noexcept { return planes[a][i]; }
+    double at(const size_t& a, const size_t& i) const noexcept { return planes[a][i]; }
+
+    void get(const size_t& r, const size_t& c, double (&s)[Components]) const noexcept
+    {
+        const size_t i = index(r, c);
+        for(size_t a = 0; a < Components; ++a) s[a] = planes[a][i];
+    }
+
+    void set(const size_t& r, const size_t& c, const double (&s)[Components]) noexcept
+    {
+        const size_t i = index(r, c);
+        for(size_t a = 0; a < Components; ++a) planes[a][i] = s[a];
+    }
+
+private:
+    size_t L;
+    size_t half;
+    AlignedVector<double> planes[Components];
+
+    template<size_t> friend class Engine;
+};
+
+
+template<size_t Components>
+class Engine
+{
+public:
+    using PlaneType = Lattice<Components>;
+
+    explicit Engine(IsingModel *ising, const uint64_t& seed = 0x9e3779b97f4a7c15ULL)
+        : ising(ising)
+        , _rng(seed) {}
+
+    /* Metropolis 法の試行 s' = (s + δ g) / |s + δ g| の δ (g は標準正規分布) */
+    void setStepSize(const double& delta) { stepSize = delta; }
+
+    void setSeed(const uint64_t& seed) { _rng.seed(seed); }
+    MonteCarlo::Xoshiro256& rng() noexcept { return _rng; }
+
+    /* これまでの Metropolis 法の採択率 */
+    double acceptanceRate() const noexcept { return (trialCount == 0) ? 0.0 : static_cast<double>(acceptCount) / trialCount; }
+
+    /* 両方の副格子を Metropolis 法で1回ずつ更新する */
+    void metropolisSweep(PlaneType& lattice)
+    {
+        const double K = ising->param.J / ising->kbT();
+        const size_t half = lattice.half;
+        prepare(half);
+
+        for(size_t color = 0; color < 2; ++color)
+            for(size_t r = 0; r < lattice.L; ++r)
+            {
+                localField(lattice, color, r);
+                fillGaussian(Components * half);
+                fillUniform(half);
+
+                double *s[Components];
+                for(size_t a = 0; a < Components; ++a) s[a] = lattice.row(a, color, r);
+
+                size_t accepted = 0;
+                for(size_t k = 0; k < half; ++k)
+                {
+                    double trial[Components];
+                    double norm = 0.0;
+                    for(size_t a = 0; a < Components; ++a)
+                    {
+                        trial[a] = s[a][k] + stepSize * gaussians[a * half + k];
+                        norm += trial[a] * trial[a];
+                    }
+                    norm = 1.0 / std::sqrt(norm);
+
+                    //-βΔE = K (s' - s)・h
+                    double gain = 0.0;
+                    for(size_t a = 0; a < Components; ++a)
+                    {
+                        trial[a] *= norm;
+                        gain += (trial[a] - s[a][k]) * fields[a][k];
+                    }
+
+                    const bool accept = uniforms[k] < std::exp(K * gain);
+                    for(size_t a = 0; a < Components; ++a) s[a][k] = (accept) ? trial[a] : s[a][k];
+                    accepted += (accept) ? 1 : 0;
+                }
+
+                acceptCount += accepted;
+                trialCount += half;
+            }
+    }
+
+    /* 両方の副格子を熱浴法で1回ずつ更新する．
+     * Heisenberg (n = 3) は cosθ を逆関数法で引き，h に垂直な向きは正規乱数の垂直成分から作るので分岐がない．
+     * XY (n = 2) は von Mises 分布を Best-Fisher の棄却法で引く．
+     */
+    void heatBathSweep(PlaneType& lattice)
+    {
+        static_assert(Components == 2 || Components == 3, "heat bath is implemented for XY and Heisenberg spins");
+
+        const double J = ising->param.J;
+        const double beta = 1.0 / ising->kbT();
+        const double sign = (J < 0.0) ? -1.0 : 1.0;
+        const size_t half = lattice.half;
+        prepare(half);
+
+        for(size_t color = 0; color < 2; ++color)
+            for(size_t r = 0; r < lattice.L; ++r)
+            {
+                localField(lattice, color, r);
+
+                double *s[Components];
+                for(size_t a = 0; a < Components; ++a) s[a] = lattice.row(a, color, r);
+
+                if constexpr(Components == 3)
+                {
+                    fillGaussian(3 * half);
+                    fillUniform(half);
+
+                    for(size_t k = 0; k < half; ++k)
+                    {
+                        const double hx = fields[0][k], hy = fields[1][k], hz = fields[2][k];
+                        const double H = std::sqrt(hx * hx + hy * hy + hz * hz);
+                        const double K = beta * std::abs(J) * H;
+
+                        //h = 0 では任意の単位ベクトルを軸にする (cosθ は一様になる)
+                        const double inv = (H > 0.0) ? sign / H : 0.0;
+                        const double ex = (H > 0.0) ? hx * inv : 1.0;
+                        const double ey = hy * inv, ez = hz * inv;
+
+                        //p(cosθ) ∝ exp(K cosθ)
+                        const double u = uniforms[k];
+                        const double cosTheta = (K > 1e-10) ? 1.0 + std::log(1.0 - u * (1.0 - std::exp(-2.0 * K))) / K : 2.0 * u - 1.0;
+                        const double sinTheta = std::sqrt(std::max(0.0, 1.0 - cosTheta * cosTheta));
+
+                        double wx = gaussians[k], wy = gaussians[half + k], wz = gaussians[2 * half + k];
+                        const double dot = wx * ex + wy * ey + wz * ez;
+                        wx -= dot * ex;
+                        wy -= dot * ey;
+                        wz -= dot * ez;
+                        const double norm = sinTheta / std::sqrt(wx * wx + wy * wy + wz * wz + 1e-300);
+
+                        s[0][k] = cosTheta * ex + norm * wx;
+                        s[1][k] = cosTheta * ey + norm * wy;
+                        s[2][k] = cosTheta * ez + norm * wz;
+                    }
+                }
+                else
+                {
+                    for(size_t k = 0; k < half; ++k)
+                    {
+                        const double hx = fields[0][k], hy = fields[1][k];
+                        const double H = std::sqrt(hx * hx + hy * hy);
+                        const double theta = vonMises(beta * std::abs(J) * H);
+
+                        const double ex = (H > 0.0) ? sign * hx / H : 1.0;
+                        const double ey = (H > 0.0) ? sign * hy / H : 0.0;
+                        const double c = std::cos(theta), sn = std::sin(theta);
+                        s[0][k] = c * ex - sn * ey;
+                        s[1][k] = sn * ex + c * ey;
+                    }
+                }
+            }
+    }
+
+    /* 両方の副格子を過緩和 s' = 2 (s・h) h / |h|^2 - s で1回ずつ更新する．
+     * エネルギーを変えない (小正準) ので乱数は使わず，熱浴法と組み合わせて自己相関を短くする．
+     */
+    void overRelaxationSweep(PlaneType& lattice)
+    {
+        const size_t half = lattice.half;
+        prepare(half);
+
+        for(size_t color = 0; color < 2; ++color)
+            for(size_t r = 0; r < lattice.L; ++r)
+            {
+                localField(lattice, color, r);
+
+                double *s[Components];
+                for(size_t a = 0; a < Components; ++a) s[a] = lattice.row(a, color, r);
+
+                for(size_t k = 0; k < half; ++k)
+                {
+                    double dot = 0.0, norm = 0.0;
+                    for(size_t a = 0; a < Components; ++a)
+                    {
+                        dot += s[a][k] * fields[a][k];
+                        norm += fields[a][k] * fields[a][k];
+                    }
+
+                    //h = 0 ではそのまま
+                    const double scale = (norm > 0.0) ? 2.0 * dot / norm : 0.0;
+                    for(size_t a = 0; a < Components; ++a)
+                        s[a][k] = (norm > 0.0) ? scale * fields[a][k] - s[a][k] : s[a][k];
+                }
+            }
+    }
+
+    /* Wolff の埋め込みクラスター更新．ランダムな向き e へのスピンの射影をイジング変数とみなし，
+     * 確率 1 - exp(-2βJ (s_i・e)(s_j・e)) でボンドをつないだクラスターの射影を反転する．クラスターの大きさを返す．
+     */
+    size_t wolffUpdate(PlaneType& lattice)
+    {
+        const double K = ising->param.J / ising->kbT();
+        const size_t L = lattice.L;
+        prepare(lattice.half);
+
+        double e[Components];
+        randomDirection(e);
+
+        marks.assign(lattice.siteCount(), 0);
+        stack.clear();
+
+        const auto project = [&](const size_t& i)
+        {
+            double dot = 0.0;
+            for(size_t a = 0; a < Components; ++a) dot += lattice.at(a, i) * e[a];
+            return dot;
+        };
+        const auto flip = [&](const size_t& i, const double& p)
+        {
+            for(size_t a = 0; a < Components; ++a) lattice.at(a, i) -= 2.0 * p * e[a];
+        };
+
+        const size_t seed = static_cast<size_t>(uniform01() * lattice.siteCount()) % lattice.siteCount();
+        const double seedProjection = project(seed);
+        marks[seed] = 1;
+        flip(seed, seedProjection);
+        stack.push_back({ seed, seedProjection });
+
+        size_t size = 0;
+        while(!stack.empty())
+        {
+            const auto [i, p] = stack.back();
+            stack.pop_back();
+            size++;
+
+            size_t r, c;
+            lattice.position(i, r, c);
+            const size_t neighbors[4] = {
+                lattice.index((r + L - 1) % L, c), lattice.index((r + 1) % L, c),
+                lattice.index(r, (c + L - 1) % L), lattice.index(r, (c + 1) % L)
+            };
+
+            for(const size_t& j : neighbors)
+            {
+                if(marks[j]) continue;
+
+                const double q = project(j);
+                const double x = 2.0 * K * p * q;
+                if(x > 0.0 && uniform01() < 1.0 - std::exp(-x))
+                {
+                    marks[j] = 1;
+                    flip(j, q);
+                    stack.push_back({ j, q });
+                }
+            }
+        }
+
+        return size;
+    }
+
+    /* 全エネルギー (各ボンドを1回ずつ数える．ボンドは必ず色 0 と色 1 をつなぐ) */
+    double energy(const PlaneType& lattice)
+    {
+        prepare(lattice.half);
+
+        double sum = 0.0;
+        for(size_t r = 0; r < lattice.L; ++r)
+        {
+            localField(lattice, 0, r);
+            for(size_t a = 0; a < Components; ++a)
+            {
+                const double *s = lattice.row(a, 0, r);
+                for(size_t k = 0; k < lattice.half; ++k) sum += s[k] * fields[a][k];
+            }
+        }
+
+        return - ising->param.J * sum;
+    }
+
+    /* 磁化 (1サイトあたりのベクトル) */
+    static void magnetization(const PlaneType& lattice, double (&m)[Components]) noexcept
+    {
+        for(size_t a = 0; a < Components; ++a)
+        {
+            double sum = 0.0;
+            for(const auto& x : lattice.planes[a]) sum += x;
+            m[a] = sum / lattice.siteCount();
+        }
+    }
+
+private:
+    struct Entry
+    {
+        size_t site;
+        double projection;  //反転する前の s・e
+    };
+
+    void prepare(const size_t& half)
+    {
+        if(fields[0].size() == half) return;
+
+        for(auto& field : fields) field.assign(half, 0.0);
+        gaussians.assign(Components * half + 1, 0.0);
+        uniforms.assign(half, 0.0);
+    }
+
+    /* 色 color の行 r の各サイトの局所場 (色 1 - color の4つの隣の和) を fields に入れる */
+    void localField(const PlaneType& lattice, const size_t& color, const size_t& r)
+    {
+        const size_t L = lattice.L, half = lattice.half;
+        const size_t other = 1 - color;
+        const size_t up = (r + L - 1) % L, down = (r + 1) % L;
+        const bool shiftRight = ((r + color) & 1) != 0;  //横の隣が k と k + 1 (false なら k と k - 1)
+
+        for(size_t a = 0; a < Components; ++a)
+        {
+            const double *U = lattice.row(a, other, up);
+            const double *D = lattice.row(a, other, down);
+            const double *S = lattice.row(a, other, r);
+            double *h = fields[a].data();
+
+            for(size_t k = 0; k < half; ++k) h[k] = U[k] + D[k] + S[k];
+            if(shiftRight)
+            {
+                for(size_t k = 0; k + 1 < half; ++k) h[k] += S[k + 1];
+                h[half - 1] += S[0];
+            }
+            else
+            {
+                h[0] += S[half - 1];
+                for(size_t k = 1; k < half; ++k) h[k] += S[k - 1];
+            }
+        }
+    }
+
+    double uniform01() noexcept { return static_cast<double>(_rng() >> 11) * (1.0 / 9007199254740992.0); }
+
+    void fillUniform(const size_t& count)
+    {
+        for(size_t i = 0; i < count; ++i) uniforms[i] = uniform01();
+    }
+
+    /* Box-Muller 法で count 個 (偶数に切り上げ) の標準正規乱数を作る */
+    void fillGaussian(const size_t& count)
+    {
+        static constexpr double twoPi = 6.283185307179586;
+        for(size_t i = 0; i < count; i += 2)
+        {
+            const double radius = std::sqrt(-2.0 * std::log(1.0 - uniform01()));
+            const double angle = twoPi * uniform01();
+            gaussians[i] = radius * std::cos(angle);
+            gaussians[i + 1] = radius * std::sin(angle);
+        }
+    }
+
+    void randomDirection(double (&e)[Components])
+    {
+        fillGaussian(Components);
+        double norm = 0.0;
+        for(size_t a = 0; a < Components; ++a)
+        {
+            e[a] = gaussians[a];
+            norm += e[a] * e[a];
+        }
+        norm = 1.0 / std::sqrt(norm);
+        for(auto& x : e) x *= norm;
+    }
+
+    /* p(θ) ∝ exp(κ cosθ) の θ ∈ (-π, π] (Best-Fisher 法) */
+    double vonMises(const double& kappa)
+    {
+        static constexpr double pi = 3.141592653589793;
+        if(kappa < 1e-8) return pi * (2.0 * uniform01() - 1.0);
+
+        const double tau = 1.0 + std::sqrt(1.0 + 4.0 * kappa * kappa);
+        const double rho = (tau - std::sqrt(2.0 * tau)) / (2.0 * kappa);
+        const double r = (1.0 + rho * rho) / (2.0 * rho);
+
+        while(true)
+        {
+            const double z = std::cos(pi * uniform01());
+            const double f = (1.0 + r * z) / (r + z);
+            const double c = kappa * (r - f);
+            const double u = 1.0 - uniform01();
+
+            if(c * (2.0 - c) > u || std::log(c / u) + 1.0 >= c)
+            {
+                const double theta = std::acos(std::min(1.0, std::max(-1.0, f)));
+                return (uniform01() < 0.5) ? -theta : theta;
+            }
+        }
+    }
+
+    IsingModel *ising; //this has no ownership
+    MonteCarlo::Xoshiro256 _rng;
+    double stepSize = 1.0;
+
+    AlignedVector<double> fields[Components];
+    AlignedVector<double> gaussians;
+    AlignedVector<double> uniforms;
+    std::vector<uint8_t> marks;
+    std::vector<Entry> stack;
+
+    size_t acceptCount = 0;
+    size_t trialCount = 0;
+};
+
+using XY = Engine<2>;
+using Heisenberg = Engine<3>;
+
+} //namespace VectorSpin
+
+#endif // VECTORSPIN_H